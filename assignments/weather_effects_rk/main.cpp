@@ -1,10 +1,10 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
-#include <random>
 
 #include <vector>
 #include <chrono>
+#include <cstddef>
 
 #include "shader.h"
 #include "glmutils.h"
@@ -49,9 +49,7 @@ unsigned int screenHeight = 1080;
 float loopInterval = 0.f;
 bool renderAsParticle = true;
 
-glm::vec3 gravityOffset = glm::vec3(0);
 glm::vec3 gravityVelocity = glm::vec3(0.f, -1.f, 0.f);
-glm::vec3 windOffset = glm::vec3(0);
 glm::vec3 windVelocity = glm::vec3(0.2f, 0.f, 0.2f);
 float distanceToCube = 10;
 float currentTime = 0;
@@ -73,101 +71,157 @@ struct Camera {
 };
 Camera camera;
 
+// a particle of the GPU simulation (shaders/particle_simulation.glsl), 32 bytes that match the layouts of the vertex
+// attributes, of the transform feedback outputs and of the std430 buffer of the compute shader
 struct Particle {
-    glm::vec3 position;
+    glm::vec4 positionAndAge; // xyz position, w age in seconds
+    glm::vec4 velocityAndLifetime; // xyz velocity, w age at which the particle respawns
 };
 
+// the particles live in buffers on the GPU, and a shader moves them each frame: a compute shader that updates the
+// buffer in place (OpenGL 4.3), or a vertex shader whose outputs are captured with transform feedback from one buffer
+// to the other (OpenGL 3.3), the two buffers swap roles every frame. The CPU only sets the uniforms, so the cost of a
+// frame on the CPU does not depend on the number of particles
 struct ParticleSystem {
     float boxSize = 2;
-    unsigned int VAO{};
-    unsigned int VBO{};
+    unsigned int VAO[2]{};
+    unsigned int VBO[2]{};
+    // the buffer that holds the particles of the current frame
+    int current = 0;
+    int frame = 0;
     int particleCount = 12000;
-    int attributeCount = 3;
-    std::vector<float> particlesDataBuffer = std::vector<float>(particleCount*attributeCount);
+    // about 6 million, 2 buffers of 197 MB, and well below the 65535 x 256 particles of a dispatch of the compute shader
+    int maxParticleCount = 12000 << 9;
     Shader* program{};
-
+    Shader* updateProgram{};
+    Shader* computeProgram{};
+    bool useCompute = false;
+    // how much the velocity of a particle changes in random gusts, per second
+    float turbulence = 0.5f;
+    float floorHeight = 0.f;
+    glm::vec2 lifetimeRange = glm::vec2(2.f, 6.f);
+
+    // (re)allocate both buffers for particleCount particles. They all start expired, so the first update spawns them
+    // in the box around the camera
     void generateParticles()
     {
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-        std::random_device rd; // obtain a random number from hardware
-        std::mt19937 gen(rd()); // seed
-        std::uniform_real_distribution<> distr(-boxSize/2, boxSize/2);
-
-        for(int i = 0; i < particleCount*attributeCount; i+=attributeCount*2)
+        std::vector<Particle> particles(particleCount, Particle{glm::vec4(0), glm::vec4(0)});
+        for (unsigned int buffer : VBO)
         {
-            glm::vec3 position = glm::vec3(distr(gen), distr(gen), distr(gen));
-
-            particlesDataBuffer[i + 0] = position.x;
-            particlesDataBuffer[i + 1] = position.y;
-            particlesDataBuffer[i + 2] = position.z;
-
-            particlesDataBuffer[i + 3] = position.x;
-            particlesDataBuffer[i + 4] = position.y;
-            particlesDataBuffer[i + 5] = position.z;
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glBufferData(GL_ARRAY_BUFFER, particleCount * sizeof(Particle), &particles[0], GL_DYNAMIC_COPY);
         }
-
-        glBufferData(GL_ARRAY_BUFFER, particleCount * sizeof(Particle), &particlesDataBuffer[0], GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        current = 0;
     }
 
     void init()
     {
         program = new Shader("shaders/particle.vert", "shaders/particle.frag");
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        updateProgram = new Shader({"shaders/particle_update.vert", "shaders/particle_simulation.glsl"},
+                                   {"outPositionAndAge", "outVelocityAndLifetime"});
+        if (GLAD_GL_VERSION_4_3)
+        {
+            computeProgram = new Shader(std::vector<std::string>{"shaders/particle_update.comp",
+                                                                 "shaders/particle_simulation.glsl"});
+            useCompute = true;
+        }
+        glGenVertexArrays(2, VAO);
+        glGenBuffers(2, VBO);
+        for (int i = 0; i < 2; i++)
+        {
+            glBindVertexArray(VAO[i]);
+            glBindBuffer(GL_ARRAY_BUFFER, VBO[i]);
+            bindParticleAttributes();
+        }
+        glBindVertexArray(0);
+    }
 
-        for(float & i : particlesDataBuffer) i = 0.0f;
+    void bindParticleAttributes() {
+        // the update and the render shaders read the particles at the same locations
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)offsetof(Particle, positionAndAge));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)offsetof(Particle, velocityAndLifetime));
+        glEnableVertexAttribArray(1);
+    }
 
-        glBufferData(GL_ARRAY_BUFFER, particleCount * sizeof(Particle), &particlesDataBuffer[0], GL_DYNAMIC_DRAW);
-        bindParticleAttributes();
+    void setSimulationUniforms(const Shader &shader, const glm::vec3 &boxMin) const
+    {
+        shader.setFloat("deltaTime", loopInterval);
+        shader.setInt("frame", frame);
+        shader.setVec3("boxMin", boxMin);
+        shader.setFloat("boxSize", boxSize);
+        shader.setVec3("gravityVelocity", gravityVelocity);
+        shader.setVec3("windVelocity", windVelocity);
+        shader.setFloat("turbulence", turbulence);
+        shader.setFloat("floorHeight", floorHeight);
+        shader.setVec2("lifetimeRange", lifetimeRange);
     }
 
-    void bindParticleAttributes() {
-        int posSize = 3; // each position consists of x,y,z
-        GLuint vertexLocation = glGetAttribLocation(program->ID, "particlePosition");
-        glVertexAttribPointer(vertexLocation, posSize, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)0);
-        glEnableVertexAttribArray(vertexLocation);
+    // move the particles by loopInterval seconds, the ones that expire respawn in the box in front of the camera
+    void updateParticles()
+    {
+        glm::vec3 boxMin = camera.position + camera.forward - boxSize/2;
+
+        if (useCompute)
+        {
+            computeProgram->use();
+            setSimulationUniforms(*computeProgram, boxMin);
+            computeProgram->setInt("particleCount", particleCount);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, VBO[current]);
+            glDispatchCompute((particleCount + 255) / 256, 1, 1);
+            // the draw reads the particles as vertex attributes, and the next dispatch reads them from the buffer
+            glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+        else
+        {
+            updateProgram->use();
+            setSimulationUniforms(*updateProgram, boxMin);
+            int next = 1 - current;
+            glEnable(GL_RASTERIZER_DISCARD);
+            glBindVertexArray(VAO[current]);
+            // the update draws the particles as points with no divisor, whatever the render mode
+            glVertexAttribDivisor(0, 0);
+            glVertexAttribDivisor(1, 0);
+            glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, VBO[next]);
+            glBeginTransformFeedback(GL_POINTS);
+            glDrawArrays(GL_POINTS, 0, particleCount);
+            glEndTransformFeedback();
+            glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+            glBindVertexArray(0);
+            glDisable(GL_RASTERIZER_DISCARD);
+            current = next;
+        }
+        frame++;
     }
 
     void drawParticles()
     {
-        glm::vec3 cameraPosition = camera.position;
-        program->setVec3("cameraPosition", cameraPosition);
+        updateParticles();
+        program->use();
 
         glm::mat4 mvpMatrix = camera.getViewProjectionMatrix();
         program->setMat4("mvpMatrix", mvpMatrix);
         program->setMat4("previousMvpMatrix", camera.previousMvpMatrix);
 
-        glm::vec3 forwardOffset = camera.forward;
-        program->setVec3("forwardOffset", forwardOffset);
-        program->setVec3("windVelocity", windVelocity);
-        program->setVec3("gravityVelocity", gravityVelocity);
-
-        gravityOffset += loopInterval * gravityVelocity;
-        windOffset += loopInterval * windVelocity;
-
-        glm::vec3 offsets = gravityOffset + windOffset;
-        offsets -= cameraPosition + forwardOffset + boxSize/2;
-        offsets = glm::mod(offsets, boxSize);
-        program->setVec3("in_Offsets", offsets);
-
-        program->setFloat("boxSize", boxSize);
         program->setBool("renderAsParticle", renderAsParticle);
         program->setFloat("particleScale", particleScale);
 
-        glBindVertexArray(VAO);
+        glBindVertexArray(VAO[current]);
         if (renderAsParticle)
         {
+            glVertexAttribDivisor(0, 0);
+            glVertexAttribDivisor(1, 0);
             glDisable(GL_BLEND);
             glDrawArrays(GL_POINTS, 0, particleCount);
         }
         else
         {
+            // a line of 2 vertices per particle, each instance reads the attributes of its particle
+            glVertexAttribDivisor(0, 1);
+            glVertexAttribDivisor(1, 1);
             glEnable(GL_BLEND);
-            glDrawArrays(GL_LINES, 0, particleCount);
+            glDrawArraysInstanced(GL_LINES, 0, 2, particleCount);
             glDisable(GL_BLEND);
         }
         glBindVertexArray(0);
@@ -203,6 +257,13 @@ int main()
     // --------------------
     GLFWwindow* window = glfwCreateWindow(screenWidth, screenHeight, "Exercise 5.2", nullptr, nullptr);
     if (window == nullptr)
+    {
+        // without OpenGL 4.3 (e.g. on macOS) the particles are simulated with transform feedback, from OpenGL 3.3
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(screenWidth, screenHeight, "Exercise 5.2", nullptr, nullptr);
+    }
+    if (window == nullptr)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -262,6 +323,8 @@ int main()
 
     delete shaderProgram;
     delete particleSystem.program;
+    delete particleSystem.updateProgram;
+    delete particleSystem.computeProgram;
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
@@ -285,7 +348,6 @@ void drawObjects(){
     drawPlane(viewProjection * glm::translate(-2.0f, .5f, 2.0f) * glm::rotateX(glm::quarter_pi<float>()) * scale);
     drawPlane(viewProjection * glm::translate(2.0f, .5f, -2.0f) * glm::rotateX(glm::quarter_pi<float>() * 3.f) * scale);
 
-    particleSystem.program->use();
     particleSystem.drawParticles();
 }
 
@@ -483,6 +545,27 @@ void processInput(GLFWwindow *window) {
         windVelocity = glm::vec3(0.2f, 0.f, 0.2f);
     }
 
+    // double or halve the number of particles, and switch between the compute and the transform feedback updates,
+    // once per key press
+    static bool morePressed = false, fewerPressed = false, computePressed = false;
+    bool more = glfwGetKey(window, GLFW_KEY_EQUAL) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_KP_ADD) == GLFW_PRESS;
+    bool fewer = glfwGetKey(window, GLFW_KEY_MINUS) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_KP_SUBTRACT) == GLFW_PRESS;
+    bool compute = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
+    // the direction comes from the key that was just pressed, the other one may still be held down
+    bool doubleCount = more && !morePressed && particleSystem.particleCount * 2 <= particleSystem.maxParticleCount;
+    bool halveCount = fewer && !fewerPressed && particleSystem.particleCount > 1000;
+    if (doubleCount != halveCount){
+        particleSystem.particleCount = doubleCount ? particleSystem.particleCount * 2 : particleSystem.particleCount / 2;
+        particleSystem.generateParticles();
+        std::cout << particleSystem.particleCount << " particles" << std::endl;
+    }
+    if (compute && !computePressed && particleSystem.computeProgram){
+        particleSystem.useCompute = !particleSystem.useCompute;
+        std::cout << (particleSystem.useCompute ? "compute shader" : "transform feedback") << " update" << std::endl;
+    }
+    morePressed = more;
+    fewerPressed = fewer;
+    computePressed = compute;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
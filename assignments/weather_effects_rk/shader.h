@@ -5,6 +5,7 @@
 #include <glm/glm.hpp>
 
 #include <string>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -88,7 +89,9 @@ public:
         }
         // shader Program
         ID = glCreateProgram();
-        glObjectLabel(GL_PROGRAM, ID, -1, fragmentPath);
+        // object labels are core from OpenGL 4.3, the program can run on a 3.3 context
+        if (GLAD_GL_VERSION_4_3)
+            glObjectLabel(GL_PROGRAM, ID, -1, fragmentPath);
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
         if(geometryPath != nullptr)
@@ -102,6 +105,36 @@ public:
             glDeleteShader(geometry);
 
     }
+    // compute shader, the source is the concatenation of the files in computePaths (the first one starts with the
+    // #version line, the next ones can hold functions that are shared with other shaders). Requires OpenGL 4.3
+    // ------------------------------------------------------------------------
+    explicit Shader(const std::vector<std::string> &computePaths)
+    {
+        unsigned int compute = compileShader(GL_COMPUTE_SHADER, readFiles(computePaths), "COMPUTE");
+        ID = glCreateProgram();
+        glObjectLabel(GL_PROGRAM, ID, -1, computePaths[0].c_str());
+        glAttachShader(ID, compute);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+        glDeleteShader(compute);
+    }
+    // vertex shader without a fragment shader, whose outputs feedbackVaryings are captured with transform feedback
+    // to a single buffer, one after the other (GL_INTERLEAVED_ATTRIBS). The source is the concatenation of the files
+    // in vertexPaths, as for the compute shader. Draw with GL_RASTERIZER_DISCARD enabled
+    // ------------------------------------------------------------------------
+    Shader(const std::vector<std::string> &vertexPaths, const std::vector<const char*> &feedbackVaryings)
+    {
+        unsigned int vertex = compileShader(GL_VERTEX_SHADER, readFiles(vertexPaths), "VERTEX");
+        ID = glCreateProgram();
+        if (GLAD_GL_VERSION_4_3)
+            glObjectLabel(GL_PROGRAM, ID, -1, vertexPaths[0].c_str());
+        glAttachShader(ID, vertex);
+        // the captured outputs must be set before the program is linked
+        glTransformFeedbackVaryings(ID, (GLsizei)feedbackVaryings.size(), feedbackVaryings.data(), GL_INTERLEAVED_ATTRIBS);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+        glDeleteShader(vertex);
+    }
     // activate the shader
     // ------------------------------------------------------------------------
     void use()
@@ -168,6 +201,33 @@ public:
     }
 
 private:
+    // the contents of the files in paths, one after the other
+    // ------------------------------------------------------------------------
+    static std::string readFiles(const std::vector<std::string> &paths)
+    {
+        std::stringstream code;
+        for (const std::string &path : paths)
+        {
+            std::ifstream file(path);
+            if (!file)
+            {
+                std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+                continue;
+            }
+            code << file.rdbuf() << "\n";
+        }
+        return code.str();
+    }
+    // ------------------------------------------------------------------------
+    unsigned int compileShader(GLenum type, const std::string &code, const std::string &typeName)
+    {
+        const char* shaderCode = code.c_str();
+        unsigned int shader = glCreateShader(type);
+        glShaderSource(shader, 1, &shaderCode, NULL);
+        glCompileShader(shader);
+        checkCompileErrors(shader, typeName);
+        return shader;
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -1,47 +1,42 @@
 #version 330 core
-layout (location = 0) in vec3 particlePosition;
+layout (location = 0) in vec4 positionAndAge;
+layout (location = 1) in vec4 velocityAndLifetime;
 
 uniform mat4 mvpMatrix;
 uniform mat4 previousMvpMatrix;
 
-uniform vec3 cameraPosition;
-uniform vec3 forwardOffset;
-uniform vec3 gravityVelocity;
-uniform vec3 windVelocity;
-
-uniform vec3 in_Offsets;
-uniform float boxSize;
 uniform int renderAsParticle;
 uniform float particleScale;
 
 out float alpha;
-out vec3 debugColor;
 
 void main()
 {
     float lineScalar = 0.05f;
-    vec3 updatedPosition = mod(particlePosition + in_Offsets, boxSize);
-    updatedPosition += cameraPosition + forwardOffset - boxSize/2;
+    // the particles are simulated on the GPU (particle_simulation.glsl), they are already where they should be drawn
+    vec3 position = positionAndAge.xyz;
 
     if(renderAsParticle == 1)
     {
-        gl_Position = mvpMatrix * vec4(updatedPosition, 1.0);
+        gl_Position = mvpMatrix * vec4(position, 1.0);
+        alpha = 1.0;
     }
-    else // renderAsLines
+    else // renderAsLines, each particle is an instance of a line of 2 vertices
     {
-        vec4 particleDirection = normalize(vec4(windVelocity+gravityVelocity, 1.0));
-        vec4 previousPosition = vec4(updatedPosition,1.0) + particleDirection * lineScalar;
-        previousPosition.w = 1.0f;
+        // the line follows the velocity of the particle
+        vec3 velocity = velocityAndLifetime.xyz;
+        vec4 particleDirection = vec4(velocity / max(length(velocity), 1e-5), 0.0);
+        vec4 previousPosition = vec4(position, 1.0) + particleDirection * lineScalar;
 
-        vec4 bottomVertex = mvpMatrix * vec4(updatedPosition,1.0);
+        vec4 bottomVertex = mvpMatrix * vec4(position,1.0);
         vec4 topVertex = mvpMatrix * previousPosition;
         vec4 prevTopVertex = previousMvpMatrix * previousPosition;
-        vec2 velocity = (topVertex.xy/topVertex.w) - (bottomVertex.xy/bottomVertex.w);
-        vec2 prevVelocity = (prevTopVertex.xy/prevTopVertex.w) - (bottomVertex.xy/bottomVertex.w);
-        alpha = clamp(length(velocity)/length(prevVelocity), 0.0, 1.0);
+        vec2 velocityOnScreen = (topVertex.xy/topVertex.w) - (bottomVertex.xy/bottomVertex.w);
+        vec2 prevVelocityOnScreen = (prevTopVertex.xy/prevTopVertex.w) - (bottomVertex.xy/bottomVertex.w);
+        alpha = clamp(length(velocityOnScreen)/length(prevVelocityOnScreen), 0.0, 1.0);
 
-        gl_Position = mix(prevTopVertex, bottomVertex, mod(gl_VertexID, 2));
+        gl_Position = mix(prevTopVertex, bottomVertex, float(gl_VertexID % 2));
     }
 
     gl_PointSize = particleScale;
-}
\ No newline at end of file
+}
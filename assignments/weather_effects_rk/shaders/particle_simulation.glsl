@@ -0,0 +1,79 @@
+// the simulation of one particle, shared by particle_update.vert (transform feedback, OpenGL 3.3) and
+// particle_update.comp (compute shader, OpenGL 4.3), which start with the #version line and are followed by this file
+//
+// positionAndAge: xyz is the position, w the age of the particle in seconds
+// velocityAndLifetime: xyz is the velocity, w the age at which the particle respawns
+
+uniform float deltaTime;
+uniform int frame;
+// the box of the particles, which follows the camera: its corner with the lowest coordinates and its size
+uniform vec3 boxMin;
+uniform float boxSize;
+// the velocity the particles drift towards, and how much random gusts change it per second
+uniform vec3 gravityVelocity;
+uniform vec3 windVelocity;
+uniform float turbulence;
+uniform float floorHeight;
+// the range of the lifetimes of the particles, in seconds
+uniform vec2 lifetimeRange;
+
+// PCG hash, a good enough random number for each particle and frame
+uint hash(uint v)
+{
+    uint state = v * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// a random number in [0, 1), state moves to the next one
+float random(inout uint state)
+{
+    state = hash(state);
+    return float(state >> 8u) / 16777216.0;
+}
+
+vec3 random3(inout uint state)
+{
+    float x = random(state), y = random(state), z = random(state);
+    return vec3(x, y, z);
+}
+
+void simulateParticle(inout vec4 positionAndAge, inout vec4 velocityAndLifetime, uint index)
+{
+    uint state = hash(index ^ hash(uint(frame)));
+    vec3 position = positionAndAge.xyz;
+    vec3 velocity = velocityAndLifetime.xyz;
+    float age = positionAndAge.w + deltaTime;
+    float lifetime = velocityAndLifetime.w;
+
+    if (age >= lifetime)
+    {
+        // respawn anywhere in the box, which keeps the density of the particles uniform
+        position = boxMin + boxSize * random3(state);
+        velocity = gravityVelocity + windVelocity + turbulence * (random3(state) - 0.5);
+        age = 0.0;
+        lifetime = mix(lifetimeRange.x, lifetimeRange.y, random(state));
+    }
+    else
+    {
+        // the velocity of the particle relaxes towards the one of the weather, plus a random gust
+        vec3 gust = turbulence * (random3(state) - 0.5);
+        velocity += (gravityVelocity + windVelocity - velocity) * min(2.0 * deltaTime, 1.0) + gust * deltaTime;
+        position += velocity * deltaTime;
+
+        if (position.y < floorHeight)
+        {
+            // the particle stops on the floor for this frame, and respawns at the next one
+            position.y = floorHeight;
+            age = lifetime;
+        }
+        else
+        {
+            // the particles that leave the box (e.g. when the camera moves) come back from the opposite side
+            position = boxMin + mod(position - boxMin, boxSize);
+        }
+    }
+
+    positionAndAge = vec4(position, age);
+    velocityAndLifetime = vec4(velocity, lifetime);
+}
@@ -0,0 +1,18 @@
+#version 330 core
+// one step of the simulation of the particles with transform feedback: each vertex is a particle, its outputs are
+// captured to the other buffer of the particles and nothing is rasterized
+layout (location = 0) in vec4 positionAndAge;
+layout (location = 1) in vec4 velocityAndLifetime;
+
+out vec4 outPositionAndAge;
+out vec4 outVelocityAndLifetime;
+
+// in particle_simulation.glsl
+void simulateParticle(inout vec4 positionAndAge, inout vec4 velocityAndLifetime, uint index);
+
+void main()
+{
+    outPositionAndAge = positionAndAge;
+    outVelocityAndLifetime = velocityAndLifetime;
+    simulateParticle(outPositionAndAge, outVelocityAndLifetime, uint(gl_VertexID));
+}
@@ -0,0 +1,137 @@
+//
+// Shows the images rendered by the CPU in the window, shared by the software rasterizer of exercise 7 and the ray
+// tracer of exercise 10.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_DISPLAY_BUFFER_H
+#define ITU_GRAPHICS_PROGRAMMING_DISPLAY_BUFFER_H
+
+#include <glad/glad.h>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+
+// The image is uploaded to a texture through a ring of pixel unpack buffers (PBOs), and the texture is copied
+// to the window frame buffer. The CPU renders each frame directly in the memory of one of the buffers (beginFrame),
+// then the GPU copies the buffer to the texture (endFrame) while the CPU is already rendering the next frame
+// in the next buffer. So the upload does not stall the render loop, unless the GPU falls behind by more than
+// the number of buffers in the ring.
+// If a buffer can not be mapped, the frame is rendered in memory of the CPU instead and uploaded from there, which
+// stalls until the copy is done but still shows the frame.
+class DisplayBuffer {
+public:
+    unsigned int W, H;
+
+    DisplayBuffer(unsigned int width, unsigned int height, unsigned int ringSize = 3)
+            : W(width), H(height), m_pixelBuffers(ringSize), m_fences(ringSize, nullptr) {
+        // texture we upload the image to, its storage is allocated once (immutable when the context supports it)
+        glGenTextures(1, &m_texture);
+        glBindTexture(GL_TEXTURE_2D, m_texture);
+        if (GLAD_GL_VERSION_4_2)
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, W, H);
+        else
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, W, H, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        // set the texture wrapping parameters
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        // set texture filtering parameters
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        // the ring of pixel buffers, the CPU writes to them and the GPU reads from them
+        glGenBuffers(ringSize, m_pixelBuffers.data());
+        for (GLuint pbo : m_pixelBuffers) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, imageSize(), nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        // openGL frame buffer object, it helps handling writing the texture content into the window frame buffer
+        glGenFramebuffers(1, &m_frameBuffer);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_frameBuffer);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texture, 0);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    }
+
+    ~DisplayBuffer() {
+        for (GLsync fence : m_fences)
+            if (fence) glDeleteSync(fence);
+        glDeleteBuffers(m_pixelBuffers.size(), m_pixelBuffers.data());
+        glDeleteFramebuffers(1, &m_frameBuffer);
+        glDeleteTextures(1, &m_texture);
+    }
+
+    DisplayBuffer(const DisplayBuffer &) = delete;
+    DisplayBuffer &operator=(const DisplayBuffer &) = delete;
+
+    // memory where the next frame must be rendered, W x H RGBA pixels stored one row after the other from the
+    // bottom of the image. It is only valid until endFrame, and should only be written to (reading it is slow)
+    uint32_t *beginFrame() {
+        // wait until the GPU has copied the last frame rendered in this buffer,
+        // it has usually finished long ago, since the other buffers of the ring have been used in the meantime
+        GLsync &fence = m_fences[m_current];
+        if (fence) {
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+
+        // we have just waited for the GPU to stop using the buffer, so the driver does not have to synchronize
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBuffers[m_current]);
+        void *memory = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, imageSize(),
+                                        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        m_mapped = memory != nullptr;
+        if (!m_mapped) {
+            // e.g. out of memory, or a driver that does not map pixel buffers: render in the memory of the CPU
+            if (m_fallback.empty())
+                std::cout << "DisplayBuffer: glMapBufferRange failed (error 0x" << std::hex << glGetError() << std::dec
+                          << "), uploading the frames from the CPU memory" << std::endl;
+            m_fallback.resize(size_t(W) * H);
+            return m_fallback.data();
+        }
+        return static_cast<uint32_t *>(memory);
+    }
+
+    // upload the frame rendered since beginFrame and copy it to the window frame buffer (of windowW x windowH pixels)
+    void endFrame(int windowW, int windowH) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, m_texture);
+        if (m_mapped) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBuffers[m_current]);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+            // with a pixel unpack buffer bound, the last argument is an offset in the buffer, and the GPU copies
+            // the pixels to the texture asynchronously (glTexImage2D would copy them from the CPU memory right now)
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, W, H, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+            // signaled when the GPU is done with the buffer, so that we can write to it again
+            m_fences[m_current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            m_current = (m_current + 1) % m_pixelBuffers.size();
+        } else {
+            // no pixel unpack buffer is bound, the pixels are copied from the CPU memory right now
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, W, H, GL_RGBA, GL_UNSIGNED_BYTE, m_fallback.data());
+        }
+
+        // copy from the frame buffer object (access the texture) to the window frame buffer
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_frameBuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, W, H, 0, 0, windowW, windowH, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+
+private:
+    GLsizeiptr imageSize() const { return GLsizeiptr(W) * H * sizeof(uint32_t); }
+
+    GLuint m_texture = 0;
+    GLuint m_frameBuffer = 0;
+    std::vector<GLuint> m_pixelBuffers;
+    // fence of the last upload from each pixel buffer
+    std::vector<GLsync> m_fences;
+    unsigned int m_current = 0;
+    // false if the frame since beginFrame is rendered in m_fallback, because the buffer could not be mapped
+    bool m_mapped = false;
+    std::vector<uint32_t> m_fallback;
+};
+
+#endif //ITU_GRAPHICS_PROGRAMMING_DISPLAY_BUFFER_H
@@ -0,0 +1,470 @@
+// Benchmark of the CPU renderers, the software rasterizer (srl, exercise 7), the ray tracer (rt, exercise 10) and the
+// hybrid of both (hybrid, srl rasterizes what the camera sees and rt traces the shadow and reflected rays).
+// It renders fixed scenes without a window: the cube of Primitives::makeCube, a tessellated sphere and the car of
+// exercise 8, each inside the grey room of exercise 10 (an inverted cube, so that the ray tracer has something to
+// cast shadows on and to reflect). Every scene is rendered at 64x64, 99x99, 512x512 and 1920x1080 by every renderer;
+// 99 pixels is not a multiple of the SIMD width, so the last group of pixels of each row is only partly in the image.
+// For each case it prints the time per frame, the triangles per second (triangles submitted to the rasterizer),
+// the fragments per second (fragments that passed the depth test and were shaded) and the rays per second (camera,
+// shadow and reflected rays), and it writes the last frame to <out>/<renderer>_<scene>_<size>.ppm.
+// With --golden, each image is also compared to the one with the same name in the golden directory, and the
+// benchmark fails if a color channel differs by more than --tolerance.
+//
+// The ray tracer builds its bounding volume hierarchy before the first frame, the time of the build is printed
+// separately. With --bvh 0 it tests every triangle for every ray instead, then the large cases of the car and the
+// sphere take minutes; use the filters to run only some of them. With --wavefront 0 the rays of a tile are traced
+// depth first (each camera ray with its shadow and reflected rays) instead of in queues of the same kind of rays.
+// With --bvh-cache the hierarchies are saved to that directory, and the next runs load them instead of building them
+// (the build time is then the time of the load).
+// The images of the hybrid renderer are compared to the ones of the ray tracer of the same run, they can only differ
+// at a few pixels on the edges of the triangles: it fails if more than 1% of the pixels differ by more than --tolerance.
+// With --reflection-step n the ray tracer and the hybrid renderer trace the reflections of one pixel out of n x n and
+// fill in the others with their denoiser (Renderer::reflectionStep), with --denoise 1 they filter the reflections even
+// with a step of 1. The images then only approximate the golden ones, compare them with a --tolerance of a few tens.
+//
+// usage: cpu_render_bench [--renderer srl|rt|hybrid] [--scene cube|sphere|car] [--size 64|99|512|1080]
+//                         [--min-time seconds] [--out dir] [--golden dir] [--tolerance value] [--models dir]
+//                         [--bvh 0|1] [--wavefront 0|1] [--threads count] [--heatmap 0|1] [--bvh-cache dir]
+//                         [--reflection-step n] [--denoise 0|1]
+//
+// The ray tracer uses all the cores unless --threads is given. With --heatmap 1 it also writes the time spent in each
+// tile of the last frame to <out>/rt_<scene>_<size>_tiles.ppm (blue is the fastest tile, red the slowest).
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <cassert>
+#include <cmath>
+#include <cfloat>
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include "srl_triangle_renderer.h"
+#include "rt_renderer.h"
+#include "rt_hybrid_renderer.h"
+#include "primitives.h"
+#include "objloader.h"
+
+// scene vertices, converted to the vertex type of each renderer (they have the same attributes)
+struct bench_vertex {
+    glm::vec4 pos;
+    glm::vec4 norm;
+    glm::vec4 col;
+    glm::vec2 uv;
+};
+
+struct bench_scene {
+    std::string name;
+    std::vector<bench_vertex> vertices;
+};
+
+// fragment shader of the rasterizer that counts the fragments it shades, the same as default_fragment_shader
+struct counting_fragment_shader {
+    unsigned long long *fragments = nullptr;
+
+    srl::Colors::color operator()(const srl::shaders::default_varyings &in) const {
+        (*fragments)++;
+        return in.col;
+    }
+};
+
+using bench_rasterizer = srl::TriangleRendererT<srl::shaders::default_varyings, srl::shaders::default_vertex_shader,
+        counting_fragment_shader>;
+
+struct bench_result {
+    int frames = 0;
+    double seconds = 0;
+    unsigned long long triangles = 0, fragments = 0, rays = 0;
+    // time to build the acceleration structure of the ray tracer
+    double buildSeconds = 0;
+    // time spent in each tile by the ray tracer, as an image
+    std::vector<uint32_t> tileHeatmap;
+    // the last frame, RGBA8 in rows from the bottom of the image to the top
+    std::vector<uint32_t> image;
+};
+
+// the camera of exercise 10 looking at the origin, and its light (at (0, 1.9, 0), just below the ceiling)
+static const glm::vec3 cameraPosition(0.9f, 0.0f, 1.5f);
+static const float fovDegrees = 70.0f;
+static const unsigned int rtDepth = 2;
+
+static glm::mat4 viewMatrix() {
+    return glm::lookAt(cameraPosition, glm::vec3(0.0f), glm::vec3(0, 1, 0));
+}
+
+// append the triangles in points/normals to out, transformed by model, with normals in the same space.
+// A model that mirrors the mesh turns it inside out (the triangles change their winding), so the normals are flipped
+// to point to the same side as the triangles
+static void appendMesh(const std::vector<glm::vec3> &points, const std::vector<glm::vec3> &normals,
+                       const std::vector<glm::vec2> &uvs, const std::vector<glm::vec4> &colors,
+                       const glm::mat4 &model, std::vector<bench_vertex> &out) {
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+    if (glm::determinant(glm::mat3(model)) < 0)
+        normalMatrix = -normalMatrix;
+    for (size_t i = 0; i < points.size(); i++) {
+        glm::vec3 n = glm::normalize(normalMatrix * normals[i]);
+        // meshes without colors are colored by their normals
+        glm::vec4 col = i < colors.size() ? colors[i] : glm::vec4(n * .5f + .5f, 1.0f);
+        out.push_back(bench_vertex{model * glm::vec4(points[i], 1.0f), glm::vec4(n, 0.0f), col,
+                                   i < uvs.size() ? uvs[i] : glm::vec2(0.0f)});
+    }
+}
+
+// the grey room of exercise 10, a cube of side 4 turned inside out
+static void appendRoom(std::vector<bench_vertex> &out) {
+    std::vector<glm::vec3> points, normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec4> colors;
+    Primitives::makeCube(2.f, points, normals, uvs, colors);
+    colors.assign(points.size(), rt::Colors::grey);
+    appendMesh(points, normals, uvs, colors, glm::scale(glm::vec3(-2.f)), out);
+}
+
+static bench_scene makeCubeScene() {
+    bench_scene scene{"cube", {}};
+    std::vector<glm::vec3> points, normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec4> colors;
+    Primitives::makeCube(1.f, points, normals, uvs, colors);
+    appendMesh(points, normals, uvs, colors, glm::rotate(.6f, glm::vec3(0, 1, 0)), scene.vertices);
+    appendRoom(scene.vertices);
+    return scene;
+}
+
+// UV sphere of radius .6 with slices x stacks quads (two triangles each, one at the poles)
+static bench_scene makeSphereScene(int slices = 64, int stacks = 32) {
+    bench_scene scene{"sphere", {}};
+    const float radius = .6f, pi = 3.14159265f;
+    auto point = [&](int slice, int stack) {
+        float theta = pi * float(stack) / float(stacks), phi = 2.0f * pi * float(slice) / float(slices);
+        return glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), -std::sin(theta) * std::sin(phi));
+    };
+    std::vector<glm::vec3> points, normals;
+    std::vector<glm::vec2> uvs;
+    auto add = [&](int slice, int stack) {
+        glm::vec3 n = point(slice, stack);
+        points.push_back(n * radius);
+        normals.push_back(n);
+        uvs.push_back(glm::vec2(float(slice) / float(slices), 1.0f - float(stack) / float(stacks)));
+    };
+    for (int stack = 0; stack < stacks; stack++) {
+        for (int slice = 0; slice < slices; slice++) {
+            // counterclockwise seen from outside of the sphere
+            if (stack > 0) {
+                add(slice, stack); add(slice, stack + 1); add(slice + 1, stack);
+            }
+            if (stack < stacks - 1) {
+                add(slice + 1, stack); add(slice, stack + 1); add(slice + 1, stack + 1);
+            }
+        }
+    }
+    appendMesh(points, normals, uvs, {}, glm::mat4(1.0f), scene.vertices);
+    appendRoom(scene.vertices);
+    return scene;
+}
+
+// the car of exercise 8 (without the wheels), scaled to fit in the same space as the other objects
+static bool makeCarScene(const std::string &modelsDir, bench_scene &scene) {
+    scene = bench_scene{"car", {}};
+    std::vector<glm::vec3> points, normals;
+    std::vector<glm::vec2> uvs;
+    for (const char *part : {"Body_LOD0.obj", "Interior_LOD0.obj", "Paint_LOD0.obj", "Light_LOD0.obj",
+                             "Windows_LOD0.obj"}) {
+        std::string path = modelsDir + "/car/" + part;
+        // loadOBJ waits for a key press when it can not open the file
+        if (!std::ifstream(path).good() || !loadOBJ(path.c_str(), points, uvs, normals)) {
+            std::cout << "could not load " << path << std::endl;
+            return false;
+        }
+    }
+
+    glm::vec3 boxMin(FLT_MAX), boxMax(-FLT_MAX);
+    for (auto &p : points) {
+        boxMin = glm::min(boxMin, p);
+        boxMax = glm::max(boxMax, p);
+    }
+    glm::vec3 size = boxMax - boxMin;
+    float scale = 1.6f / std::max(size.x, std::max(size.y, size.z));
+    glm::mat4 model = glm::rotate(.6f, glm::vec3(0, 1, 0)) * glm::scale(glm::vec3(scale)) *
+                      glm::translate(-(boxMin + boxMax) * .5f);
+    appendMesh(points, normals, uvs, {}, model, scene.vertices);
+    appendRoom(scene.vertices);
+    return true;
+}
+
+template<class Clock = std::chrono::high_resolution_clock>
+static double secondsSince(typename Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static bench_result benchRasterizer(const bench_scene &scene, int width, int height, double minTime) {
+    std::vector<srl::vertex> vts;
+    for (auto &v : scene.vertices)
+        vts.push_back(srl::vertex{v.pos, v.norm, v.col, v.uv});
+    glm::mat4 viewProj = glm::perspectiveFov<float>(glm::radians(fovDegrees), float(width), float(height), .1f, 10.f) *
+                         viewMatrix();
+
+    bench_result result;
+    bench_rasterizer renderer;
+    renderer.fragmentShader.fragments = &result.fragments;
+    srl::CustomFrameBuffer<uint32_t> colorBuffer(width, height);
+    srl::DepthBuffer depthBuffer(width, height);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    do {
+        colorBuffer.clearBuffer(srl::Colors::toRGBA32(srl::Colors::black));
+        depthBuffer.clearBuffer(1.0f);
+        renderer.render(vts, glm::mat4(1.0f), viewProj, colorBuffer, depthBuffer);
+        result.triangles += vts.size() / 3;
+        result.frames++;
+    } while (secondsSince(start) < minTime);
+    result.seconds = secondsSince(start);
+
+    result.image.assign(colorBuffer.buffer, colorBuffer.buffer + size_t(width) * height);
+    return result;
+}
+
+static bench_result benchRayTracer(const bench_scene &scene, int width, int height, double minTime, bool useBVH,
+                                   bool wavefront, unsigned int threads, const std::string &bvhCacheDir,
+                                   int reflectionStep, bool denoise) {
+    std::vector<rt::vertex> vts;
+    for (auto &v : scene.vertices)
+        vts.push_back(rt::vertex{v.pos, v.norm, v.col, v.uv});
+
+    bench_result result;
+    rt::Renderer renderer;
+    renderer.useBVH = useBVH;
+    renderer.wavefront = wavefront;
+    renderer.bvhCacheDirectory = bvhCacheDir;
+    renderer.reflectionStep = reflectionStep;
+    renderer.denoise = denoise;
+    if (threads > 0)
+        renderer.threads = threads;
+    FrameBuffer<uint32_t> frameBuffer(width, height);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    if (useBVH) {
+        renderer.build(vts);
+        result.buildSeconds = secondsSince(start);
+        start = std::chrono::high_resolution_clock::now();
+    }
+    do {
+        frameBuffer.clearBuffer(rt::Colors::toRGBA32(rt::Colors::black));
+        renderer.rayCount = 0;
+        renderer.render(vts, glm::mat4(1.0f), viewMatrix(), fovDegrees, rtDepth, frameBuffer);
+        result.rays += renderer.rayCount;
+        result.frames++;
+    } while (secondsSince(start) < minTime);
+    result.seconds = secondsSince(start);
+
+    result.image.assign(frameBuffer.buffer, frameBuffer.buffer + size_t(width) * height);
+    renderer.paintTileHeatmap(frameBuffer);
+    result.tileHeatmap.assign(frameBuffer.buffer, frameBuffer.buffer + size_t(width) * height);
+    return result;
+}
+
+// the ray tracer with the surfaces seen by the camera rasterized, in a scene with the vertices as its only mesh (like
+// Renderer::build)
+static bench_result benchHybrid(const bench_scene &scene, int width, int height, double minTime, bool wavefront,
+                                unsigned int threads, const std::string &bvhCacheDir, int reflectionStep,
+                                bool denoise) {
+    std::vector<rt::vertex> vts;
+    for (auto &v : scene.vertices)
+        vts.push_back(rt::vertex{v.pos, v.norm, v.col, v.uv});
+
+    bench_result result;
+    rt::HybridRenderer renderer;
+    renderer.tracer.wavefront = wavefront;
+    renderer.tracer.reflectionStep = reflectionStep;
+    renderer.tracer.denoise = denoise;
+    if (threads > 0)
+        renderer.tracer.threads = threads;
+    FrameBuffer<uint32_t> frameBuffer(width, height);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    rt::Scene hybridScene;
+    hybridScene.buildThreads = renderer.tracer.threads;
+    hybridScene.bvhCacheDirectory = bvhCacheDir;
+    rt::instance only;
+    only.mesh = hybridScene.addMesh(vts);
+    hybridScene.instances.push_back(only);
+    hybridScene.update();
+    result.buildSeconds = secondsSince(start);
+
+    start = std::chrono::high_resolution_clock::now();
+    do {
+        frameBuffer.clearBuffer(rt::Colors::toRGBA32(rt::Colors::black));
+        renderer.tracer.rayCount = 0;
+        renderer.render(hybridScene, glm::mat4(1.0f), viewMatrix(), fovDegrees, rtDepth, frameBuffer);
+        result.rays += renderer.tracer.rayCount;
+        result.triangles += vts.size() / 3;
+        result.frames++;
+    } while (secondsSince(start) < minTime);
+    result.seconds = secondsSince(start);
+
+    result.image.assign(frameBuffer.buffer, frameBuffer.buffer + size_t(width) * height);
+    renderer.tracer.paintTileHeatmap(frameBuffer);
+    result.tileHeatmap.assign(frameBuffer.buffer, frameBuffer.buffer + size_t(width) * height);
+    return result;
+}
+
+// binary PPM, the rows of image go from the bottom to the top like in OpenGL, so they are written in reverse
+static bool writePPM(const std::string &path, const std::vector<uint32_t> &image, int width, int height) {
+    std::ofstream file(path, std::ios::binary);
+    file << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<char> row(size_t(width) * 3);
+    for (int y = height - 1; y >= 0; y--) {
+        for (int x = 0; x < width; x++) {
+            uint32_t c = image[size_t(x) + size_t(y) * width];
+            row[x * 3] = char(c & 0xffu);
+            row[x * 3 + 1] = char((c >> 8) & 0xffu);
+            row[x * 3 + 2] = char((c >> 16) & 0xffu);
+        }
+        file.write(row.data(), std::streamsize(row.size()));
+    }
+    return file.good();
+}
+
+// reads a PPM written by writePPM, as rows of RGB bytes from the top of the image
+static bool readPPM(const std::string &path, std::vector<unsigned char> &rgb, int &width, int &height) {
+    std::ifstream file(path, std::ios::binary);
+    std::string magic;
+    int maxValue;
+    if (!(file >> magic >> width >> height >> maxValue) || magic != "P6" || maxValue != 255)
+        return false;
+    file.get(); // the single white space after the header
+    rgb.resize(size_t(width) * height * 3);
+    file.read(reinterpret_cast<char *>(rgb.data()), std::streamsize(rgb.size()));
+    return file.good();
+}
+
+// compares the two images, and returns false if they have different sizes or a channel differs by more than tolerance
+// in more than maxDifferent of the pixels (a fraction)
+static bool compareImages(const std::string &path, const std::string &goldenPath, int tolerance,
+                          double maxDifferent = 0) {
+    std::vector<unsigned char> image, golden;
+    int w, h, goldenW, goldenH;
+    if (!readPPM(goldenPath, golden, goldenW, goldenH)) {
+        std::cout << "  no golden image " << goldenPath << std::endl;
+        return false;
+    }
+    if (!readPPM(path, image, w, h) || w != goldenW || h != goldenH) {
+        std::cout << "  " << path << " does not have the size of " << goldenPath << std::endl;
+        return false;
+    }
+    int maxDiff = 0;
+    size_t pixels = 0;
+    for (size_t i = 0; i < image.size(); i += 3) {
+        int diff = 0;
+        for (int c = 0; c < 3; c++)
+            diff = std::max(diff, std::abs(int(image[i + c]) - int(golden[i + c])));
+        maxDiff = std::max(maxDiff, diff);
+        pixels += diff > tolerance;
+    }
+    if (pixels > 0)
+        std::cout << "  " << path << ": " << pixels << " pixels differ from " << goldenPath
+                  << ", largest difference " << maxDiff << std::endl;
+    return pixels <= maxDifferent * (image.size() / 3);
+}
+
+int main(int argc, char **argv) {
+    std::string rendererFilter, sceneFilter, sizeFilter, outDir = ".", goldenDir, modelsDir = ".", bvhCacheDir;
+    double minTime = 1.0;
+    int tolerance = 0;
+    bool useBVH = true, wavefront = true, heatmap = false, denoise = false;
+    unsigned int threads = 0;
+    int reflectionStep = 1;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i], value = argv[i + 1];
+        if (option == "--renderer") rendererFilter = value;
+        else if (option == "--scene") sceneFilter = value;
+        else if (option == "--size") sizeFilter = value;
+        else if (option == "--min-time") minTime = std::atof(value.c_str());
+        else if (option == "--out") outDir = value;
+        else if (option == "--golden") goldenDir = value;
+        else if (option == "--tolerance") tolerance = std::atoi(value.c_str());
+        else if (option == "--models") modelsDir = value;
+        else if (option == "--bvh") useBVH = value != "0";
+        else if (option == "--wavefront") wavefront = value != "0";
+        else if (option == "--threads") threads = unsigned(std::max(1, std::atoi(value.c_str())));
+        else if (option == "--heatmap") heatmap = value != "0";
+        else if (option == "--bvh-cache") bvhCacheDir = value;
+        else if (option == "--reflection-step") reflectionStep = std::max(1, std::atoi(value.c_str()));
+        else if (option == "--denoise") denoise = value != "0";
+        else {
+            std::cout << "unknown option " << option << std::endl;
+            return 2;
+        }
+    }
+
+    std::vector<bench_scene> scenes;
+    if (sceneFilter.empty() || sceneFilter == "cube")
+        scenes.push_back(makeCubeScene());
+    if (sceneFilter.empty() || sceneFilter == "sphere")
+        scenes.push_back(makeSphereScene());
+    if (sceneFilter.empty() || sceneFilter == "car") {
+        bench_scene car;
+        if (!makeCarScene(modelsDir, car))
+            return 2;
+        scenes.push_back(car);
+    }
+
+    struct bench_size { const char *name; int width, height; };
+    const bench_size sizes[] = {{"64", 64, 64}, {"99", 99, 99}, {"512", 512, 512}, {"1080", 1920, 1080}};
+    const char *renderers[] = {"srl", "rt", "hybrid"};
+
+    std::cout << std::setw(5) << "" << std::setw(8) << "scene" << std::setw(11) << "size" << std::setw(11) << "triangles"
+              << std::setw(8) << "frames" << std::setw(12) << "ms/frame" << std::setw(12) << "Mtri/s"
+              << std::setw(12) << "Mfrag/s" << std::setw(12) << "Mray/s" << std::setw(12) << "build ms" << std::endl;
+    bool allMatch = true;
+    for (const char *renderer : renderers) {
+        if (!rendererFilter.empty() && rendererFilter != renderer)
+            continue;
+        for (auto &scene : scenes) {
+            for (auto &size : sizes) {
+                if (!sizeFilter.empty() && sizeFilter != size.name)
+                    continue;
+                bool raster = std::string(renderer) == "srl", hybrid = std::string(renderer) == "hybrid";
+                bench_result r = raster ? benchRasterizer(scene, size.width, size.height, minTime)
+                               : hybrid ? benchHybrid(scene, size.width, size.height, minTime, wavefront, threads,
+                                                      bvhCacheDir, reflectionStep, denoise)
+                                        : benchRayTracer(scene, size.width, size.height, minTime, useBVH, wavefront,
+                                                         threads, bvhCacheDir, reflectionStep, denoise);
+
+                std::ostringstream resolution;
+                resolution << size.width << "x" << size.height;
+                std::cout << std::fixed << std::setprecision(3) << std::setw(5) << renderer << std::setw(8)
+                          << scene.name << std::setw(11) << resolution.str() << std::setw(11)
+                          << scene.vertices.size() / 3 << std::setw(8) << r.frames << std::setw(12)
+                          << r.seconds * 1e3 / r.frames << std::setw(12) << r.triangles / r.seconds * 1e-6
+                          << std::setw(12) << r.fragments / r.seconds * 1e-6 << std::setw(12)
+                          << r.rays / r.seconds * 1e-6 << std::setw(12) << r.buildSeconds * 1e3 << std::endl;
+
+                std::string name = std::string(renderer) + "_" + scene.name + "_" + size.name + ".ppm";
+                if (!writePPM(outDir + "/" + name, r.image, size.width, size.height)) {
+                    std::cout << "  could not write " << outDir + "/" + name << std::endl;
+                    allMatch = false;
+                }
+                else if (hybrid && rendererFilter.empty()) {
+                    std::string rtName = std::string("rt_") + scene.name + "_" + size.name + ".ppm";
+                    allMatch &= compareImages(outDir + "/" + name, outDir + "/" + rtName, tolerance, .01);
+                }
+                else if (!goldenDir.empty() && !hybrid)
+                    allMatch &= compareImages(outDir + "/" + name, goldenDir + "/" + name, tolerance);
+                if (heatmap && !raster) {
+                    std::string tilesName = std::string(renderer) + "_" + scene.name + "_" + size.name + "_tiles.ppm";
+                    writePPM(outDir + "/" + tilesName, r.tileHeatmap, size.width, size.height);
+                }
+            }
+        }
+    }
+
+    return allMatch ? 0 : 1;
+}
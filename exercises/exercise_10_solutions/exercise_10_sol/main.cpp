@@ -8,6 +8,7 @@
 #include <glm/gtx/transform.hpp>
 #include "rt_renderer.h"
 #include "primitives.h"
+#include "display_buffer.h"
 
 #include "camera.h"
 
@@ -100,32 +101,15 @@ int main()
         vts.push_back(v);
     }
 
+    // the renderer traces the vertices of its last build (or refit), build again if vts changes
+    renderer.build(vts);
 
 
-    // initialize our custom frame buffer
-    // ----------------------------------
-    // every frame we will: draw to it, upload it to a texture, and copy the texture to the window frame buffer.
-    FrameBuffer<uint32_t> customBuffer(max_W, max_H);
-
-
-    // initialize texture we will use to upload our buffer to GPU
-    // ----------------------------------------------------------
-    unsigned int bufferTexture;
-
-    glGenTextures(1, &bufferTexture);
-    glBindTexture(GL_TEXTURE_2D, bufferTexture);
-    // set the texture wrapping parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    // set texture filtering parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    // initialize openGL frame buffer object
-    // ------------------------------------
-    // this helps handling writing the texture content into the window frame buffer
-    GLuint oglFrameBuffer = 0;
-    glGenFramebuffers(1, &oglFrameBuffer);
+    // initialize the buffers we use to upload our custom frame buffer to GPU
+    // ----------------------------------------------------------------------
+    // every frame we will: draw to a custom frame buffer, upload it to a texture, and copy the texture to the window
+    // frame buffer. The custom frame buffer is created every frame, in memory provided by the display buffer.
+    DisplayBuffer displayBuffer(max_W, max_H);
 
     // render loop
     // -----------
@@ -139,6 +123,8 @@ int main()
     std::cout << "3 - two reflections" << std::endl;
     std::cout << "4 - three reflections" << std::endl;
     std::cout << "5 - four reflections" << std::endl;
+    std::cout << "P - progressive rendering on/off (anti-aliases the image while the camera does not move)" << std::endl;
+    std::cout << "R - reflections at half resolution on/off (the denoiser fills in the other pixels)" << std::endl;
 
     while (!glfwWindowShouldClose(window))
     {
@@ -150,6 +136,8 @@ int main()
 
         // render to our custom frame buffer
         // ---------------------------------
+        // the frame buffer is the memory that will be uploaded, the previous frame may still be uploading meanwhile
+        FrameBuffer<uint32_t> customBuffer(max_W, max_H, displayBuffer.beginFrame());
         customBuffer.clearBuffer(rt::Colors::toRGBA32(rt::Colors::black));
 
         glm::mat4 scale = glm::scale(glm::vec3(.5f,.5f,.5f));
@@ -158,22 +146,10 @@ int main()
 
         // show our rendered image
         // -----------------------
-        // upload the custom color buffer to the GPU using the texture
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, bufferTexture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, max_W, max_H, 0, GL_RGBA, GL_UNSIGNED_BYTE, customBuffer.buffer);
-
-        // set opengl frame buffer object to read from our texture, we will copy from it
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, oglFrameBuffer);
-        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, bufferTexture, 0);
-
-        // bind the window frame buffer, where we want to copy the contents of the texture to
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-
-        // copy from the frame buffer object (access the texture) to the window frame buffer
+        // upload the custom color buffer to the GPU and copy it to the window frame buffer
         int size_W, size_H;
         glfwGetFramebufferSize(window, &size_W, &size_H);
-        glBlitFramebuffer(0,0, max_W, max_H, 0, 0, size_W, size_H, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        displayBuffer.endFrame(size_W, size_H);
 
         // display frame buffer
         glfwSwapBuffers(window);
@@ -185,7 +161,10 @@ int main()
             elapsed = std::chrono::high_resolution_clock::now() - frameStart;
         }
         deltaTime = elapsed.count();
-        glfwSetWindowTitle(window, ("Exercise 10 - FPS: " + std::to_string(int(1.0f/deltaTime + .5f))).c_str());
+        std::string title = "Exercise 10 - FPS: " + std::to_string(int(1.0f/deltaTime + .5f));
+        if (renderer.progressive)
+            title += " - samples: " + std::to_string(std::min(renderer.accumulatedFrames(), renderer.maxSamples));
+        glfwSetWindowTitle(window, title.c_str());
     }
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
@@ -236,6 +215,19 @@ void processInput(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS) rtDepth = 4;
     if (glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS) rtDepth = 5;
 
+    // toggle when the key goes down, not every frame while it is held
+    static bool progressiveKeyDown = false;
+    bool progressiveKey = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+    if (progressiveKey && !progressiveKeyDown)
+        renderer.progressive = !renderer.progressive;
+    progressiveKeyDown = progressiveKey;
+
+    static bool reflectionKeyDown = false;
+    bool reflectionKey = glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS;
+    if (reflectionKey && !reflectionKeyDown)
+        renderer.reflectionStep = renderer.reflectionStep > 1 ? 1 : 2;
+    reflectionKeyDown = reflectionKey;
+
     // movement commands
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
         camera.ProcessKeyboard(FORWARD, deltaTime);
@@ -16,7 +16,15 @@ public:
         buffer = new T[W * H];
     }
 
-    ~FrameBuffer() { delete[] buffer; } // clean our memory
+    // use memory allocated somewhere else (e.g. a mapped OpenGL buffer), with room for width * height values.
+    // The memory is not deleted with the frame buffer
+    FrameBuffer(unsigned int width, unsigned int height, T *memory) : W(width), H(height), buffer(memory),
+            ownsBuffer(false) {}
+
+    ~FrameBuffer() { if (ownsBuffer) delete[] buffer; } // clean our memory
+
+    FrameBuffer(const FrameBuffer &) = delete;
+    FrameBuffer &operator=(const FrameBuffer &) = delete;
 
     void clearBuffer(T value) {
         int size = W * H;
@@ -34,6 +42,8 @@ public:
         return buffer[x + y * W];
     }
 
+private:
+    bool ownsBuffer = true;
 };
 
 
@@ -0,0 +1,629 @@
+//
+// Bounding volume hierarchy of the triangles traced by the ray tracer.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_RT_BVH_H
+#define ITU_GRAPHICS_PROGRAMMING_RT_BVH_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cfloat>
+#include <cmath>
+#include <glm/glm.hpp>
+#include "rt_types.h"
+#include "rt_mesh.h"
+#include "rt_simd.h"
+#include "rt_thread_pool.h"
+
+namespace rt {
+
+    // a node of the hierarchy, 32 bytes so that two of them fit in a cache line
+    struct bvh_node {
+        glm::vec3 boundsMin;
+        // interior nodes: index of the second child (the first child is the next node), leaves: index of the first
+        // item of the leaf (e.g. the first triangle block in BVH::blocks)
+        int32_t secondOrFirst;
+        glm::vec3 boundsMax;
+        // number of items of a leaf, 0 for interior nodes
+        int32_t count;
+
+        bool isLeaf() const { return count > 0; }
+    };
+    static_assert(sizeof(bvh_node) == 32, "bvh_node should be 32 bytes");
+
+    struct bvh_box {
+        glm::vec3 min, max;
+
+        static bvh_box empty() { return bvh_box{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)}; }
+
+        void grow(const bvh_box &other) {
+            min = glm::min(min, other.min);
+            max = glm::max(max, other.max);
+        }
+
+        float area() const {
+            glm::vec3 d = glm::max(max - min, glm::vec3(0.0f));
+            return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+        }
+    };
+
+    // BOX HIERARCHY
+    // -------------
+    // a binary tree of boxes over a list of items that have a box each (triangles in BVH, instances of meshes in
+    // Scene). A ray only visits the leaves whose boxes it crosses, which are about log(N) of them instead of all N.
+    //
+    // The tree is built top-down with the surface area heuristic (SAH): the items of a node are split at the plane
+    // that minimizes the expected cost of tracing a ray through both halves (the number of items of each half
+    // weighted by the surface area of its box, the probability that a random ray hits it). The candidate planes are
+    // the borders of binCount bins along each axis, so the build is O(N log N).
+    // The nodes are stored in a flat array in depth-first order, so the first child of a node is always the next node
+    // and the subtrees are contiguous in memory.
+    //
+    // With more than one thread, the first levels are split on the calling thread until the nodes have at most a few
+    // thousand items, and the subtrees of those nodes are built in parallel on a thread pool, each into its own array
+    // of nodes. The arrays are then joined in depth-first order, so the tree is the same for any number of threads.
+    class BoxHierarchy {
+    public:
+        // the number of bins of the SAH build along each axis
+        static const int binCount = 16;
+        // the deepest level of the tree, which is also the size of the traversal stack
+        static const int maxDepth = 64;
+        // the parallel build does not make jobs of fewer items than this, smaller subtrees are not worth a job
+        static const int minJobItems = 1024;
+
+        // the largest number of items in a leaf, nodes with more items are always split (if they can be)
+        int maxLeafSize = 8;
+
+        bool empty() const { return m_nodes.empty(); }
+
+        const std::vector<bvh_node> &nodes() const { return m_nodes; }
+
+        // build the tree over the items with the boxes bounds, on up to threads threads. order gets the indices of
+        // the items in the order of the leaves, and each leaf gets the position of its first item in order
+        void build(const std::vector<bvh_box> &bounds, std::vector<uint32_t> &order, unsigned int threads = 1) {
+            int count = int(bounds.size());
+            m_nodes.clear();
+            order.resize(count);
+            for (int i = 0; i < count; i++)
+                order[i] = uint32_t(i);
+            if (count == 0)
+                return;
+            m_nodes.reserve(2 * count);
+            m_bounds = &bounds;
+            m_order = &order;
+            if (threads > 1 && count >= 2 * minJobItems)
+                buildParallel(count, threads);
+            else
+                buildNode(m_nodes, 0, count, 0);
+            m_bounds = nullptr;
+            m_order = nullptr;
+        }
+
+        // call visit(leaf) for the leaves that ray crosses closer than maxDist, visiting the closest leaves first.
+        // visit can make maxDist smaller (e.g. it is the distance of the closest hit so far), which skips the nodes
+        // that are farther away. If visit returns true the traversal stops, and traverse returns true too
+        template<class LeafVisitor>
+        bool traverse(const Ray &ray, const float &maxDist, LeafVisitor &&visit) const {
+            if (m_nodes.empty())
+                return false;
+
+            // a direction of 0 would give 0 * infinity = NaN in the slab test, a large value works the same
+            glm::vec3 invDir;
+            for (int i = 0; i < 3; i++)
+                invDir[i] = ray.direction[i] != 0 ? 1.0f / ray.direction[i] : FLT_MAX;
+
+            // nodes that are still to be visited, with the distance at which the ray enters them
+            struct entry { int node; float dist; };
+            entry stack[maxDepth];
+            int size = 0;
+
+            int node = 0;
+            if (enterDistance(m_nodes[0], ray.origin, invDir, maxDist) == FLT_MAX)
+                return false;
+            while (true) {
+                const bvh_node &current = m_nodes[node];
+                if (current.isLeaf()) {
+                    if (visit(current))
+                        return true;
+                } else {
+                    // visit the closest child first, and the other one later if it is still closer than maxDist
+                    int nearChild = node + 1, farChild = current.secondOrFirst;
+                    float nearDist = enterDistance(m_nodes[nearChild], ray.origin, invDir, maxDist);
+                    float farDist = enterDistance(m_nodes[farChild], ray.origin, invDir, maxDist);
+                    if (farDist < nearDist) {
+                        std::swap(nearChild, farChild);
+                        std::swap(nearDist, farDist);
+                    }
+                    if (nearDist != FLT_MAX) {
+                        if (farDist != FLT_MAX)
+                            stack[size++] = entry{farChild, farDist};
+                        node = nearChild;
+                        continue;
+                    }
+                }
+
+                // take the next node from the stack, skipping the ones behind the closest hit found meanwhile
+                do {
+                    if (size == 0)
+                        return false;
+                    size--;
+                } while (stack[size].dist >= maxDist);
+                node = stack[size].node;
+            }
+        }
+
+        // call visit(leaf, mask) for the leaves that any ray of packet crosses closer than its maximum distance in
+        // maxDist, mask has the bits of those rays. visit can make the maximum distances smaller (a negative distance
+        // removes a ray from the traversal). If visit returns true the traversal stops
+        template<class LeafVisitor>
+        void traverse(const ray_packet &packet, float maxDist[simd::width], LeafVisitor &&visit) const {
+            if (m_nodes.empty() || !packet.active)
+                return;
+
+            // nodes that are still to be visited, they are tested again when taken since the rays may have found
+            // closer hits meanwhile
+            int stack[maxDepth];
+            int size = 0;
+
+            int node = 0;
+            simd::vfloat enter;
+            int mask = enterBox(packet, m_nodes[0].boundsMin, m_nodes[0].boundsMax, simd::vfloat::load(maxDist), enter);
+            while (true) {
+                if (mask) {
+                    const bvh_node &current = m_nodes[node];
+                    if (current.isLeaf()) {
+                        if (visit(current, mask))
+                            return;
+                    } else {
+                        // visit first the child that the rays enter first
+                        int nearChild = node + 1, farChild = current.secondOrFirst;
+                        simd::vfloat nearEnter, farEnter;
+                        simd::vfloat dist = simd::vfloat::load(maxDist);
+                        int nearMask = enterBox(packet, m_nodes[nearChild].boundsMin, m_nodes[nearChild].boundsMax, dist, nearEnter);
+                        int farMask = enterBox(packet, m_nodes[farChild].boundsMin, m_nodes[farChild].boundsMax, dist, farEnter);
+                        if (nearMask && farMask && closest(farEnter, farMask) < closest(nearEnter, nearMask)) {
+                            std::swap(nearChild, farChild);
+                            std::swap(nearMask, farMask);
+                        }
+                        if (nearMask || farMask) {
+                            if (nearMask && farMask)
+                                stack[size++] = farChild;
+                            node = nearMask ? nearChild : farChild;
+                            mask = nearMask ? nearMask : farMask;
+                            continue;
+                        }
+                    }
+                }
+
+                // take the next node from the stack that a ray still enters before its maximum distance
+                if (size == 0)
+                    return;
+                node = stack[--size];
+                mask = enterBox(packet, m_nodes[node].boundsMin, m_nodes[node].boundsMax, simd::vfloat::load(maxDist), enter);
+            }
+        }
+
+    protected:
+        // the distance at which the ray enters the box of node, or FLT_MAX if it misses it or enters it after maxDist
+        static float enterDistance(const bvh_node &node, const glm::vec3 &origin, const glm::vec3 &invDir,
+                                   float maxDist) {
+            glm::vec3 t1 = (node.boundsMin - origin) * invDir;
+            glm::vec3 t2 = (node.boundsMax - origin) * invDir;
+            glm::vec3 tNear = glm::min(t1, t2), tFar = glm::max(t1, t2);
+            float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+            float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+            return enter <= exit && enter < maxDist ? enter : FLT_MAX;
+        }
+
+        // the smallest of the lanes of values in mask
+        static float closest(simd::vfloat values, int mask) {
+            alignas(32) float lanes[simd::width];
+            values.store(lanes);
+            float result = FLT_MAX;
+            for (int lane = 0; lane < simd::width; lane++)
+                if (mask & (1 << lane))
+                    result = std::min(result, lanes[lane]);
+            return result;
+        }
+
+        // append the node of the items [begin, end) of m_order and its subtree to nodes
+        void buildNode(std::vector<bvh_node> &nodes, int begin, int end, int depth) const {
+            int index = int(nodes.size());
+            nodes.push_back(bvh_node{});
+            int middle;
+            if (!splitNode(begin, end, depth, nodes[index], middle))
+                return;
+            buildNode(nodes, begin, middle, depth + 1);
+            nodes[index].secondOrFirst = int(nodes.size());
+            buildNode(nodes, middle, end, depth + 1);
+        }
+
+        // a subtree of the parallel build, built by a job into its own array of nodes, whose interior nodes point to
+        // their second child relative to the start of the array
+        struct build_job {
+            int begin, end, depth;
+            std::vector<bvh_node> nodes;
+        };
+
+        void buildParallel(int count, unsigned int threads) {
+            // a few jobs per thread, so that the work stealing of the pool can balance subtrees of different costs
+            int jobItems = std::max(int(minJobItems), count / int(8 * threads));
+            std::vector<build_job> jobs;
+            std::vector<bvh_node> top;
+            buildTop(top, jobs, 0, count, 0, jobItems);
+
+            ThreadPool pool;
+            pool.run(int(jobs.size()), threads, [&](int job, unsigned int) {
+                build_job &subtree = jobs[job];
+                subtree.nodes.reserve(2 * (subtree.end - subtree.begin));
+                buildNode(subtree.nodes, subtree.begin, subtree.end, subtree.depth);
+            });
+            appendTop(top, 0, jobs);
+        }
+
+        // append the node of the items [begin, end) of m_order and the nodes of the first levels below it to top.
+        // The nodes with at most jobItems items become a job, their node in top has the count -(job + 1)
+        void buildTop(std::vector<bvh_node> &top, std::vector<build_job> &jobs, int begin, int end, int depth,
+                      int jobItems) const {
+            int index = int(top.size());
+            top.push_back(bvh_node{});
+            if (end - begin <= jobItems) {
+                top[index].count = -int(jobs.size()) - 1;
+                jobs.push_back(build_job{begin, end, depth, {}});
+                return;
+            }
+            int middle;
+            if (!splitNode(begin, end, depth, top[index], middle))
+                return;
+            buildTop(top, jobs, begin, middle, depth + 1, jobItems);
+            top[index].secondOrFirst = int(top.size());
+            buildTop(top, jobs, middle, end, depth + 1, jobItems);
+        }
+
+        // append the node top[index] and its subtree to m_nodes, with the nodes of the jobs in the place of their
+        // node in top
+        void appendTop(const std::vector<bvh_node> &top, int index, const std::vector<build_job> &jobs) {
+            const bvh_node &node = top[index];
+            if (node.count < 0) {
+                int offset = int(m_nodes.size());
+                for (bvh_node subtreeNode : jobs[-node.count - 1].nodes) {
+                    if (!subtreeNode.isLeaf())
+                        subtreeNode.secondOrFirst += offset;
+                    m_nodes.push_back(subtreeNode);
+                }
+                return;
+            }
+            int appended = int(m_nodes.size());
+            m_nodes.push_back(node);
+            if (node.isLeaf())
+                return;
+            appendTop(top, index + 1, jobs);
+            m_nodes[appended].secondOrFirst = int(m_nodes.size());
+            appendTop(top, node.secondOrFirst, jobs);
+        }
+
+        // the box of the items [begin, end) of m_order in node. If the items should be split, sorts them into the
+        // halves [begin, middle) and [middle, end) and returns true, otherwise makes node a leaf of them
+        bool splitNode(int begin, int end, int depth, bvh_node &node, int &middle) const {
+            const std::vector<bvh_box> &itemBounds = *m_bounds;
+            std::vector<uint32_t> &order = *m_order;
+
+            bvh_box bounds = bvh_box::empty(), centroids = bvh_box::empty();
+            for (int t = begin; t < end; t++) {
+                const bvh_box &b = itemBounds[order[t]];
+                bounds.grow(b);
+                glm::vec3 c = (b.min + b.max) * .5f;
+                centroids.grow(bvh_box{c, c});
+            }
+            node.boundsMin = bounds.min;
+            node.boundsMax = bounds.max;
+
+            int count = end - begin;
+            int axis;
+            float splitPlane;
+            bool split = depth < maxDepth - 1 && count > 1 && findSplit(begin, end, bounds, centroids, axis, splitPlane);
+            middle = begin;
+            if (split) {
+                auto first = order.begin() + begin;
+                middle = begin + int(std::partition(first, first + count, [&](uint32_t item) {
+                    const bvh_box &b = itemBounds[item];
+                    return (b.min[axis] + b.max[axis]) * .5f < splitPlane;
+                }) - first);
+                split = middle > begin && middle < end;
+            }
+
+            if (!split) {
+                node.secondOrFirst = begin;
+                node.count = count;
+                return false;
+            }
+            node.count = 0;
+            return true;
+        }
+
+        // find the bin border with the smallest SAH cost. Returns false if it is cheaper to keep the items in a leaf
+        // (and the node is small enough to be a leaf), or if the centroids can not be separated
+        bool findSplit(int begin, int end, const bvh_box &bounds, const bvh_box &centroids, int &bestAxis,
+                       float &bestPlane) const {
+            const std::vector<bvh_box> &itemBounds = *m_bounds;
+            const std::vector<uint32_t> &order = *m_order;
+            int count = end - begin;
+            // the cost of tracing a ray through the items, in item tests (the cost of a node is about 1 test)
+            float leafCost = float(count);
+            float bestCost = FLT_MAX;
+
+            for (int axis = 0; axis < 3; axis++) {
+                float low = centroids.min[axis], extent = centroids.max[axis] - low;
+                if (extent <= 0)
+                    continue;
+
+                bvh_box binBounds[binCount];
+                int binItems[binCount] = {};
+                std::fill(binBounds, binBounds + binCount, bvh_box::empty());
+                float scale = binCount / extent;
+                for (int t = begin; t < end; t++) {
+                    const bvh_box &b = itemBounds[order[t]];
+                    int bin = std::min(binCount - 1, int(((b.min[axis] + b.max[axis]) * .5f - low) * scale));
+                    binBounds[bin].grow(b);
+                    binItems[bin]++;
+                }
+
+                // area and items on the left and on the right of each of the binCount - 1 borders
+                float leftArea[binCount - 1], rightArea[binCount - 1];
+                int leftCount[binCount - 1], rightCount[binCount - 1];
+                bvh_box left = bvh_box::empty(), right = bvh_box::empty();
+                int leftSum = 0, rightSum = 0;
+                for (int i = 0; i < binCount - 1; i++) {
+                    left.grow(binBounds[i]);
+                    leftSum += binItems[i];
+                    leftArea[i] = left.area();
+                    leftCount[i] = leftSum;
+                    right.grow(binBounds[binCount - 1 - i]);
+                    rightSum += binItems[binCount - 1 - i];
+                    rightArea[binCount - 2 - i] = right.area();
+                    rightCount[binCount - 2 - i] = rightSum;
+                }
+
+                for (int i = 0; i < binCount - 1; i++) {
+                    if (leftCount[i] == 0 || rightCount[i] == 0)
+                        continue;
+                    float cost = leftArea[i] * float(leftCount[i]) + rightArea[i] * float(rightCount[i]);
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestPlane = low + float(i + 1) / scale;
+                    }
+                }
+            }
+
+            if (bestCost == FLT_MAX)
+                return false;
+            // a split costs one node test plus the tests of the children, relative to the area of this node
+            float splitCost = 1.0f + bestCost / bounds.area();
+            return splitCost < leafCost || count > maxLeafSize;
+        }
+
+        std::vector<bvh_node> m_nodes;
+        // the boxes and the order of the items during the build
+        const std::vector<bvh_box> *m_bounds = nullptr;
+        std::vector<uint32_t> *m_order = nullptr;
+    };
+
+    class BVHCache;
+
+    // BOUNDING VOLUME HIERARCHY
+    // -------------------------
+    // a box hierarchy over the triangles of an indexed mesh, which only reads the positions of its vertices.
+    // The triangles of each leaf are stored in blocks of simd::width triangles, which a ray tests at the same time
+    // (intersectBlock), and a packet of rays can traverse the tree together.
+    class BVH : public BoxHierarchy {
+    public:
+        // the first corner of each triangle (see indexed_mesh), in the order of the leaves. Each leaf starts at a
+        // multiple of simd::width (the triangles of block b are at [b * simd::width, (b + 1) * simd::width)), and the
+        // entries after its last triangle are noTriangle
+        std::vector<uint32_t> triangles;
+        static const uint32_t noTriangle = 0xffffffffu;
+
+        // build the hierarchy over the triangles of mesh, on up to threads threads
+        void build(const indexed_mesh &mesh, unsigned int threads = 1) {
+            int count = int(mesh.triangleCount());
+            m_blocks.clear();
+            std::vector<bvh_box> bounds(count);
+            for (int i = 0; i < count; i++)
+                bounds[i] = triangleBox(mesh, uint32_t(i * 3));
+            std::vector<uint32_t> order;
+            BoxHierarchy::build(bounds, order, threads);
+            buildBlocks(mesh, order);
+        }
+
+        // update the boxes after the vertices of mesh moved, the tree keeps the same structure. It is much faster than
+        // build, but the tree gets slower to trace if the triangles move far from where they were when it was built.
+        // mesh must have the same triangles as when the tree was built
+        void refit(const indexed_mesh &mesh) {
+            // the children of a node come after it, so going backwards every child is updated before its parent
+            for (int n = int(m_nodes.size()) - 1; n >= 0; n--) {
+                bvh_node &node = m_nodes[n];
+                if (node.isLeaf()) {
+                    bvh_box bounds = bvh_box::empty();
+                    for (int b = node.secondOrFirst; b < node.secondOrFirst + blockCount(node); b++) {
+                        for (int lane = 0; lane < simd::width; lane++) {
+                            uint32_t firstCorner = triangles[b * simd::width + lane];
+                            if (firstCorner == noTriangle)
+                                continue;
+                            bounds.grow(triangleBox(mesh, firstCorner));
+                            m_blocks[b].set(lane, mesh.positionOf(firstCorner), mesh.positionOf(firstCorner + 1),
+                                            mesh.positionOf(firstCorner + 2), int32_t(firstCorner));
+                        }
+                    }
+                    node.boundsMin = bounds.min;
+                    node.boundsMax = bounds.max;
+                } else {
+                    const bvh_node &first = m_nodes[n + 1], &second = m_nodes[node.secondOrFirst];
+                    node.boundsMin = glm::min(first.boundsMin, second.boundsMin);
+                    node.boundsMax = glm::max(first.boundsMax, second.boundsMax);
+                }
+            }
+        }
+
+        const std::vector<triangle_block> &blocks() const { return m_blocks; }
+
+        // the number of triangle blocks of a leaf
+        static int blockCount(const bvh_node &leaf) { return (leaf.count + simd::width - 1) / simd::width; }
+
+        // closest intersection of ray with the triangles, if it is closer than hit.dist. Like
+        // Renderer::rayModelIntersection, except that of two triangles at the same distance the one with the lower
+        // index is kept (rayModelIntersection keeps the first one it tests, which is also the lower one)
+        bool intersect(const Ray &ray, Hit &hit) const {
+            traverse(ray, hit.dist, [&](const bvh_node &leaf) {
+                for (int b = leaf.secondOrFirst; b < leaf.secondOrFirst + blockCount(leaf); b++) {
+                    block_hits hits;
+                    intersectBlock(ray, m_blocks[b], hit.dist, true, hits);
+                    closestHit(m_blocks[b], hits, hit);
+                }
+                return false; // look for a closer hit
+            });
+            return hit.hit_ID >= 0;
+        }
+
+        // returns true if ray hits a triangle at a distance of tMax or less, stopping at the first one found
+        bool occluded(const Ray &ray, float tMax) const {
+            // the nodes entered exactly at tMax can still have an occluder
+            float maxDist = std::nextafter(tMax, FLT_MAX);
+            return traverse(ray, maxDist, [&](const bvh_node &leaf) {
+                for (int b = leaf.secondOrFirst; b < leaf.secondOrFirst + blockCount(leaf); b++) {
+                    block_hits hits;
+                    intersectBlock(ray, m_blocks[b], tMax, true, hits);
+                    if (hits.mask)
+                        return true;
+                }
+                return false;
+            });
+        }
+
+        // intersect for each ray of packet, the closest hit of the ray in lane i is stored in hits[i]. The nodes are
+        // visited if any of the rays enters them, and only the rays that enter a leaf test its triangles, so the
+        // hits are the same as tracing each ray with intersect
+        void intersect(const ray_packet &packet, Hit hits[simd::width]) const {
+            // the distance of the closest hit of each ray so far, -1 for the lanes without a ray
+            alignas(32) float maxDist[simd::width];
+            for (int lane = 0; lane < simd::width; lane++)
+                maxDist[lane] = packet.active & (1 << lane) ? hits[lane].dist : -1.0f;
+
+            traverse(packet, maxDist, [&](const bvh_node &leaf, int mask) {
+                for (int lane = 0; lane < simd::width; lane++) {
+                    if (!(mask & (1 << lane)))
+                        continue;
+                    Ray ray = packet.ray(lane);
+                    for (int b = leaf.secondOrFirst; b < leaf.secondOrFirst + blockCount(leaf); b++) {
+                        block_hits blockHits;
+                        intersectBlock(ray, m_blocks[b], hits[lane].dist, true, blockHits);
+                        closestHit(m_blocks[b], blockHits, hits[lane]);
+                    }
+                    if (hits[lane].hit_ID >= 0)
+                        maxDist[lane] = hits[lane].dist;
+                }
+                return false;
+            });
+        }
+
+        // occluded for each ray of packet, with the maximum distance in tMax of its lane. Returns the mask of the
+        // occluded rays, the traversal stops when all the rays are occluded
+        int occluded(const ray_packet &packet, const float tMax[simd::width]) const {
+            // the rays that are already occluded get a maximum distance of -1, so they do not enter more nodes
+            alignas(32) float maxDist[simd::width];
+            for (int lane = 0; lane < simd::width; lane++)
+                maxDist[lane] = packet.active & (1 << lane) ? std::nextafter(tMax[lane], FLT_MAX) : -1.0f;
+            int occludedMask = 0;
+
+            traverse(packet, maxDist, [&](const bvh_node &leaf, int mask) {
+                for (int lane = 0; lane < simd::width; lane++) {
+                    if (!(mask & (1 << lane)))
+                        continue;
+                    Ray ray = packet.ray(lane);
+                    for (int b = leaf.secondOrFirst; b < leaf.secondOrFirst + blockCount(leaf); b++) {
+                        block_hits blockHits;
+                        intersectBlock(ray, m_blocks[b], tMax[lane], true, blockHits);
+                        if (blockHits.mask) {
+                            occludedMask |= 1 << lane;
+                            maxDist[lane] = -1.0f;
+                            break;
+                        }
+                    }
+                }
+                return occludedMask == packet.active;
+            });
+            return occludedMask;
+        }
+
+    private:
+        // saves and loads the nodes and the triangles
+        friend class BVHCache;
+
+        // the box of the triangle of mesh starting at firstCorner, slightly larger than the triangle.
+        // rayTriangleIntersection accepts hits a little outside of the triangle, and a ray that lies in the plane of
+        // a face of a box (e.g. a ray at y = 0 and a triangle with all its vertices at y = 0) could miss the box
+        static bvh_box triangleBox(const indexed_mesh &mesh, uint32_t firstCorner) {
+            const glm::vec3 &a = mesh.positionOf(firstCorner), &b = mesh.positionOf(firstCorner + 1),
+                            &c = mesh.positionOf(firstCorner + 2);
+            bvh_box bounds{glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c))};
+            glm::vec3 size = bounds.max - bounds.min;
+            glm::vec3 magnitude = glm::max(glm::abs(bounds.min), glm::abs(bounds.max));
+            float pad = 1e-5f * (std::max(size.x, std::max(size.y, size.z)) +
+                                 std::max(magnitude.x, std::max(magnitude.y, magnitude.z)));
+            bounds.min -= pad;
+            bounds.max += pad;
+            return bounds;
+        }
+
+        // keep in hit the closest of the hits of a block, and of two at the same distance the lower triangle
+        static void closestHit(const triangle_block &block, const block_hits &hits, Hit &hit) {
+            for (int lane = 0; lane < simd::width; lane++) {
+                if (!(hits.mask & (1 << lane)))
+                    continue;
+                float dist = hits.dist[lane];
+                if (dist < hit.dist || (dist == hit.dist && block.vertex[lane] < hit.hit_ID)) {
+                    hit.hit_ID = block.vertex[lane];
+                    hit.dist = dist;
+                    hit.barycentric = glm::vec3(1.0f - hits.u[lane] - hits.v[lane], hits.u[lane], hits.v[lane]);
+                }
+            }
+        }
+
+        // put the triangles of each leaf in blocks of simd::width triangles, in the order of the build. The leaves
+        // then point to their first block instead of their first triangle
+        void buildBlocks(const indexed_mesh &mesh, const std::vector<uint32_t> &order) {
+            triangles.clear();
+            int blocks = 0;
+            for (bvh_node &node : m_nodes) {
+                if (!node.isLeaf())
+                    continue;
+                int first = node.secondOrFirst;
+                node.secondOrFirst = blocks;
+                blocks += blockCount(node);
+                for (int t = 0; t < blockCount(node) * simd::width; t++)
+                    triangles.push_back(t < node.count ? order[first + t] * 3 : uint32_t(noTriangle));
+            }
+            setBlocks(mesh);
+        }
+
+        // the blocks of triangles from the positions of mesh, the lanes of noTriangle are empty
+        void setBlocks(const indexed_mesh &mesh) {
+            m_blocks.assign(triangles.size() / simd::width, triangle_block{});
+            for (size_t i = 0; i < m_blocks.size() * simd::width; i++) {
+                triangle_block &block = m_blocks[i / simd::width];
+                int lane = int(i % simd::width);
+                uint32_t firstCorner = triangles[i];
+                if (firstCorner == noTriangle)
+                    block.clear(lane);
+                else
+                    block.set(lane, mesh.positionOf(firstCorner), mesh.positionOf(firstCorner + 1),
+                              mesh.positionOf(firstCorner + 2), int32_t(firstCorner));
+            }
+        }
+
+        std::vector<triangle_block> m_blocks;
+    };
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_RT_BVH_H
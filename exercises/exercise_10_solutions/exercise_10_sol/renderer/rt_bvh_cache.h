@@ -0,0 +1,283 @@
+//
+// Cache of the bounding volume hierarchies of the ray tracer in binary files.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_RT_BVH_CACHE_H
+#define ITU_GRAPHICS_PROGRAMMING_RT_BVH_CACHE_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <initializer_list>
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include "rt_types.h"
+#include "rt_bvh.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RT_BVH_CACHE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace rt {
+
+    // BVH CACHE
+    // ---------
+    // the build of the hierarchy of a large mesh takes most of the time of opening it, so the finished hierarchy
+    // (its nodes and the order of its triangles) is saved to a file in directory, and the next time the same mesh is
+    // opened it is loaded instead of built. A file is named after a hash of the positions of the corners
+    // of the triangles of its mesh, so a mesh that changed gets a different file, and it starts with a header that
+    // must match what the loading program would build (the format version, simd::width, the sizes of the structures
+    // and the build settings). A file that does not match is built again and overwritten.
+    // The file is mapped into memory (mmap) where it is available, and read with a stream elsewhere, and its
+    // arrays are copied to the BVH. The blocks of triangles are not saved, they are set again from the positions of
+    // the mesh in the order of the triangles (O(N), much less than a build), so the hits always come from the mesh.
+    // A file can be damaged or written by someone else: it is only used if its nodes form a tree no deeper than
+    // BoxHierarchy::maxDepth whose leaves are in the blocks, and its triangles are corners of the mesh, so that the
+    // traversal never leaves the arrays (or its stack) whatever the file holds.
+    class BVHCache {
+    public:
+        // increase when the layout of the file, or the build, changes
+        static const uint32_t formatVersion = 3;
+
+        explicit BVHCache(std::string directory) : m_directory(std::move(directory)) {}
+
+        // load the hierarchy of mesh into bvh from its file, or build it on up to threads threads and save it.
+        // Returns true if it was loaded
+        bool buildOrLoad(BVH &bvh, const indexed_mesh &mesh, unsigned int threads = 1) const {
+            uint64_t hash = contentHash(mesh);
+            std::string path = pathOf(hash);
+            if (load(bvh, path, hash, mesh))
+                return true;
+            bvh.build(mesh, threads);
+            save(bvh, path, hash, mesh.indices.size());
+            return false;
+        }
+
+        // FNV-1a hash of the number of corners of the triangles and their positions, the only part of the mesh the
+        // hierarchy depends on
+        static uint64_t contentHash(const indexed_mesh &mesh) {
+            uint64_t hash = 14695981039346656037ull;
+            auto add = [&](const void *data, size_t size) {
+                const unsigned char *bytes = static_cast<const unsigned char *>(data);
+                for (size_t i = 0; i < size; i++)
+                    hash = (hash ^ bytes[i]) * 1099511628211ull;
+            };
+            uint64_t count = mesh.indices.size();
+            add(&count, sizeof(count));
+            for (uint32_t corner = 0; corner < uint32_t(count); corner++)
+                add(&mesh.positionOf(corner), sizeof(glm::vec3));
+            return hash;
+        }
+
+        // the file of the mesh with the content hash hash
+        std::string pathOf(uint64_t hash) const {
+            char name[32];
+            std::snprintf(name, sizeof(name), "%016llx.rtbvh", static_cast<unsigned long long>(hash));
+            if (m_directory.empty())
+                return name;
+            char last = m_directory.back();
+            return m_directory + (last == '/' || last == '\\' ? "" : "/") + name;
+        }
+
+        // load bvh, the hierarchy of mesh with the content hash hash, from the file at path, if it was saved by a
+        // program that builds the same hierarchy. Returns false (and leaves bvh as it was) otherwise
+        bool load(BVH &bvh, const std::string &path, uint64_t hash, const indexed_mesh &mesh) const {
+            file_contents file;
+            if (!file.open(path) || file.size < sizeof(file_header))
+                return false;
+            file_header header;
+            std::memcpy(&header, file.data, sizeof(header));
+            size_t cornerCount = mesh.indices.size();
+            if (!(header == headerOf(bvh, hash, cornerCount, header.nodeCount, header.triangleCount)) ||
+                !sizeMatches(header, file.size) || header.nodeCount == 0 || header.triangleCount % simd::width != 0)
+                return false;
+
+            const unsigned char *data = file.data + sizeof(file_header);
+            std::vector<bvh_node> nodes(header.nodeCount);
+            std::vector<uint32_t> triangles(header.triangleCount);
+            copy(nodes, data);
+            copy(triangles, data);
+            if (!validTree(nodes, triangles.size() / simd::width))
+                return false;
+            for (uint32_t firstCorner : triangles)
+                if (firstCorner != BVH::noTriangle && (firstCorner % 3 != 0 || uint64_t(firstCorner) + 3 > cornerCount))
+                    return false;
+
+            bvh.m_nodes.swap(nodes);
+            bvh.triangles.swap(triangles);
+            bvh.setBlocks(mesh);
+            return true;
+        }
+
+        // save bvh, the hierarchy of a mesh of cornerCount corners with the content hash hash, to the file at
+        // path. The file is written under another name and renamed, so a program that is loading it never sees a
+        // file that is half written. Returns false if it could not be written
+        bool save(const BVH &bvh, const std::string &path, uint64_t hash, size_t cornerCount) const {
+            file_header header = headerOf(bvh, hash, cornerCount, bvh.m_nodes.size(), bvh.triangles.size());
+            std::string temporary = path + ".tmp";
+            {
+                std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+                file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+                write(file, bvh.m_nodes);
+                write(file, bvh.triangles);
+                if (!file.good()) {
+                    file.close();
+                    std::remove(temporary.c_str());
+                    return false;
+                }
+            }
+            // rename does not replace an existing file on every system
+            std::remove(path.c_str());
+            if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+                std::remove(temporary.c_str());
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        // the start of a file, the arrays of nodes and triangles follow it in this order
+        struct file_header {
+            char magic[8];
+            uint32_t version, simdWidth, nodeSize, maxDepth;
+            int32_t maxLeafSize, binCount;
+            uint64_t contentHash, cornerCount;
+            uint64_t nodeCount, triangleCount;
+
+            bool operator==(const file_header &other) const {
+                return std::memcmp(this, &other, sizeof(file_header)) == 0;
+            }
+        };
+
+        static file_header headerOf(const BVH &bvh, uint64_t hash, size_t cornerCount, uint64_t nodeCount,
+                                    uint64_t triangleCount) {
+            file_header header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, "RTBVH\r\n", 8);
+            header.version = formatVersion;
+            header.simdWidth = simd::width;
+            header.nodeSize = sizeof(bvh_node);
+            header.maxDepth = BVH::maxDepth;
+            header.maxLeafSize = bvh.maxLeafSize;
+            header.binCount = BVH::binCount;
+            header.contentHash = hash;
+            header.cornerCount = cornerCount;
+            header.nodeCount = nodeCount;
+            header.triangleCount = triangleCount;
+            return header;
+        }
+
+        // true if a file of size bytes holds exactly the header and its arrays. The counts come from the file, they
+        // are compared with what is left of it one array at a time so that no size overflows
+        static bool sizeMatches(const file_header &header, uint64_t size) {
+            uint64_t left = size - sizeof(file_header);
+            if (header.nodeCount > left / sizeof(bvh_node))
+                return false;
+            left -= header.nodeCount * sizeof(bvh_node);
+            if (header.triangleCount > left / sizeof(uint32_t))
+                return false;
+            return left == header.triangleCount * sizeof(uint32_t);
+        }
+
+        // true if nodes is a tree that the traversal can not leave: the first child of each interior node is the next
+        // node and the second one comes after it, so every path goes forward and ends in a leaf, no node is deeper than
+        // maxDepth - 1 (the traversal stack holds at most one node per level), and the leaves are in the blockCount
+        // blocks
+        static bool validTree(const std::vector<bvh_node> &nodes, uint64_t blockCount) {
+            // the depth of each node, -1 for the nodes that are not reached from the root
+            std::vector<int> depths(nodes.size(), -1);
+            depths[0] = 0;
+            for (size_t n = 0; n < nodes.size(); n++) {
+                const bvh_node &node = nodes[n];
+                if (node.isLeaf()) {
+                    uint64_t blocks = (uint64_t(node.count) + simd::width - 1) / simd::width;
+                    if (node.secondOrFirst < 0 || uint64_t(node.secondOrFirst) + blocks > blockCount)
+                        return false;
+                    continue;
+                }
+                if (node.count != 0 || node.secondOrFirst <= int64_t(n) + 1 ||
+                    uint64_t(node.secondOrFirst) >= nodes.size())
+                    return false;
+                if (depths[n] < 0)
+                    continue;
+                if (depths[n] + 1 >= BVH::maxDepth)
+                    return false;
+                for (size_t child : {n + 1, size_t(node.secondOrFirst)})
+                    depths[child] = std::max(depths[child], depths[n] + 1);
+            }
+            return true;
+        }
+
+        template<class T>
+        static void copy(std::vector<T> &items, const unsigned char *&data) {
+            std::memcpy(items.data(), data, items.size() * sizeof(T));
+            data += items.size() * sizeof(T);
+        }
+
+        template<class T>
+        static void write(std::ofstream &file, const std::vector<T> &items) {
+            file.write(reinterpret_cast<const char *>(items.data()), std::streamsize(items.size() * sizeof(T)));
+        }
+
+        // the bytes of a file, mapped into memory or read into a buffer
+        struct file_contents {
+            const unsigned char *data = nullptr;
+            uint64_t size = 0;
+
+            file_contents() = default;
+            file_contents(const file_contents &) = delete;
+            file_contents &operator=(const file_contents &) = delete;
+
+#if defined(RT_BVH_CACHE_MMAP)
+            bool open(const std::string &path) {
+                int descriptor = ::open(path.c_str(), O_RDONLY);
+                if (descriptor < 0)
+                    return false;
+                struct stat status;
+                if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+                    void *mapped = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+                    if (mapped != MAP_FAILED) {
+                        data = static_cast<const unsigned char *>(mapped);
+                        size = uint64_t(status.st_size);
+                    }
+                }
+                // the mapping stays valid after the file is closed
+                ::close(descriptor);
+                return data != nullptr;
+            }
+
+            ~file_contents() {
+                if (data)
+                    munmap(const_cast<unsigned char *>(data), size_t(size));
+            }
+#else
+            std::vector<unsigned char> buffer;
+
+            bool open(const std::string &path) {
+                std::ifstream file(path, std::ios::binary | std::ios::ate);
+                if (!file)
+                    return false;
+                buffer.resize(size_t(file.tellg()));
+                file.seekg(0);
+                file.read(reinterpret_cast<char *>(buffer.data()), std::streamsize(buffer.size()));
+                if (!file || buffer.empty())
+                    return false;
+                data = buffer.data();
+                size = buffer.size();
+                return true;
+            }
+#endif
+        };
+
+        std::string m_directory;
+    };
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_RT_BVH_CACHE_H
@@ -0,0 +1,179 @@
+//
+// Edge-aware à-trous wavelet filter of the ray tracer: smooths a color buffer, and fills in the pixels that have no
+// value, without blurring across the edges of the surfaces.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_RT_DENOISER_H
+#define ITU_GRAPHICS_PROGRAMMING_RT_DENOISER_H
+
+#include <vector>
+#include <algorithm>
+#include <initializer_list>
+#include <cstddef>
+#include <glm/glm.hpp>
+#include "rt_simd.h"
+#include "rt_thread_pool.h"
+
+namespace rt {
+
+    // À-TROUS FILTER
+    // --------------
+    // each pass replaces the value of a pixel by the weighted average of the 5x5 pixels around it, spaced by 2^pass
+    // pixels (the holes, "trous", of the kernel grow with each pass), so a few passes reach far for the cost of 25
+    // taps per pixel each. The weight of a pixel is the B-spline kernel (1/16, 1/4, 3/8, 1/4, 1/16 on each axis) times
+    // the edge-stopping functions, which are close to 1 for the pixels that see the same surface and 0 for the others:
+    // - normal: max(dot(n, n'), 0)^normalPower, the pixels on another face of an object do not contribute
+    // - depth: max(1 - |d - d'| / (depthTolerance * d * spacing), 0), neither do the pixels of objects behind or in
+    //   front, d is the distance of the camera ray to the surface
+    // - color: max(1 - |l - l'| / colorTolerance, 0) with the luminance l, which keeps the sharp details of the values
+    //   (e.g. the edges of a reflected object). A pixel without a value ignores it and takes any of its neighbors
+    // The pixels without a value, or without a surface (a normal of length 0), have a weight of 0. After a pass, the
+    // pixels with any neighbor of their surface have a value: the taps of the first pass reach 2 pixels away, so a
+    // buffer with a value every 2 (or up to 4) pixels is filled in by the first pass, and the next ones smooth it.
+    //
+    // The buffers are planes of floats (one per channel), with a border of pixels without a surface around the image,
+    // so that the taps never leave the planes: the pixels of a row are filtered simd::width at a time with the same
+    // instructions and no special case at the edges, and the rows are distributed over the threads
+    class ATrousFilter {
+    public:
+        // number of passes, the last one has taps 2^(passes - 1) pixels apart. 2 passes remove most of the aliasing
+        // of the reflections, and the ones after the first cost about as much as a tenth of the rays of a frame
+        int passes = 2;
+        // the edge-stopping parameters (see above), normalPower is rounded down to a power of 2
+        int normalPower = 64;
+        float depthTolerance = 0.05f;
+        float colorTolerance = 0.5f;
+
+        // start a frame of width x height pixels, all without a value and without a surface
+        void resize(unsigned int width, unsigned int height) {
+            // the taps reach 2 spacings away, and the last group of a row covers up to simd::width - 1 pixels past
+            // its end, whose taps reach as far again
+            m_border = (2 << std::max(passes - 1, 0)) + simd::width - 1;
+            m_W = width;
+            m_H = height;
+            m_stride = int(width) + 2 * m_border;
+            size_t size = size_t(m_stride) * (height + 2 * m_border);
+            for (auto *plane : {&m_nx, &m_ny, &m_nz, &m_depth})
+                plane->assign(size, 0.0f);
+            for (int i = 0; i < 2; i++)
+                for (auto *plane : {&m_r[i], &m_g[i], &m_b[i], &m_weight[i]})
+                    plane->assign(size, 0.0f);
+            m_current = 0;
+        }
+
+        // the value of pixel x, y if it has one, and the surface seen through it: its normal (length 0 if there is
+        // none) and its distance to the camera
+        void set(unsigned int x, unsigned int y, const glm::vec3 &value, bool hasValue, const glm::vec3 &normal,
+                 float depth) {
+            size_t i = index(x, y);
+            m_r[m_current][i] = value.r;
+            m_g[m_current][i] = value.g;
+            m_b[m_current][i] = value.b;
+            m_weight[m_current][i] = hasValue ? 1.0f : 0.0f;
+            m_nx[i] = normal.x;
+            m_ny[i] = normal.y;
+            m_nz[i] = normal.z;
+            m_depth[i] = depth;
+        }
+
+        // run the passes, the rows of each pass are filtered by up to threads threads of pool
+        void filter(ThreadPool &pool, unsigned int threads) {
+            int squarings = 0;
+            while ((2 << squarings) <= normalPower)
+                squarings++;
+            for (int pass = 0; pass < passes; pass++) {
+                int spacing = 1 << pass;
+                pool.run(int(m_H), threads, [&](int y, unsigned int) {
+                    filterRow(y, spacing, squarings);
+                });
+                m_current = 1 - m_current;
+            }
+        }
+
+        // the filtered value of pixel x, y, 0 if none of the pixels around it had a value for its surface
+        glm::vec3 valueAt(unsigned int x, unsigned int y) const {
+            size_t i = index(x, y);
+            return glm::vec3(m_r[m_current][i], m_g[m_current][i], m_b[m_current][i]);
+        }
+
+    private:
+        size_t index(unsigned int x, unsigned int y) const {
+            return size_t(x + m_border) + size_t(y + m_border) * m_stride;
+        }
+
+        // one pass over the row y, from the current planes to the other ones
+        void filterRow(int y, int spacing, int squarings) {
+            using simd::vfloat;
+            static const float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+            const vfloat zero = vfloat::set1(0.0f), one = vfloat::set1(1.0f);
+            const vfloat lr = vfloat::set1(0.2126f), lg = vfloat::set1(0.7152f), lb = vfloat::set1(0.0722f);
+            const vfloat inverseColorTolerance = vfloat::set1(1.0f / std::max(colorTolerance, 1e-6f));
+            const float *r = m_r[m_current].data(), *g = m_g[m_current].data(), *b = m_b[m_current].data(),
+                        *weight = m_weight[m_current].data();
+            int next = 1 - m_current;
+            float *outR = m_r[next].data(), *outG = m_g[next].data(), *outB = m_b[next].data(),
+                  *outWeight = m_weight[next].data();
+
+            // the last group of a row ends in the border, which stays without a surface
+            for (unsigned int x = 0; x < m_W; x += simd::width) {
+                size_t p = index(x, unsigned(y));
+                vfloat nx = vfloat::load(&m_nx[p]), ny = vfloat::load(&m_ny[p]), nz = vfloat::load(&m_nz[p]);
+                vfloat depth = vfloat::load(&m_depth[p]);
+                vfloat inverseDepthTolerance = one / max(vfloat::set1(depthTolerance * float(spacing)) * depth,
+                                                         vfloat::set1(1e-6f));
+                vfloat luminance = lr * vfloat::load(r + p) + lg * vfloat::load(g + p) + lb * vfloat::load(b + p);
+                // the pixels without a value take their neighbors whatever their color
+                vfloat anyColor = (vfloat::load(weight + p) <= zero) & one;
+
+                vfloat sumR = zero, sumG = zero, sumB = zero, sumWeight = zero;
+                for (int dy = -2; dy <= 2; dy++) {
+                    for (int dx = -2; dx <= 2; dx++) {
+                        size_t q = size_t(ptrdiff_t(p) + ptrdiff_t(dy * spacing) * m_stride + dx * spacing);
+                        vfloat tapWeight = vfloat::load(weight + q);
+                        if ((zero < tapWeight).mask() == 0)
+                            continue; // none of the taps has a value
+                        vfloat cosine = max(nx * vfloat::load(&m_nx[q]) + ny * vfloat::load(&m_ny[q]) +
+                                            nz * vfloat::load(&m_nz[q]), zero);
+                        vfloat w = cosine;
+                        for (int i = 0; i < squarings; i++)
+                            w = w * w;
+                        vfloat depthDifference = depth - vfloat::load(&m_depth[q]);
+                        depthDifference = max(depthDifference, zero - depthDifference);
+                        w = w * max(one - depthDifference * inverseDepthTolerance, zero);
+                        vfloat tapR = vfloat::load(r + q), tapG = vfloat::load(g + q), tapB = vfloat::load(b + q);
+                        vfloat luminanceDifference = luminance - (lr * tapR + lg * tapG + lb * tapB);
+                        luminanceDifference = max(luminanceDifference, zero - luminanceDifference);
+                        w = w * max(max(one - luminanceDifference * inverseColorTolerance, zero), anyColor);
+                        w = w * tapWeight * vfloat::set1(kernel[dx + 2] * kernel[dy + 2]);
+                        sumR = sumR + w * tapR;
+                        sumG = sumG + w * tapG;
+                        sumB = sumB + w * tapB;
+                        sumWeight = sumWeight + w;
+                    }
+                }
+                // the pixels without any contribution keep their value (and stay without a value)
+                vfloat filled = zero < sumWeight;
+                vfloat inverse = one / max(sumWeight, vfloat::set1(1e-30f));
+                blend(filled, sumR * inverse, vfloat::load(r + p)).store(outR + p);
+                blend(filled, sumG * inverse, vfloat::load(g + p)).store(outG + p);
+                blend(filled, sumB * inverse, vfloat::load(b + p)).store(outB + p);
+                (filled & one).store(outWeight + p);
+            }
+        }
+
+        // a in the lanes where mask is true, b in the others
+        static simd::vfloat blend(simd::vfloat mask, simd::vfloat a, simd::vfloat b) {
+            return (mask & a) | andNot(mask, b);
+        }
+
+        unsigned int m_W = 0, m_H = 0;
+        int m_border = 0, m_stride = 0;
+        // the surface of each pixel
+        std::vector<float> m_nx, m_ny, m_nz, m_depth;
+        // the values, and 1 where there is one, in two sets of planes that the passes go back and forth between
+        std::vector<float> m_r[2], m_g[2], m_b[2], m_weight[2];
+        int m_current = 0;
+    };
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_RT_DENOISER_H
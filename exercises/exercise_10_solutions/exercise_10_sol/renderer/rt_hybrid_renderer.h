@@ -0,0 +1,228 @@
+//
+// Hybrid renderer: the software rasterizer of exercise 7 (srl) finds what the camera sees, the ray tracer only traces
+// the shadow and reflected rays.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_RT_HYBRID_RENDERER_H
+#define ITU_GRAPHICS_PROGRAMMING_RT_HYBRID_RENDERER_H
+
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+#include "srl_triangle_renderer.h"
+#include "rt_renderer.h"
+
+namespace rt {
+
+    // SURFACE PROGRAM
+    // ---------------
+    // the srl shader program of HybridRenderer, it writes the surface of each pixel to a G-buffer: the instance drawn,
+    // the distance from the camera of the position interpolated at the pixel, and the normal and color of the
+    // vertices interpolated there (the positions and normals are in the space of the scene). The
+    // fragment shader is positioned (see srl::is_positioned), it is called with the pixel of each fragment that passed
+    // the depth test, so the last surface written to a pixel is the closest one. Its color output is not used
+    namespace hybrid_shaders {
+
+        struct surface_varyings {
+            glm::vec3 position;
+            glm::vec3 normal;
+            Colors::color col;
+
+            friend surface_varyings operator/(surface_varyings v, float sc) {
+                return surface_varyings{v.position / sc, v.normal / sc, v.col / sc};
+            }
+            friend surface_varyings operator*(surface_varyings v, float sc) {
+                return surface_varyings{v.position * sc, v.normal * sc, v.col * sc};
+            }
+            friend surface_varyings operator-(surface_varyings v1, const surface_varyings &v2) {
+                return surface_varyings{v1.position - v2.position, v1.normal - v2.normal, v1.col - v2.col};
+            }
+            friend surface_varyings operator+(surface_varyings v1, const surface_varyings &v2) {
+                return surface_varyings{v1.position + v2.position, v1.normal + v2.normal, v1.col + v2.col};
+            }
+        };
+
+        // the model matrix is the transform of the instance, from its mesh to the space of the scene
+        struct surface_vertex_shader {
+            // transforms the normals of the mesh of the instance to the space of the scene (Scene::normalMatrix)
+            glm::mat3 normalMatrix = glm::mat3(1.0f);
+
+            surface_varyings operator()(const srl::vertex &in, const srl::uniforms &u, glm::vec4 &/*clipPos*/) const {
+                return surface_varyings{glm::vec3(u.model * in.pos), normalMatrix * glm::vec3(in.norm), in.col};
+            }
+        };
+
+        struct surface_fragment_shader {
+            static const bool positioned = true;
+
+            // the G-buffer, and the rows of it that the frame buffer of the draw covers: row y of the frame buffer is
+            // row firstRow + y of the G-buffer, the rows from rows on are past the G-buffer
+            gbuffer *surfaces = nullptr;
+            int firstRow = 0, rows = 0;
+            // the instance drawn plus 1 (see gbuffer::instance), and the tint of its material
+            uint32_t instance = 0;
+            Colors::color tint = Colors::white;
+            // the position of the camera, in the space of the scene
+            glm::vec3 camera = glm::vec3(0.0f);
+
+            srl::Colors::color operator()(const surface_varyings &/*in*/) const {
+                return srl::Colors::black;
+            }
+
+            srl::Colors::color operator()(const surface_varyings &in, int x, int y) const {
+                if (y < rows) {
+                    size_t pixel = size_t(x) + size_t(firstRow + y) * surfaces->W;
+                    surfaces->instance[pixel] = instance;
+                    surfaces->dist[pixel] = glm::length(in.position - camera);
+                    surfaces->normal[pixel] = glm::normalize(in.normal);
+                    surfaces->col[pixel] = in.col * tint;
+                }
+                return srl::Colors::black;
+            }
+        };
+    }
+
+    // HYBRID RENDERER
+    // ---------------
+    // renders a Scene like Renderer::render, but the surfaces seen by the camera are rasterized by srl instead of
+    // traced. Each instance is drawn with the surface program, with a projection that matches the camera rays of the
+    // ray tracer (the same fov and aspect ratio, and the pixel x, y sampled at its corner), so the G-buffer ends up
+    // with the closest surface of each pixel, interpolated from the vertices like the ray tracer does at a hit.
+    // Renderer::render(..., const gbuffer&) shades them without intersecting the camera rays, and traces the shadow and
+    // reflected rays from them.
+    //
+    // The image is split in bands of bandHeight rows, which are rasterized in parallel on the threads of the tracer,
+    // each band with its own srl renderer and buffers, and a projection that maps the band to the whole viewport. The
+    // bands do not depend on the number of threads, so neither does the image.
+    //
+    // The image is the one of the ray tracer except at a few pixels on the silhouettes of the triangles, where the
+    // rasterizer and the camera ray pick different triangles (the rasterizer rounds the vertices to 1/256 of a pixel).
+    // The camera rays of the pixels without a surface are traced as usual. The back faces are not culled, since the
+    // ray tracer sees both sides of a triangle
+    class HybridRenderer {
+    public:
+        // the rows of the bands of the image that are rasterized in parallel
+        static const int bandHeight = 64;
+
+        // the ray tracer of the shadow and reflected rays, and its settings (threads, wavefront, ...)
+        Renderer tracer;
+        // the G-buffer of the last frame
+        gbuffer surfaces;
+
+        // render the instances of scene, with the model matrix m and the view matrix v (see Renderer::render)
+        void render(Scene &scene,
+                    const glm::mat4 &m,
+                    const glm::mat4 &v,
+                    const float fov_degrees,
+                    unsigned int depth,
+                    FrameBuffer <uint32_t> &fb) {
+            scene.update();
+            rasterize(scene, m, v, fov_degrees, fb.W, fb.H);
+            tracer.render(scene, m, v, fov_degrees, depth, fb, surfaces);
+        }
+
+    private:
+        using surface_rasterizer = srl::TriangleRendererT<hybrid_shaders::surface_varyings,
+                hybrid_shaders::surface_vertex_shader, hybrid_shaders::surface_fragment_shader>;
+
+        // the renderer and the render target of a thread, the size of a band. The target has a single sample per
+        // pixel, at the corner the camera ray goes through, so that the triangles are rasterized with sub-pixel
+        // precision (see srl::MultisampleBuffer): with the vertices snapped to the pixels, the pixels along the
+        // silhouettes would often get the surface next to the one of their camera ray
+        struct band_raster {
+            surface_rasterizer raster;
+            std::unique_ptr<srl::MultisampleBuffer> target;
+        };
+
+        // the surfaces of the pixels, band by band
+        void rasterize(const Scene &scene, const glm::mat4 &m, const glm::mat4 &v, float fov_degrees,
+                       unsigned int width, unsigned int height) {
+            copyMeshes(scene);
+            surfaces.resize(width, height);
+
+            // the far plane just behind the farthest corner of the scene from the camera, and the near plane close
+            // enough not to clip anything a camera ray can see in practice, with enough depth precision in between
+            bvh_box bounds = scene.bounds();
+            bool empty = bounds.min.x > bounds.max.x;
+            glm::vec3 camera(glm::inverse(v * m) * glm::vec4(0, 0, 0, 1));
+            glm::vec3 farthest = glm::max(glm::abs(bounds.min - camera), glm::abs(bounds.max - camera));
+            float farPlane = glm::length(farthest) * 1.01f, nearPlane = farPlane * 1e-3f;
+            // the model matrix of the draws is the transform of the instance, m moves the scene to the world
+            glm::mat4 viewProjection = glm::perspectiveFov(std::abs(glm::radians(fov_degrees)), float(width),
+                                                           float(height), nearPlane, farPlane) * v * m;
+
+            unsigned int threads = std::max(tracer.threads, 1u);
+            if (m_bands.size() < threads)
+                m_bands.resize(threads);
+            int bandCount = (int(height) + bandHeight - 1) / bandHeight;
+            m_pool.run(bandCount, threads, [&](int band, unsigned int thread) {
+                // bandHeight + 0 is a copy, std::min takes references and bandHeight has no definition to refer to
+                int firstRow = band * bandHeight, rows = std::min(bandHeight + 0, int(height) - firstRow);
+                // no surface, until one is drawn
+                std::fill_n(surfaces.instance.begin() + size_t(firstRow) * width, size_t(rows) * width, 0u);
+                if (empty)
+                    return;
+
+                band_raster &state = m_bands[thread];
+                if (!state.target || state.target->W != width) {
+                    state.raster.m_cullBackFaces = false;
+                    state.target.reset(new srl::MultisampleBuffer(width, bandHeight, 1));
+                }
+                state.target->clearBuffer(0, 1.0f);
+
+                // window row firstRow + y of the image is row y of the band: y' = y * H / h + (H - 2 firstRow) / h - 1
+                // in normalized device coordinates, i.e. the same for the clip space y with w in place of 1
+                glm::mat4 toBand(1.0f);
+                toBand[1][1] = float(height) / bandHeight;
+                toBand[3][1] = float(int(height) - 2 * firstRow) / bandHeight - 1.0f;
+                glm::mat4 bandProjection = toBand * viewProjection;
+
+                hybrid_shaders::surface_fragment_shader &shader = state.raster.fragmentShader;
+                shader.surfaces = &surfaces;
+                shader.firstRow = firstRow;
+                shader.rows = rows;
+                shader.camera = camera;
+                for (int i = 0; i < scene.instanceCount(); i++) {
+                    const instance &drawn = scene.instanceAt(i);
+                    state.raster.vertexShader.normalMatrix = scene.normalMatrix(i);
+                    shader.instance = uint32_t(i) + 1;
+                    shader.tint = scene.materialOf(i).tint;
+                    state.raster.render(m_meshes[drawn.mesh], scene.meshAt(drawn.mesh).geometry.indices,
+                                        drawn.transform, bandProjection, *state.target);
+                }
+            });
+        }
+
+        // srl copies of the vertices of the meshes of scene, drawn with the indices of the meshes. They are made
+        // again when the scene changes
+        void copyMeshes(const Scene &scene) {
+            if (m_scene == &scene && m_sceneVersion == scene.version())
+                return;
+            m_scene = &scene;
+            m_sceneVersion = scene.version();
+            m_meshes.resize(scene.meshCount());
+            for (int mesh = 0; mesh < scene.meshCount(); mesh++) {
+                const indexed_mesh &geometry = scene.meshAt(mesh).geometry;
+                std::vector<srl::vertex> &copy = m_meshes[mesh];
+                copy.resize(geometry.positions.size());
+                for (size_t i = 0; i < copy.size(); i++) {
+                    const shading_vertex &shading = geometry.shading[i];
+                    copy[i] = srl::vertex{glm::vec4(geometry.positions[i], 1.0f), glm::vec4(shading.norm, 0.0f),
+                                          shading.col, shading.uv};
+                }
+            }
+        }
+
+        std::vector<band_raster> m_bands;
+        ThreadPool m_pool;
+        std::vector<std::vector<srl::vertex>> m_meshes;
+        const Scene *m_scene = nullptr;
+        unsigned long long m_sceneVersion = 0;
+    };
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_RT_HYBRID_RENDERER_H
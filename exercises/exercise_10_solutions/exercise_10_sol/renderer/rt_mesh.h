@@ -0,0 +1,185 @@
+//
+// Indexed triangle meshes of the ray tracer, and their import from the vertex lists and the model loaders of the
+// other exercises.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_RT_MESH_H
+#define ITU_GRAPHICS_PROGRAMMING_RT_MESH_H
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <glm/glm.hpp>
+#include "rt_types.h"
+
+namespace rt {
+
+    // the attributes of a vertex that only the shading of a hit reads
+    struct shading_vertex {
+        glm::vec3 norm;
+        Colors::color col;
+        glm::vec2 uv;
+    };
+
+    // INDEXED MESH
+    // ------------
+    // every vertex of a mesh is stored once, and every 3 indices form a triangle (like every 3 vertices of a vertex
+    // list), so the triangles around a vertex share it. The positions and the shading attributes of the vertices are
+    // separate streams: the build of the hierarchy and the intersections only read positions (and the blocks of the
+    // hierarchy, see BVH), the shading attributes are read once per traced ray, for its closest hit
+    // (Renderer::surfaceGeometry).
+    // A corner is one of the 3 vertices of a triangle: corner c is the vertex indices[c], and the corners of triangle
+    // t are 3 * t, 3 * t + 1 and 3 * t + 2. Hit::hit_ID is the first corner of the triangle that was hit, which is the
+    // same number as the first vertex of the triangle in a vertex list.
+    // A vertex of a vertex list takes 56 bytes, 168 per triangle. Here a triangle takes 12 bytes of indices, plus 48
+    // bytes per vertex (12 of position and 36 of shading attributes), and a smooth closed mesh has about half as many
+    // vertices as triangles
+    struct indexed_mesh {
+        std::vector<glm::vec3> positions;
+        std::vector<shading_vertex> shading;
+        std::vector<uint32_t> indices;
+
+        size_t triangleCount() const { return indices.size() / 3; }
+
+        const glm::vec3 &positionOf(uint32_t corner) const { return positions[indices[corner]]; }
+
+        const shading_vertex &shadingOf(uint32_t corner) const { return shading[indices[corner]]; }
+
+        // the vertex of corner with all its attributes, as in a vertex list
+        vertex vertexOf(uint32_t corner) const {
+            const shading_vertex &s = shadingOf(corner);
+            return vertex{glm::vec4(positionOf(corner), 1.0f), glm::vec4(s.norm, 0.0f), s.col, s.uv};
+        }
+
+        // the triangles as a vertex list, every 3 vertices form a triangle
+        std::vector<vertex> vertexList() const {
+            std::vector<vertex> vts(indices.size());
+            for (size_t corner = 0; corner < indices.size(); corner++)
+                vts[corner] = vertexOf(uint32_t(corner));
+            return vts;
+        }
+
+        // the memory taken by the streams
+        size_t bytes() const {
+            return positions.size() * sizeof(glm::vec3) + shading.size() * sizeof(shading_vertex) +
+                   indices.size() * sizeof(uint32_t);
+        }
+    };
+
+    // MESH BUILDER
+    // ------------
+    // builds an indexed_mesh from triangles given corner by corner, the way the loaders and the vertex lists store
+    // them: a corner that is equal to a vertex that was already added (the same position and shading attributes, bit
+    // for bit) uses that vertex, the others add a new one. The triangles are kept in the order they are added
+    class MeshBuilder {
+    public:
+        explicit MeshBuilder(indexed_mesh &mesh) : m_mesh(mesh) {
+            for (uint32_t i = 0; i < uint32_t(mesh.positions.size()); i++)
+                m_vertices.emplace(key{mesh.positions[i], mesh.shading[i]}, i);
+        }
+
+        // add the next corner of the current triangle
+        void addCorner(const glm::vec3 &position, const shading_vertex &shading) {
+            auto added = m_vertices.emplace(key{position, shading}, uint32_t(m_mesh.positions.size()));
+            if (added.second) {
+                m_mesh.positions.push_back(position);
+                m_mesh.shading.push_back(shading);
+            }
+            m_mesh.indices.push_back(added.first->second);
+        }
+
+        void addCorner(const vertex &v) {
+            addCorner(glm::vec3(v.pos), shadingOf(v));
+        }
+
+        // true if a and b would be stored as the same vertex of a mesh
+        static bool sameVertex(const vertex &a, const vertex &b) {
+            return key{glm::vec3(a.pos), shadingOf(a)} == key{glm::vec3(b.pos), shadingOf(b)};
+        }
+
+    private:
+        static shading_vertex shadingOf(const vertex &v) {
+            return shading_vertex{glm::vec3(v.norm), v.col, v.uv};
+        }
+
+        // the bits of the 12 floats of a vertex, two vertices are the same if all their bits are
+        struct key {
+            uint32_t bits[12];
+
+            key(const glm::vec3 &position, const shading_vertex &shading) {
+                // the members one by one, the padding of shading_vertex (if any) is not part of the vertex
+                std::memcpy(bits, &position, sizeof(position));
+                std::memcpy(bits + 3, &shading.norm, sizeof(shading.norm));
+                std::memcpy(bits + 6, &shading.col, sizeof(shading.col));
+                std::memcpy(bits + 10, &shading.uv, sizeof(shading.uv));
+            }
+
+            bool operator==(const key &other) const { return std::memcmp(bits, other.bits, sizeof(bits)) == 0; }
+        };
+
+        // FNV-1a over the 32 bit words of a key instead of its bytes
+        struct key_hash {
+            size_t operator()(const key &k) const {
+                uint64_t hash = 14695981039346656037ull;
+                for (uint32_t word : k.bits)
+                    hash = (hash ^ word) * 1099511628211ull;
+                return size_t(hash ^ (hash >> 32));
+            }
+        };
+
+        indexed_mesh &m_mesh;
+        std::unordered_map<key, uint32_t, key_hash> m_vertices;
+    };
+
+    // MESH IMPORT
+    // -----------
+    // the vertex lists of the ray tracer, the output of loadOBJ (exercise 8) and the Model classes of the exercises
+    // (the one of exercise 8 over loadOBJ, and the ones over assimp from exercise 9 on) as indexed meshes. The
+    // vertices of the loaders have no color, col is given to all of them (the material tint multiplies it)
+
+    // the triangles of the vertex list vts (every 3 vertices form a triangle)
+    inline indexed_mesh meshFromVertices(const std::vector<vertex> &vts) {
+        indexed_mesh mesh;
+        MeshBuilder builder(mesh);
+        for (size_t i = 0; i + 2 < vts.size(); i += 3)
+            for (size_t corner = i; corner < i + 3; corner++)
+                builder.addCorner(vts[corner]);
+        return mesh;
+    }
+
+    // the triangles loaded by the glm version of loadOBJ: the position, uv and normal of each corner, every 3 corners
+    // form a triangle
+    inline indexed_mesh meshFromOBJ(const std::vector<glm::vec3> &positions,
+                                    const std::vector<glm::vec2> &uvs,
+                                    const std::vector<glm::vec3> &normals,
+                                    const Colors::color &col = Colors::white) {
+        indexed_mesh mesh;
+        MeshBuilder builder(mesh);
+        size_t cornerCount = positions.size() / 3 * 3;
+        for (size_t corner = 0; corner < cornerCount; corner++)
+            builder.addCorner(positions[corner], shading_vertex{normals[corner], col, uvs[corner]});
+        return mesh;
+    }
+
+    // the triangles of all the meshes of model, a Model of the exercises: model.meshes, each with the vertices
+    // (Position, Normal and TexCoords) and the indices of its triangles
+    template<class Model>
+    indexed_mesh meshFromModel(const Model &model, const Colors::color &col = Colors::white) {
+        indexed_mesh mesh;
+        MeshBuilder builder(mesh);
+        for (const auto &part : model.meshes) {
+            for (size_t i = 0; i + 2 < part.indices.size(); i += 3) {
+                for (size_t corner = i; corner < i + 3; corner++) {
+                    const auto &v = part.vertices[part.indices[corner]];
+                    builder.addCorner(glm::vec3(v.Position),
+                                      shading_vertex{glm::vec3(v.Normal), col, glm::vec2(v.TexCoords)});
+                }
+            }
+        }
+        return mesh;
+    }
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_RT_MESH_H
@@ -6,128 +6,436 @@
 #define ITU_GRAPHICS_PROGRAMMING_RT_RENDERER_H
 
 #include <vector>
+#include <string>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <algorithm>
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include "rt_types.h"
+#include "rt_bvh.h"
+#include "rt_scene.h"
+#include "rt_thread_pool.h"
+#include "rt_denoiser.h"
 #include "frame_buffer.h"
 
 namespace rt{
     using namespace Colors;
     using namespace glm;
 
+    // G-BUFFER
+    // --------
+    // what the camera sees through each pixel of a frame (pixel x, y is at x + y * W), e.g. rasterized by
+    // HybridRenderer. Renderer::render can shade it instead of tracing the camera rays, and only traces the shadow
+    // and reflected rays
+    struct gbuffer {
+        unsigned int W = 0, H = 0;
+        // the instance seen through each pixel plus 1, 0 if there is none, and the distance of its surface from the
+        // camera along the camera ray of the pixel, and the normal (normalized, in the space of the scene) and color
+        // (with the tint of the material) of the surface there. The surface is at the same point the camera ray would
+        // hit it, so only the distance is stored, like in a Hit
+        std::vector<uint32_t> instance;
+        std::vector<float> dist;
+        std::vector<vec3> normal;
+        std::vector<color> col;
+
+        void resize(unsigned int width, unsigned int height) {
+            W = width;
+            H = height;
+            size_t size = size_t(W) * H;
+            instance.resize(size);
+            dist.resize(size);
+            normal.resize(size);
+            col.resize(size);
+        }
+    };
+
     class Renderer{
         // limits the number of reflections, 1 == no reflection
         const unsigned int max_recursion = 5;
-        // mixture parameter for combining local illumination and reflected color
-        float p_rg = 0.4f;
 
     public:
+        // number of rays traced (camera, shadow and reflected rays) since it was last set to 0, for statistics
+        unsigned long long rayCount = 0;
+
+        // number of threads that trace the rays of render, and the size in pixels of the square tiles they take
+        unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+        static const int tileSize = 16;
+        // the size in pixels of the packets of camera rays traced together, simd::width rays in total
+        static const int packetW = simd::width / 2, packetH = 2;
+
+        // the time it took to render each tile of the last frame, in rows of tiles from the bottom left corner
+        std::vector<float> tileMilliseconds;
+
+        // trace the rays through a bounding volume hierarchy of the triangles, if false every ray tests every
+        // triangle (rayModelIntersection)
+        bool useBVH = true;
+        // directory where build saves the bounding volume hierarchy of the vertex list, and loads it from the next
+        // time the same vertices are built (Scene::bvhCacheDirectory), empty to always build it
+        std::string bvhCacheDirectory;
+
+        // trace the rays of each tile breadth first: all the camera rays, then all the shadow rays, then all the
+        // reflected rays and their shadow rays, and so on (see traceWavefront). If false, each camera ray is followed
+        // depth first by its shadow and reflected rays, like traceRay. Both give the same image
+        bool wavefront = true;
+
+        // progressive mode: while the scene, matrices, fov, depth and frame size given to render stay the same,
+        // each frame adds one more sample per pixel (at a random point inside the pixel) to an accumulation buffer,
+        // and fb shows the average of the samples of each pixel. A still view converges to an anti-aliased image
+        // instead of tracing the same rays every frame. Any change starts the accumulation again
+        bool progressive = false;
+        // the most samples a pixel gets, the frames after that only copy the accumulated image to fb
+        unsigned int maxSamples = 256;
+        // adaptive sampling of progressive mode: if > 0, a pixel stops getting samples once the error of its average
+        // (the standard deviation of the mean of its luminance) is below adaptiveTolerance, so the samples go to the
+        // noisy pixels (edges, reflections) and not to the flat ones. The error is estimated after minAdaptiveSamples
+        float adaptiveTolerance = 0.0f;
+        unsigned int minAdaptiveSamples = 8;
+
+        // LOW SAMPLE COUNT MODE
+        // each pixel has a single sample, and the reflected rays of the camera hits are only traced for one pixel out
+        // of reflectionStep x reflectionStep (the ones whose x and y are multiples of reflectionStep), e.g. 2 for
+        // reflections at half resolution, which saves most of the reflected rays and of their shadow rays. The
+        // reflected color (the reflectivity of the surface times the color of its reflected ray) is kept apart and
+        // filtered by denoiser, which fills in the other pixels from the neighbors that see the same surface and
+        // smooths the aliasing of the reflections. With denoise, the reflected color is filtered even if all the pixels
+        // trace their reflected ray. The ambient and direct light of the camera hits are not filtered.
+        // Not used in progressive mode or without reflections (depth 1)
+        int reflectionStep = 1;
+        bool denoise = false;
+        ATrousFilter denoiser;
+
+        // the number of frames accumulated in progressive mode since the last change
+        unsigned int accumulatedFrames() const { return m_accumulatedFrames; }
+
+        // start the accumulation of progressive mode again at the next frame, e.g. after changing the vertices
+        // without changing their number (build and refit call it, and changes of a Scene are found by render)
+        void resetAccumulation() { m_accumulationValid = false; }
+
+        // render the triangles of vts (every 3 vertices form a triangle) with the model matrix m and the view matrix v.
+        // vts is traced as a scene with a single instance of an indexed copy of the vertices (meshFromVertices), which
+        // is made by build and updated by refit. The functions that take a vertex list compare it to the one of the
+        // last build or refit (a copy is kept), and refit the copy if the vertices changed in place or build it if their
+        // number changed, so they always trace vts; calling refit or build after a change only chooses when it happens
         void render(const std::vector<vertex> &vts,
                     const glm::mat4 &m,
                     const glm::mat4 &v,
                     const float fov_degrees,
                     unsigned int depth,
                     FrameBuffer <uint32_t> &fb) {
+            render(sceneOf(vts), m, v, fov_degrees, depth, fb);
+        }
 
-            float aspect_ratio = fb.H / fb.W;
-            // we use the fov and the tangent function to compute where is the bottom of the projection plane,
-            // we assume that the projection place is 1 unit in front of the camera (z == -1)
-            float bottom = - tan(abs(radians(fov_degrees)) * 0.5f);
-
-            // find the transformation that move points from camera space to model space
-            mat4 view_to_model = inverse(v * m);
-            // the bottom left corner of the image plane/camera sensor
-            vec4 lower_left_corner = vec4(bottom * aspect_ratio, bottom, -1, 1);
-            // we transform the camera position (also the convergence point of light rays) from camera coordinates to MODEL coordinates
-            // notice that we implicitly assume that the camera position is at 0,0,0 in its one coordinate space
-            vec4 cam_pos = view_to_model * vec4(0,0,0,1);
-
-            // the distance from the center of one pixel to the next along the horizontal and vertical axes of the screen
-            // notice that * and / are applied component wise
-            vec2 pixel_size = abs(vec2(lower_left_corner)) * 2.0f / vec2(fb.H, fb.W);
+        // render the instances of scene, the whole scene is placed with the model matrix m (usually the identity,
+        // each instance has its own transform). Calls scene.update, so the changes of the instances since the last
+        // frame are rendered
+        void render(Scene &scene,
+                    const glm::mat4 &m,
+                    const glm::mat4 &v,
+                    const float fov_degrees,
+                    unsigned int depth,
+                    FrameBuffer <uint32_t> &fb) {
+            renderFrame(scene, m, v, fov_degrees, depth, fb, nullptr);
+        }
 
+        // render the instances of scene seen through the pixels of surfaces, which has the size of fb and the
+        // instances and surfaces of the pixels (for the current instances of the scene). The surfaces are shaded
+        // instead of tracing the camera rays, then only the shadow and reflected rays are traced. The camera rays of
+        // the pixels without a surface are traced, so the image is the one of render without surfaces where surfaces
+        // has the closest surface of each camera ray. Progressive mode is not used, each pixel has one sample
+        void render(Scene &scene,
+                    const glm::mat4 &m,
+                    const glm::mat4 &v,
+                    const float fov_degrees,
+                    unsigned int depth,
+                    FrameBuffer <uint32_t> &fb,
+                    const gbuffer &surfaces) {
+            renderFrame(scene, m, v, fov_degrees, depth, fb, &surfaces);
+        }
 
-            // TODO ex 10.1 iterate through all pixels in the buffer (width: [0, fb.W), height:[0, fb.H])
-            //  for each pixel,
-            //  - find its position in the space of the camera,
-            //  - apply the view_to_model transformation so that we place the pixel in the space of the model
-            //  (do you notice a different pattern? contrary to the typical raster pipeline, it is sometimes cheaper to
-            //  transform from camera space than the other way around -fewer computations-, what is important is that
-            //  all intersection computations should happen in the same space, no matter what that space is)
-            //  - create a ray with the camera origin, and the vector from the camera origin to the pixel you have just found
-            //  - call the TraceRay method using that ray, and store the resulting color in the frame buffer (fb)
-            for (int c = 0; c < fb.W; c++){
-                for(int r = 0; r < fb.H; r++){
-                    vec4 pixel_pos = lower_left_corner + vec4 (vec2(c, r) * pixel_size,0, 0);
-                    pixel_pos = view_to_model * pixel_pos;  // transform from camera coord space to model coord space
-                    Ray ray(cam_pos, normalize(pixel_pos - cam_pos));
-                    color col = traceRay(ray, depth, vts);  // trace te ray / compute the color
-                    fb.paintAt(c, r, toRGBA32(col));        // set the color on the frame buffer
-                }
+        // paint each tile of the last frame with the time it took to render, from blue (the fastest tile) to red
+        // (the slowest ones), to see where the ray tracer spends its time. fb must have the size of the last frame.
+        // The 2% slowest tiles are all red, so that a few tiles interrupted by the operating system do not make
+        // all the others blue
+        void paintTileHeatmap(FrameBuffer<uint32_t> &fb) const {
+            if (tileMilliseconds.empty())
+                return;
+            std::vector<float> sorted(tileMilliseconds);
+            std::sort(sorted.begin(), sorted.end());
+            float fastest = sorted.front(), slowest = sorted[sorted.size() * 98 / 100];
+            for (int tile = 0; tile < int(tileMilliseconds.size()); tile++) {
+                float heat = slowest > fastest ? std::min((tileMilliseconds[tile] - fastest) / (slowest - fastest), 1.0f) : 0.0f;
+                uint32_t col = toRGBA32(mix(blue, red, heat));
+                int c0 = (tile % m_tilesW) * tileSize, r0 = (tile / m_tilesW) * tileSize;
+                for (int r = r0; r < std::min(r0 + tileSize, int(fb.H)); r++)
+                    for (int c = c0; c < std::min(c0 + tileSize, int(fb.W)); c++)
+                        fb.paintAt(c, r, col);
             }
-
         }
 
 
         color traceRay(const Ray & ray,
                        unsigned int depth,
                        const std::vector<vertex> &vts){
+            return traceRay(ray, depth, sceneOf(vts));
+        }
+
+        // traceRay in a scene, which must be up to date (Scene::update)
+        color traceRay(const Ray & ray,
+                       unsigned int depth,
+                       const Scene &scene){
+            unsigned long long rays = 0;
+            color col = traceRay(ray, depth, scene, rays);
+            rayCount += rays;
+            return col;
+        }
+
+        // traceRay, adding the rays it traces to rays instead of rayCount (each thread of render has its own counter)
+        color traceRay(const Ray & ray,
+                       unsigned int depth,
+                       const Scene &scene,
+                       unsigned long long &rays){
+            Hit hitInfo; // used to store the hit information
+            rays++;
+            intersect(ray, scene, hitInfo);
+            return shade(ray, hitInfo, depth, scene, rays);
+        }
+
+        // the shading of a point hit by a ray that does not depend on other rays
+        struct surface_point {
+            vec3 pos, normal;
+            // the color of the point without the light, and the light that is added if it reaches the point
+            color ambient, direct;
+            // direction and distance to the light
+            vec3 lightDir;
+            float lightDist;
+            // the fraction of the color of the reflected ray that is added
+            float reflectivity;
+        };
+
+        // the color seen by ray, which hit the scene at hitInfo (or nothing if hitInfo.hit_ID < 0)
+        color shade(const Ray & ray,
+                    const Hit & hitInfo,
+                    unsigned int depth,
+                    const Scene &scene,
+                    unsigned long long &rays){
+            if (hitInfo.hit_ID < 0) return black; // no hit, return black
+            return shade(ray, surfaceAt(ray, hitInfo, scene), depth, scene, rays);
+        }
+
+        // shade, with the surface hit by ray
+        color shade(const Ray & ray,
+                    const surface_point & surface,
+                    unsigned int depth,
+                    const Scene &scene,
+                    unsigned long long &rays){
             // this is here to ensure we don't end up with a long recursion that can freeze the program (or cause a stack overflow)
             depth = depth > max_recursion ? max_recursion : depth;
 
-            color col = black; // used to output a color
-            Hit hitInfo; // used to store the hit information
-            if (!rayModelIntersection(ray, vts, hitInfo)) return col; // no hit, return black
+            color col = surface.ambient; // used to output a color
 
+            // TODO ex 10.4 check if the light source is visible from i_pos, we only use the diffuse and specular components if that is the case
+            rays++;
+            // check if there is geometry in the direction of the light that is closer than the light source,
+            // any such geometry casts the shadow so we do not need the closest one
+            if (!occluded(shadowRay(surface), scene, surface.lightDist)) {
+                // the light is visible from i_pos (there is no occlusion), so we add the direct lighting
+                col += surface.direct;
+            }
+
+            // the recursion/reflection happens here!
+            if (depth > 1) {
+                // integrate the current color with the reflection color by the reflectivity of the material
+                col += surface.reflectivity * traceRay(reflectedRay(ray, surface), depth - 1, scene, rays);
+            }
+
+            return col;
+        }
+
+        surface_point surfaceAt(const Ray & ray,
+                                const Hit & hitInfo,
+                                const Scene &scene) const {
+            vec3 i_pos, i_normal;
+            color i_col;
+            surfaceGeometry(ray, hitInfo, scene, i_pos, i_normal, i_col);
+            return surfaceAt(i_pos, i_normal, i_col, scene.materialOf(hitInfo.instance));
+        }
+
+        // the position where ray hit the scene, and the normal and color of the surface there (in the space of the scene)
+        static void surfaceGeometry(const Ray & ray,
+                                    const Hit & hitInfo,
+                                    const Scene &scene,
+                                    vec3 &i_pos, vec3 &i_normal, color &i_col) {
+            // the shading attributes of the vertices of the triangle that was hit, in the space of the mesh. They are
+            // only read here, for the closest hit of the ray
+            const indexed_mesh &geometry = scene.meshOf(hitInfo.instance).geometry;
+            const shading_vertex &v0 = geometry.shadingOf(uint32_t(hitInfo.hit_ID)),
+                                 &v1 = geometry.shadingOf(uint32_t(hitInfo.hit_ID + 1)),
+                                 &v2 = geometry.shadingOf(uint32_t(hitInfo.hit_ID + 2));
 
             // TODO ex 10.2 replace the current i_normal and i_col computation with their interpolated versions
-            vec3 i_normal = vts[hitInfo.hit_ID].norm * hitInfo.barycentric.x + vts[hitInfo.hit_ID+1].norm * hitInfo.barycentric.y + vts[hitInfo.hit_ID+2].norm * hitInfo.barycentric.z;
-            i_normal = normalize(i_normal);
-            color i_col = vts[hitInfo.hit_ID].col * hitInfo.barycentric.x + vts[hitInfo.hit_ID+1].col * hitInfo.barycentric.y + vts[hitInfo.hit_ID+2].col * hitInfo.barycentric.z;
+            i_normal = v0.norm * hitInfo.barycentric.x + v1.norm * hitInfo.barycentric.y + v2.norm * hitInfo.barycentric.z;
+            i_normal = normalize(scene.normalMatrix(hitInfo.instance) * i_normal); // from the mesh to the scene
+            i_col = v0.col * hitInfo.barycentric.x + v1.col * hitInfo.barycentric.y + v2.col * hitInfo.barycentric.z;
+            i_col *= scene.materialOf(hitInfo.instance).tint;
 
-            vec3 i_pos = ray.origin + ray.direction * hitInfo.dist;
+            i_pos = ray.origin + ray.direction * hitInfo.dist;
+        }
 
+        // the shading of the point i_pos of a surface of surfaceMaterial, with the normal i_normal and color i_col
+        static surface_point surfaceAt(const vec3 &i_pos,
+                                       const vec3 &i_normal,
+                                       const color &i_col,
+                                       const material &surfaceMaterial) {
             // TODO ex 10.3 implement the phong reflection model for the point light below
-            float ambient = 0.1f, diffuse = 0.5f, specular = 0.5f, shininess = 10;
+            float ambient = surfaceMaterial.ambient, diffuse = surfaceMaterial.diffuse, specular = surfaceMaterial.specular,
+                  shininess = surfaceMaterial.shininess;
             vec3 light_pos(0,1.9f,0); // light position in model space
             vec3 light_dir = normalize(light_pos - i_pos);
 
-            col = ambient * i_col;
+            surface_point surface;
+            surface.pos = i_pos;
+            surface.normal = i_normal;
+            surface.ambient = ambient * i_col;
+            surface.direct = diffuse * i_col * max(dot(light_dir, i_normal), .0f) +
+                             specular * pow(max(dot(light_dir, i_normal), .0f), shininess);
+            surface.lightDir = light_dir;
+            surface.lightDist = length(light_pos - i_pos);
+            surface.reflectivity = surfaceMaterial.reflectivity;
+            return surface;
+        }
 
-            // TODO ex 10.4 check if the light source is visible from i_pos, we only use the diffuse and specular components if that is the case
-            Ray shadow_ray(i_pos + i_normal * .001f, light_dir); // i_normal * .001f is handling numerical precision issues, it prevents self-intersection
-            float light_dist = length(light_pos - i_pos);
-            Hit shadow_hit;
-            // check if there is geometry in the direction of the light, and if the closest geometry is closer than the light source
-            if (rayModelIntersection(shadow_ray, vts, shadow_hit) && light_dist < shadow_hit.dist) {
-                // the light is visible from i_pos (there is no occlusion), so we compute direct lighting
-                col += diffuse * i_col * max(dot(light_dir, i_normal), .0f) +
-                       specular * pow(max(dot(light_dir, i_normal), .0f), shininess);
+        // the ray from surface to the light
+        static Ray shadowRay(const surface_point &surface){
+            // i_normal * .001f is handling numerical precision issues, it prevents self-intersection
+            return Ray(surface.pos + surface.normal * .001f, surface.lightDir);
+        }
+
+        // the reflection at surface of ray
+        static Ray reflectedRay(const Ray &ray, const surface_point &surface){
+            Ray reflected_ray(surface.pos, reflect(ray.direction, surface.normal));
+            reflected_ray.origin -= ray.direction * .001f; // this is a small offset to address numerical precision issues
+            return reflected_ray;
+        }
+
+        // closest intersection of ray with the triangles of vts, like rayModelIntersection, using the bounding volume
+        // hierarchy if useBVH is true. Every call compares all of vts to the vertices of the last build or refit (see
+        // render), to trace many rays add the vertices to a Scene and trace it instead
+        bool intersect(const Ray & ray,
+                       const std::vector<vertex> &vts,
+                       Hit &hit){
+            return intersect(ray, sceneOf(vts), hit);
+        }
+
+        // closest intersection of ray with the instances of scene, which must be up to date (Scene::update).
+        // If useBVH is false, the ray is tested against every triangle of every instance
+        bool intersect(const Ray & ray,
+                       const Scene &scene,
+                       Hit &hit){
+            if (useBVH)
+                return scene.intersect(ray, hit);
+
+            for (int i = 0; i < scene.instanceCount(); i++) {
+                float dist = hit.dist;
+                rayModelIntersection(scene.toInstance(i, ray), scene.meshOf(i).geometry, hit);
+                if (hit.dist != dist)
+                    hit.instance = i;
             }
+            return hit.hit_ID >= 0;
+        }
 
-            // the recursion/reflection happens here!
-            if (depth > 1) {
-                Ray reflected_ray(i_pos, reflect(ray.direction, i_normal));
-                reflected_ray.origin -= ray.direction * .001f; // this is a small offset to address numerical precision issues
-                // integrate the current color with the reflection color by a p_rg factor
-                col += p_rg * traceRay(reflected_ray, depth - 1, vts);
+        // intersect for each ray of packet, the closest hit of the ray in lane i is stored in hits[i]. With the
+        // bounding volume hierarchy the rays are traced together, with the same results as one by one
+        void intersect(const ray_packet &packet,
+                       const Scene &scene,
+                       Hit hits[simd::width]){
+            if (!useBVH) {
+                for (int lane = 0; lane < simd::width; lane++)
+                    if (packet.active & (1 << lane))
+                        intersect(packet.ray(lane), scene, hits[lane]);
+                return;
             }
+            scene.intersect(packet, hits);
+        }
 
-            return col;
+        // returns true if ray hits a triangle of vts at a distance of tMax or less, e.g. a shadow ray with the
+        // distance to the light. It stops at the first such triangle, which is not necessarily the closest one
+        bool occluded(const Ray & ray,
+                      const std::vector<vertex> &vts,
+                      float tMax){
+            return occluded(ray, sceneOf(vts), tMax);
+        }
+
+        // occluded for the instances of scene
+        bool occluded(const Ray & ray,
+                      const Scene &scene,
+                      float tMax){
+            if (useBVH)
+                return scene.occluded(ray, tMax);
+
+            for (int i = 0; i < scene.instanceCount(); i++)
+                if (rayModelOccluded(scene.toInstance(i, ray), scene.meshOf(i).geometry, tMax))
+                    return true;
+            return false;
+        }
+
+        // occluded for each ray of packet with the maximum distance in tMax of its lane, returns the mask of the
+        // occluded rays
+        int occluded(const ray_packet &packet,
+                     const Scene &scene,
+                     const float tMax[simd::width]){
+            if (!useBVH) {
+                int mask = 0;
+                for (int lane = 0; lane < simd::width; lane++)
+                    if (packet.active & (1 << lane) && occluded(packet.ray(lane), scene, tMax[lane]))
+                        mask |= 1 << lane;
+                return mask;
+            }
+            return scene.occluded(packet, tMax);
+        }
+
+        // build the bounding volume hierarchy of vts on the threads of render, in a scene with an indexed copy of vts as
+        // its only mesh
+        void build(const std::vector<vertex> &vts){
+            resetAccumulation();
+            m_vtsScene.clear();
+            m_vtsScene.buildThreads = threads;
+            m_vtsScene.bvhCacheDirectory = bvhCacheDirectory;
+            m_vtsScene.instances.push_back(instance{m_vtsScene.addMesh(vts), glm::mat4(1.0f), material{}});
+            m_vtsScene.update();
+            m_vtsBuilt = true;
+            m_vtsCopy = vts;
+        }
+
+        // update the bounding volume hierarchy of vts after its vertices moved, much faster than build
+        // (the model matrix of render does not move the vertices, the rays are transformed to model space instead).
+        // The vertices that were equal at the build share a vertex of the indexed copy, if some of them moved apart
+        // (or the number of vertices changed) the copy can not follow them and vts is built again instead
+        void refit(const std::vector<vertex> &vts){
+            resetAccumulation();
+            if (!m_vtsBuilt || !m_vtsScene.refitMesh(0, vts))
+                build(vts);
+            else {
+                m_vtsScene.update();
+                m_vtsCopy = vts;
+            }
         }
 
         // returns false if no intersection
         // intersection results are returned in the "hit" reference variable
         static bool rayModelIntersection(const Ray & ray,
-                                         const std::vector<vertex> &vts,
+                                         const indexed_mesh &mesh,
                                          Hit &hit){
-            for (int i = 0; i < vts.size(); i+=3)
+            for (uint32_t i = 0; i < mesh.indices.size(); i+=3)
             {
                 float dist_temp;
                 vec3 barycentric_temp;
                 // notice that we use the hit.dist to ensure that when new intersections happen, these are closer to the
                 // projection convergence point (camera position in our case) than the previously stored hit.
-                if (rayTriangleIntersection(ray, vts[i], vts[i+1], vts[i+2], dist_temp, barycentric_temp) && dist_temp < hit.dist)
+                if (rayTriangleIntersection(ray, mesh.positionOf(i), mesh.positionOf(i+1), mesh.positionOf(i+2), dist_temp, barycentric_temp) && dist_temp < hit.dist)
                 {
                     hit.hit_ID = i;
                     hit.dist = dist_temp;
@@ -137,6 +445,20 @@ namespace rt{
             return hit.hit_ID < 0 ? false : true;
         }
 
+        // like occluded, testing every triangle
+        static bool rayModelOccluded(const Ray & ray,
+                                     const indexed_mesh &mesh,
+                                     float tMax){
+            for (uint32_t i = 0; i < mesh.indices.size(); i+=3)
+            {
+                float dist_temp;
+                vec3 barycentric_temp;
+                if (rayTriangleIntersection(ray, mesh.positionOf(i), mesh.positionOf(i+1), mesh.positionOf(i+2), dist_temp, barycentric_temp) && dist_temp <= tMax)
+                    return true;
+            }
+            return false;
+        }
+
         // returns false if no intersection
         static bool rayTriangleIntersection(const Ray & ray,
                                             const vertex & p1,
@@ -144,8 +466,18 @@ namespace rt{
                                             const vertex & p3,
                                             float & t, vec3 & barycentric)
         {
-            vec3 e1 = p2.pos - p1.pos;
-            vec3 e2 = p3.pos - p1.pos;
+            return rayTriangleIntersection(ray, vec3(p1.pos), vec3(p2.pos), vec3(p3.pos), t, barycentric);
+        }
+
+        // rayTriangleIntersection with the positions of the vertices of the triangle
+        static bool rayTriangleIntersection(const Ray & ray,
+                                            const vec3 & p1,
+                                            const vec3 & p2,
+                                            const vec3 & p3,
+                                            float & t, vec3 & barycentric)
+        {
+            vec3 e1 = p2 - p1;
+            vec3 e2 = p3 - p1;
             vec3 q = cross(ray.direction, e2);
             float a = dot(e1, q);
 
@@ -154,7 +486,7 @@ namespace rt{
             if (abs(a) < tolerance) return false;
 
             float f = 1.0f / a;
-            vec3 s = ray.origin - vec3(p1.pos);
+            vec3 s = ray.origin - p1;
             float u = f * dot(s, q);
 
             // if u < 0, intersection with plane is not within the triangle
@@ -175,6 +507,508 @@ namespace rt{
 
             return true;
         }
+
+    private:
+        // render, with the surfaces of a G-buffer instead of the camera rays if surfaces is not null
+        void renderFrame(Scene &scene,
+                         const glm::mat4 &m,
+                         const glm::mat4 &v,
+                         const float fov_degrees,
+                         unsigned int depth,
+                         FrameBuffer <uint32_t> &fb,
+                         const gbuffer *surfaces) {
+
+            float aspect_ratio = float(fb.W) / float(fb.H);
+            // we use the fov and the tangent function to compute where is the bottom of the projection plane,
+            // we assume that the projection place is 1 unit in front of the camera (z == -1)
+            float bottom = - tan(abs(radians(fov_degrees)) * 0.5f);
+
+            // find the transformation that move points from camera space to model space
+            mat4 view_to_model = inverse(v * m);
+            // the bottom left corner of the image plane/camera sensor
+            vec4 lower_left_corner = vec4(bottom * aspect_ratio, bottom, -1, 1);
+            // we transform the camera position (also the convergence point of light rays) from camera coordinates to MODEL coordinates
+            // notice that we implicitly assume that the camera position is at 0,0,0 in its one coordinate space
+            vec4 cam_pos = view_to_model * vec4(0,0,0,1);
+
+            // the distance from the center of one pixel to the next along the horizontal and vertical axes of the screen
+            // notice that * and / are applied component wise
+            vec2 pixel_size = abs(vec2(lower_left_corner)) * 2.0f / vec2(fb.W, fb.H);
+
+
+            // TODO ex 10.1 iterate through all pixels in the buffer (width: [0, fb.W), height:[0, fb.H])
+            //  for each pixel,
+            //  - find its position in the space of the camera,
+            //  - apply the view_to_model transformation so that we place the pixel in the space of the model
+            //  (do you notice a different pattern? contrary to the typical raster pipeline, it is sometimes cheaper to
+            //  transform from camera space than the other way around -fewer computations-, what is important is that
+            //  all intersection computations should happen in the same space, no matter what that space is)
+            //  - create a ray with the camera origin, and the vector from the camera origin to the pixel you have just found
+            //  - call the TraceRay method using that ray, and store the resulting color in the frame buffer (fb)
+            //
+            //  the pixels are traced in tiles of tileSize x tileSize pixels, which are distributed over the threads.
+            //  every pixel only depends on its own ray, so the image is the same for any number of threads
+            scene.update(); // before the threads start, they only read it
+            // the pixels of a G-buffer have a single sample
+            bool accumulating = progressive && !surfaces;
+            bool filtering = !accumulating && (denoise || reflectionStep > 1) && std::min(depth, max_recursion) > 1;
+            if (accumulating)
+                beginAccumulation(scene, m, v, fov_degrees, depth, fb);
+            if (filtering) {
+                denoiser.resize(fb.W, fb.H);
+                m_directColors.resize(size_t(fb.W) * fb.H);
+            }
+            m_tilesW = (int(fb.W) + tileSize - 1) / tileSize;
+            m_tilesH = (int(fb.H) + tileSize - 1) / tileSize;
+            int tileCount = m_tilesW * m_tilesH;
+            tileMilliseconds.assign(tileCount, 0.0f);
+            m_tileRays.assign(tileCount, 0);
+
+            m_tileWork.resize(std::max(threads, 1u));
+
+            m_pool.run(tileCount, threads, [&](int tile, unsigned int thread) {
+                auto start = std::chrono::steady_clock::now();
+                int c0 = (tile % m_tilesW) * tileSize, r0 = (tile / m_tilesW) * tileSize;
+                int c1 = std::min(c0 + tileSize, int(fb.W)), r1 = std::min(r0 + tileSize, int(fb.H));
+                unsigned long long rays = 0;
+
+                // the camera rays of the tile, in the order of packets of packetW x packetH neighbor pixels, which
+                // cross mostly the same nodes of the hierarchy
+                tile_work &work = m_tileWork[thread];
+                work.pixels.clear();
+                work.rays.clear();
+                work.splitReflections = filtering;
+                work.reflectionStep = std::max(reflectionStep, 1);
+                work.W = int(fb.W);
+                for (int pr = r0; pr < r1; pr += packetH){
+                    for (int pc = c0; pc < c1; pc += packetW){
+                        for (int lane = 0; lane < simd::width; lane++){
+                            int c = pc + lane % packetW, r = pr + lane / packetW;
+                            if (c >= c1 || r >= r1) continue; // the packets at the border of the image are not full
+                            int pixel = c + r * int(fb.W);
+                            if (accumulating && !needsSample(pixel)) continue;
+                            // without progressive mode, all rays go through the same corner of their pixel
+                            vec2 offset = accumulating ? jitter(pixel, m_sampleCounts[pixel]) : vec2(0.0f);
+                            vec4 pixel_pos = lower_left_corner + vec4 ((vec2(c, r) + offset) * pixel_size,0, 0);
+                            pixel_pos = view_to_model * pixel_pos;  // transform from camera coord space to model coord space
+                            work.rays.push_back(queued_ray{Ray(cam_pos, normalize(pixel_pos - cam_pos)), int(work.pixels.size())});
+                            work.pixels.push_back(pixel);
+                        }
+                    }
+                }
+
+                if (surfaces)
+                    resolveSurfaces(work, scene, *surfaces, rays);
+
+                // trace the rays / compute the colors
+                if (wavefront)
+                    traceWavefront(work, depth, scene, surfaces, rays);
+                else
+                    traceDepthFirst(work, depth, scene, surfaces, rays);
+
+                for (size_t i = 0; i < work.pixels.size(); i++){
+                    int pixel = work.pixels[i];
+                    if (accumulating)
+                        accumulate(pixel, work.colors[i]);
+                    else if (filtering) {
+                        m_directColors[pixel] = work.colors[i];
+                        denoiser.set(pixel % fb.W, pixel / fb.W, vec3(work.reflected[i]),
+                                     work.reflects(pixel) && work.depths[i] > 0, work.normals[i], work.depths[i]);
+                    }
+                    else
+                        fb.paintAt(pixel % fb.W, pixel / fb.W, toRGBA32(work.colors[i])); // set the color on the frame buffer
+                }
+                if (accumulating) {
+                    for (int r = r0; r < r1; r++)
+                        for (int c = c0; c < c1; c++)
+                            fb.paintAt(c, r, toRGBA32(average(c + r * int(fb.W))));
+                }
+                m_tileRays[tile] = rays;
+                tileMilliseconds[tile] = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+            });
+
+            // the direct color of each pixel plus its filtered reflected color
+            if (filtering) {
+                denoiser.filter(m_pool, threads);
+                m_pool.run(int(fb.H), threads, [&](int r, unsigned int) {
+                    for (int c = 0; c < int(fb.W); c++)
+                        fb.paintAt(c, r, toRGBA32(m_directColors[c + r * fb.W] + vec4(denoiser.valueAt(c, r), 0.0f)));
+                });
+            }
+
+            for (auto rays : m_tileRays)
+                rayCount += rays;
+            if (accumulating)
+                m_accumulatedFrames++;
+        }
+
+        // a ray waiting in a queue of traceWavefront, for the sample of index sample in the tile
+        struct queued_ray {
+            Ray ray;
+            int sample;
+        };
+
+        // a shadow ray waiting in a queue of traceWavefront, direct is the light it adds to the color of the
+        // sample at its level if it is not occluded
+        struct queued_shadow_ray {
+            Ray ray;
+            int sample;
+            float lightDist;
+            color direct;
+        };
+
+        // the rays of a tile, and their colors. Each thread has its own, which keeps the memory it allocated from one
+        // tile to the next. Its size depends on the number of pixels of a tile and on max_recursion, not on the size
+        // of the image
+        struct tile_work {
+            // the pixel of each sample, and the camera ray of each sample (in the order of the samples)
+            std::vector<int> pixels;
+            std::vector<queued_ray> rays;
+            // the resulting color of each sample
+            std::vector<color> colors;
+            // in the low sample count mode: colors is only the color of the camera hits without their reflection, which
+            // is in reflected (for the pixels that trace it), and the normal and the distance of the camera hits (0 if
+            // none) guide the denoiser
+            bool splitReflections = false;
+            int reflectionStep = 1, W = 0;
+            std::vector<color> reflected;
+            std::vector<vec3> normals;
+            std::vector<float> depths;
+
+            // the reflected ray of the camera hit of pixel is traced
+            bool reflects(int pixel) const {
+                return !splitReflections || (pixel % W % reflectionStep == 0 && pixel / W % reflectionStep == 0);
+            }
+
+            // no camera hit and no reflection for all the samples, until they are found
+            void startSplit() {
+                reflected.assign(rays.size(), color(0.0f));
+                normals.assign(rays.size(), vec3(0.0f));
+                depths.assign(rays.size(), 0.0f);
+            }
+
+            // the queues of traceWavefront
+            std::vector<queued_ray> nextRays, sortedRays;
+            std::vector<queued_shadow_ray> shadowRays, sortedShadowRays;
+            std::vector<Hit> hits;
+            // the color of each sample at each level of reflection (without the reflected color) and the reflectivity
+            // of its surface, level by level, and the number of levels each sample reached
+            std::vector<color> levelColors;
+            std::vector<float> levelReflectivity;
+            std::vector<int> levels;
+        };
+
+        // the hits of the camera rays of work, in work.hits: the surfaces of their pixels in surfaces are not
+        // intersected again, their hit only has their distance and instance (hit_ID is 0, the triangle is not
+        // known), which is enough for surfaceAt(surfaces, ...) and for the depth that guides the denoiser. The rays
+        // of the pixels without a surface are traced instead
+        void resolveSurfaces(tile_work &work, const Scene &scene, const gbuffer &surfaces,
+                             unsigned long long &rays){
+            work.hits.assign(work.rays.size(), Hit());
+            for (size_t i = 0; i < work.rays.size(); i++){
+                int pixel = work.pixels[i];
+                Hit &hit = work.hits[i];
+                if (surfaces.instance[pixel] != 0) {
+                    hit.hit_ID = 0;
+                    hit.instance = int(surfaces.instance[pixel]) - 1;
+                    hit.dist = surfaces.dist[pixel];
+                    continue;
+                }
+                rays++;
+                intersect(work.rays[i].ray, scene, hit);
+            }
+        }
+
+        // the shading of the camera hit of pixel found by resolveSurfaces, from surfaces if it has the surface of
+        // the pixel, else from the triangle that was hit
+        surface_point surfaceAt(const Ray &ray, const Hit &hitInfo, const gbuffer &surfaces, int pixel,
+                                const Scene &scene) const {
+            if (surfaces.instance[pixel] == 0)
+                return surfaceAt(ray, hitInfo, scene);
+            return surfaceAt(ray.origin + ray.direction * hitInfo.dist, surfaces.normal[pixel], surfaces.col[pixel],
+                             scene.materialOf(hitInfo.instance));
+        }
+
+        // the colors of the samples of work, each camera ray is traced depth first with traceRay (in packets of
+        // simd::width rays for the closest hits of the camera rays). With surfaces, the camera rays start from the
+        // surfaces of their pixels instead (resolveSurfaces). When work splits the reflections, the reflected ray of each
+        // camera hit is traced apart, and only for the pixels that trace it
+        void traceDepthFirst(tile_work &work, unsigned int depth, const Scene &scene, const gbuffer *surfaces,
+                             unsigned long long &rays){
+            size_t count = work.rays.size();
+            work.colors.resize(count);
+            // with surfaces, resolveSurfaces found the hits
+            if (!surfaces) {
+                work.hits.assign(count, Hit());
+                for (size_t first = 0; first < count; first += simd::width){
+                    ray_packet packet;
+                    for (int lane = 0; lane < simd::width && first + lane < count; lane++)
+                        packet.set(lane, work.rays[first + lane].ray);
+                    intersect(packet, scene, &work.hits[first]);
+                }
+                rays += count;
+            }
+            if (work.splitReflections)
+                work.startSplit();
+
+            for (size_t i = 0; i < count; i++){
+                const Ray &ray = work.rays[i].ray;
+                if (work.hits[i].hit_ID < 0) {
+                    work.colors[i] = black;
+                    continue;
+                }
+                surface_point surface = surfaces ? surfaceAt(ray, work.hits[i], *surfaces, work.pixels[i], scene)
+                                                 : surfaceAt(ray, work.hits[i], scene);
+                if (!work.splitReflections) {
+                    work.colors[i] = shade(ray, surface, depth, scene, rays);
+                    continue;
+                }
+                // the camera hit without its reflection, which is traced apart for the pixels that trace it
+                work.colors[i] = shade(ray, surface, 1, scene, rays);
+                work.normals[i] = surface.normal;
+                work.depths[i] = work.hits[i].dist;
+                if (work.reflects(work.pixels[i])) {
+                    unsigned int reflectionDepth = std::min(depth, max_recursion) - 1;
+                    work.reflected[i] = surface.reflectivity * traceRay(reflectedRay(ray, surface), reflectionDepth,
+                                                                        scene, rays);
+                }
+            }
+        }
+
+        // WAVEFRONT
+        // ---------
+        // the colors of the samples of work, the same as traceDepthFirst, traced breadth first: the camera rays of
+        // the tile are intersected together, the shadow rays and the reflected rays of their hits are collected in
+        // queues, then all the shadow rays are traced, then all the reflected rays, which add their shadow and
+        // reflected rays to new queues, and so on until the last level of reflection. Each queue is traced in packets
+        // of simd::width rays, and the queues of reflected and shadow rays are sorted by the octant of the direction of
+        // the rays first, so that the rays of a packet go in similar directions and cross similar nodes.
+        // The color of each level is kept apart, and combined at the end in the same order as the recursion of
+        // shade, so that the result is exactly the same. With surfaces, the hits of the camera rays are the ones
+        // found by resolveSurfaces. When work splits the reflections, the color of the first level and the reflected
+        // color of the next ones are kept apart
+        void traceWavefront(tile_work &work, unsigned int depth, const Scene &scene, const gbuffer *surfaces,
+                            unsigned long long &rays){
+            int count = int(work.rays.size());
+            int levelCount = int(std::max(1u, std::min(depth, max_recursion)));
+            work.levelColors.resize(size_t(count) * levelCount);
+            work.levelReflectivity.resize(size_t(count) * levelCount);
+            work.levels.assign(count, 0);
+            work.colors.resize(count);
+            if (work.splitReflections)
+                work.startSplit();
+
+            for (int level = 0; level < levelCount && !work.rays.empty(); level++){
+                // the camera rays are already in packets of neighbor pixels
+                if (level > 0)
+                    sortByOctant(work.rays, work.sortedRays);
+                // with surfaces, resolveSurfaces already found the hits of the camera rays, and counted the ones it
+                // traced
+                bool resolved = level == 0 && surfaces;
+                if (!resolved) {
+                    work.hits.assign(work.rays.size(), Hit());
+                    for (size_t first = 0; first < work.rays.size(); first += simd::width){
+                        ray_packet packet;
+                        for (int lane = 0; lane < simd::width && first + lane < work.rays.size(); lane++)
+                            packet.set(lane, work.rays[first + lane].ray);
+                        intersect(packet, scene, &work.hits[first]);
+                    }
+                }
+
+                work.nextRays.clear();
+                work.shadowRays.clear();
+                color *levelColors = &work.levelColors[size_t(level) * count];
+                for (size_t i = 0; i < work.rays.size(); i++){
+                    if (!resolved)
+                        rays++;
+                    const queued_ray &queued = work.rays[i];
+                    work.levels[queued.sample] = level + 1;
+                    if (work.hits[i].hit_ID < 0) {
+                        levelColors[queued.sample] = black;
+                        continue;
+                    }
+                    surface_point surface = resolved ? surfaceAt(queued.ray, work.hits[i], *surfaces,
+                                                                 work.pixels[queued.sample], scene)
+                                                     : surfaceAt(queued.ray, work.hits[i], scene);
+                    levelColors[queued.sample] = surface.ambient;
+                    work.levelReflectivity[size_t(level) * count + queued.sample] = surface.reflectivity;
+                    work.shadowRays.push_back(queued_shadow_ray{shadowRay(surface), queued.sample, surface.lightDist, surface.direct});
+                    if (level == 0 && work.splitReflections) {
+                        work.normals[queued.sample] = surface.normal;
+                        work.depths[queued.sample] = work.hits[i].dist;
+                        if (!work.reflects(work.pixels[queued.sample]))
+                            continue;
+                    }
+                    if (level + 1 < levelCount)
+                        work.nextRays.push_back(queued_ray{reflectedRay(queued.ray, surface), queued.sample});
+                }
+
+                sortByOctant(work.shadowRays, work.sortedShadowRays);
+                for (size_t first = 0; first < work.shadowRays.size(); first += simd::width){
+                    ray_packet packet;
+                    alignas(32) float tMax[simd::width] = {};
+                    for (int lane = 0; lane < simd::width && first + lane < work.shadowRays.size(); lane++){
+                        packet.set(lane, work.shadowRays[first + lane].ray);
+                        tMax[lane] = work.shadowRays[first + lane].lightDist;
+                    }
+                    int occludedMask = occluded(packet, scene, tMax);
+                    for (int lane = 0; lane < simd::width && first + lane < work.shadowRays.size(); lane++){
+                        rays++;
+                        const queued_shadow_ray &shadow = work.shadowRays[first + lane];
+                        if (!(occludedMask & (1 << lane)))
+                            levelColors[shadow.sample] += shadow.direct;
+                    }
+                }
+
+                work.rays.swap(work.nextRays);
+            }
+
+            // the color of a level plus its reflectivity times the color of the next level, from the deepest level up
+            for (int sample = 0; sample < count; sample++){
+                int level = work.levels[sample] - 1;
+                color col = work.levelColors[size_t(level) * count + sample];
+                while (level-- > 0) {
+                    // the color of the first level is kept apart from its reflection
+                    if (level == 0 && work.splitReflections) {
+                        work.reflected[sample] = work.levelReflectivity[sample] * col;
+                        col = work.levelColors[sample];
+                        break;
+                    }
+                    col = work.levelColors[size_t(level) * count + sample] +
+                          work.levelReflectivity[size_t(level) * count + sample] * col;
+                }
+                work.colors[sample] = col;
+            }
+        }
+
+        // sort the rays of queue by the octant of their direction (the signs of x, y and z), keeping their order
+        // within an octant. sorted is the memory for the sort, it is swapped with queue
+        template<class QueuedRay>
+        static void sortByOctant(std::vector<QueuedRay> &queue, std::vector<QueuedRay> &sorted){
+            auto octant = [](const Ray &ray) {
+                return int(ray.direction.x < 0) | int(ray.direction.y < 0) << 1 | int(ray.direction.z < 0) << 2;
+            };
+            if (queue.empty())
+                return;
+            size_t offsets[9] = {};
+            for (const QueuedRay &queued : queue)
+                offsets[octant(queued.ray) + 1]++;
+            for (int i = 1; i < 9; i++)
+                offsets[i] += offsets[i - 1];
+            sorted.assign(queue.size(), queue[0]);
+            for (const QueuedRay &queued : queue)
+                sorted[offsets[octant(queued.ray)]++] = queued;
+            queue.swap(sorted);
+        }
+
+        // the parameters of render that the accumulated samples were traced with
+        struct accumulation_key {
+            const Scene *scene;
+            unsigned long long sceneVersion;
+            mat4 m, v;
+            float fov;
+            unsigned int depth, W, H;
+
+            bool operator==(const accumulation_key &other) const {
+                return scene == other.scene && sceneVersion == other.sceneVersion && m == other.m &&
+                       v == other.v && fov == other.fov && depth == other.depth && W == other.W && H == other.H;
+            }
+        };
+
+        // start the accumulation again if the parameters of render changed since the last frame
+        void beginAccumulation(const Scene &scene, const mat4 &m, const mat4 &v, float fov,
+                               unsigned int depth, const FrameBuffer<uint32_t> &fb){
+            accumulation_key key{&scene, scene.version(), m, v, fov, depth, fb.W, fb.H};
+            if (m_accumulationValid && key == m_accumulationKey)
+                return;
+            m_accumulationKey = key;
+            m_accumulationValid = true;
+            m_accumulatedFrames = 0;
+            size_t pixels = size_t(fb.W) * fb.H;
+            m_sampleSums.assign(pixels, vec3(0.0f));
+            m_luminanceSquares.assign(pixels, 0.0f);
+            m_sampleCounts.assign(pixels, 0);
+        }
+
+        static float luminance(const vec3 &col) { return dot(col, vec3(0.2126f, 0.7152f, 0.0722f)); }
+
+        // false if the pixel has all its samples, or if adaptive sampling finds its average good enough
+        bool needsSample(int pixel) const {
+            unsigned int n = m_sampleCounts[pixel];
+            if (n >= maxSamples)
+                return false;
+            if (adaptiveTolerance <= 0 || n < std::max(minAdaptiveSamples, 2u))
+                return true;
+            float mean = luminance(m_sampleSums[pixel]) / float(n);
+            float variance = std::max(m_luminanceSquares[pixel] / float(n) - mean * mean, 0.0f) * float(n) / float(n - 1);
+            return variance / float(n) >= adaptiveTolerance * adaptiveTolerance;
+        }
+
+        // the offset in pixels of sample number sample of pixel from the corner of the pixel, in [-.5, .5).
+        // The first sample is at the corner, like without progressive mode, and the next ones follow the R2 low
+        // discrepancy sequence, which covers the pixel evenly. The sequence is shifted by a different random amount in
+        // each pixel, so that neighbor pixels do not show the same pattern while they converge
+        static vec2 jitter(int pixel, unsigned int sample){
+            if (sample == 0)
+                return vec2(0.0f);
+            uint32_t hash = uint32_t(pixel) * 0x9e3779b9u;
+            hash = (hash ^ (hash >> 16)) * 0x85ebca6bu;
+            hash = (hash ^ (hash >> 13)) * 0xc2b2ae35u;
+            hash ^= hash >> 16;
+            vec2 shift(float(hash & 0xffffu) / 65536.0f, float(hash >> 16) / 65536.0f);
+            return fract(vec2(0.7548776662f, 0.5698402910f) * float(sample) + shift) - .5f;
+        }
+
+        // add a sample to pixel, clamped like the colors of fb so that a single very bright sample does not keep the
+        // pixel bright for many frames
+        void accumulate(int pixel, const color &col){
+            vec3 sample = clamp(vec3(col), 0.0f, 1.0f);
+            m_sampleSums[pixel] += sample;
+            float l = luminance(sample);
+            m_luminanceSquares[pixel] += l * l;
+            m_sampleCounts[pixel]++;
+        }
+
+        color average(int pixel) const {
+            unsigned int n = m_sampleCounts[pixel];
+            return n ? color(m_sampleSums[pixel] / float(n), 1.0f) : black;
+        }
+
+        ThreadPool m_pool;
+        std::vector<tile_work> m_tileWork;
+        // in the low sample count mode, the color of each pixel without its reflection (see reflectionStep)
+        std::vector<color> m_directColors;
+        // the size of the last frame in tiles, and the rays traced in each tile
+        int m_tilesW = 0, m_tilesH = 0;
+        std::vector<unsigned long long> m_tileRays;
+
+        // the scene of the vertex list of the last build or refit, traced by the functions that take a vertex list, and
+        // a copy of that vertex list
+        Scene m_vtsScene;
+        bool m_vtsBuilt = false;
+        std::vector<vertex> m_vtsCopy;
+
+        // the scene of vts, up to date. The vertices are compared to the copy of the last build or refit rather than
+        // guessed from their address or their number, since a vector can be edited in place: a list with the same
+        // number of vertices is refitted (which builds it again if the vertices that shared an indexed vertex moved
+        // apart), another number is built. A vertex is a few floats, comparing their bytes is exact and costs about
+        // as much as reading the list once
+        Scene &sceneOf(const std::vector<vertex> &vts){
+            if (!m_vtsBuilt || m_vtsCopy.size() != vts.size())
+                build(vts);
+            else if (!vts.empty() && std::memcmp(vts.data(), m_vtsCopy.data(), vts.size() * sizeof(vertex)) != 0)
+                refit(vts);
+            return m_vtsScene;
+        }
+
+        // the samples of progressive mode: per pixel, the sum of their colors, the sum of their squared luminance
+        // (for the variance of adaptive sampling) and their number
+        accumulation_key m_accumulationKey = {};
+        bool m_accumulationValid = false;
+        unsigned int m_accumulatedFrames = 0;
+        std::vector<vec3> m_sampleSums;
+        std::vector<float> m_luminanceSquares;
+        std::vector<unsigned int> m_sampleCounts;
     };
 }
 
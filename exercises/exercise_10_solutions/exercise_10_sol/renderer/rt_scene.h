@@ -0,0 +1,331 @@
+//
+// Scene of the ray tracer: instances of meshes, each with its own transform and material.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_RT_SCENE_H
+#define ITU_GRAPHICS_PROGRAMMING_RT_SCENE_H
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+#include <cfloat>
+#include <cmath>
+#include <glm/glm.hpp>
+#include "rt_types.h"
+#include "rt_simd.h"
+#include "rt_mesh.h"
+#include "rt_bvh.h"
+#include "rt_bvh_cache.h"
+
+namespace rt {
+
+    // how the surface of an instance reflects the light, the default values are the ones of exercise 10
+    struct material {
+        // multiplies the colors of the vertices
+        Colors::color tint = Colors::white;
+        // the phong reflection model
+        float ambient = 0.1f, diffuse = 0.5f, specular = 0.5f, shininess = 10.0f;
+        // mixture parameter for combining local illumination and reflected color
+        float reflectivity = 0.4f;
+
+        bool operator==(const material &other) const {
+            return tint == other.tint && ambient == other.ambient && diffuse == other.diffuse &&
+                   specular == other.specular && shininess == other.shininess && reflectivity == other.reflectivity;
+        }
+    };
+
+    // the triangles of a mesh and their bounding volume hierarchy
+    struct mesh {
+        indexed_mesh geometry;
+        BVH bvh;
+    };
+
+    // a copy of a mesh of the scene, placed with transform (from the space of the mesh to the space of the scene)
+    struct instance {
+        int mesh;
+        glm::mat4 transform = glm::mat4(1.0f);
+        material surface;
+
+        bool operator==(const instance &other) const {
+            return mesh == other.mesh && transform == other.transform && surface == other.surface;
+        }
+    };
+
+    // TWO LEVEL SCENE
+    // ---------------
+    // every mesh is stored once, with its own bounding volume hierarchy (the bottom level) that is built when the
+    // mesh is added, and is placed in the scene any number of times by instances. A second hierarchy over the boxes of
+    // the instances (the top level) is rebuilt by update when the instances change, which takes well under a
+    // millisecond for hundreds of instances. A ray that reaches an instance is moved to the space of its mesh and
+    // traced through the bottom level there, so animating instances never rebuilds or copies triangles.
+    //
+    // The rays moved to the space of a mesh keep a direction that is not normalized, so that the distances along
+    // them are the same as in the scene, and hits in different instances can be compared
+    class Scene {
+    public:
+        // the instances of the scene, they are traced as they were at the last call of update
+        std::vector<instance> instances;
+        // number of threads that build the hierarchies of the meshes added by addMesh
+        unsigned int buildThreads = std::max(1u, std::thread::hardware_concurrency());
+        // directory where addMesh saves the hierarchies of the meshes and loads them from the next time the same
+        // mesh is added (see BVHCache), empty to always build them
+        std::string bvhCacheDirectory;
+
+        Scene() { m_topLevel.maxLeafSize = 2; }
+
+        // add a mesh to the scene and build its hierarchy (or load it from bvhCacheDirectory), returns the index of
+        // the mesh for instance::mesh. See rt_mesh.h for the import of the models of the other exercises
+        int addMesh(indexed_mesh geometry) {
+            m_meshes.emplace_back();
+            mesh &added = m_meshes.back();
+            added.geometry = std::move(geometry);
+            if (bvhCacheDirectory.empty())
+                added.bvh.build(added.geometry, buildThreads);
+            else
+                BVHCache(bvhCacheDirectory).buildOrLoad(added.bvh, added.geometry, buildThreads);
+            m_changed = true;
+            return int(m_meshes.size()) - 1;
+        }
+
+        // addMesh with the triangles of a vertex list (every 3 vertices form a triangle), the equal vertices are
+        // stored once
+        int addMesh(const std::vector<vertex> &vertices) {
+            return addMesh(meshFromVertices(vertices));
+        }
+
+        // move the vertices of mesh to positions (one per vertex of its geometry) and refit its hierarchy
+        // (BVH::refit)
+        void refitMesh(int mesh, const std::vector<glm::vec3> &positions) {
+            m_meshes[mesh].geometry.positions = positions;
+            m_meshes[mesh].bvh.refit(m_meshes[mesh].geometry);
+            m_changed = true;
+        }
+
+        // refitMesh for a mesh added as a vertex list, with the vertex list after the vertices moved. The vertices
+        // that were equal when the mesh was added are stored once, so the mesh can only follow vertices that are still
+        // equal to the ones they were stored with: returns false, and leaves the mesh as it was, if they are not, or
+        // if the number of vertices changed (add the vertex list as a new mesh then)
+        bool refitMesh(int mesh, const std::vector<vertex> &vertices) {
+            indexed_mesh &geometry = m_meshes[mesh].geometry;
+            if (vertices.size() != geometry.indices.size())
+                return false;
+            // the first corner of each vertex of the mesh, the other corners of the vertex must be equal to it
+            std::vector<uint32_t> firstCorners(geometry.positions.size(), UINT32_MAX);
+            for (uint32_t corner = 0; corner < uint32_t(vertices.size()); corner++) {
+                uint32_t &first = firstCorners[geometry.indices[corner]];
+                if (first == UINT32_MAX)
+                    first = corner;
+                else if (!MeshBuilder::sameVertex(vertices[first], vertices[corner]))
+                    return false;
+            }
+            for (size_t corner = 0; corner < geometry.indices.size(); corner++) {
+                uint32_t index = geometry.indices[corner];
+                geometry.positions[index] = glm::vec3(vertices[corner].pos);
+                geometry.shading[index] = shading_vertex{glm::vec3(vertices[corner].norm), vertices[corner].col,
+                                                         vertices[corner].uv};
+            }
+            m_meshes[mesh].bvh.refit(geometry);
+            m_changed = true;
+            return true;
+        }
+
+        // remove all the meshes and instances
+        void clear() {
+            m_meshes.clear();
+            instances.clear();
+            m_changed = true;
+        }
+
+        int meshCount() const { return int(m_meshes.size()); }
+
+        const mesh &meshAt(int mesh) const { return m_meshes[mesh]; }
+
+        // take the changes of instances and the meshes, rebuilding the top level if needed. Call before tracing
+        // rays, Renderer::render calls it for the scene it renders
+        void update() {
+            if (!m_changed && instances == m_current)
+                return;
+            m_changed = false;
+            m_current = instances;
+            m_version++;
+
+            int count = int(m_current.size());
+            m_transforms.resize(count);
+            m_bounds.resize(count);
+            for (int i = 0; i < count; i++) {
+                const glm::mat4 &transform = m_current[i].transform;
+                m_transforms[i].toInstance = glm::inverse(transform);
+                m_transforms[i].identity = transform == glm::mat4(1.0f);
+                // normals are transformed by the inverse transpose, which keeps them perpendicular to the surface
+                // when the transform has a non uniform scale
+                m_transforms[i].normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+                m_bounds[i] = instanceBox(m_meshes[m_current[i].mesh].bvh, transform);
+            }
+            m_topLevel.build(m_bounds, m_order);
+        }
+
+        // a number that changes every time update takes a change of the scene
+        unsigned long long version() const { return m_version; }
+
+        int instanceCount() const { return int(m_current.size()); }
+
+        // the box of all the instances, in the space of the scene
+        bvh_box bounds() const {
+            bvh_box box = bvh_box::empty();
+            for (const bvh_box &instanceBounds : m_bounds)
+                box.grow(instanceBounds);
+            return box;
+        }
+
+        // the instance as it was at the last update
+        const instance &instanceAt(int instance) const { return m_current[instance]; }
+
+        const mesh &meshOf(int instance) const { return m_meshes[m_current[instance].mesh]; }
+
+        const material &materialOf(int instance) const { return m_current[instance].surface; }
+
+        // transforms the normals of the mesh of instance to the space of the scene
+        const glm::mat3 &normalMatrix(int instance) const { return m_transforms[instance].normalMatrix; }
+
+        // ray in the space of the mesh of instance
+        Ray toInstance(int instance, const Ray &ray) const {
+            if (m_transforms[instance].identity)
+                return ray;
+            const glm::mat4 &toInstance = m_transforms[instance].toInstance;
+            return Ray(glm::vec3(toInstance * glm::vec4(ray.origin, 1.0f)),
+                       glm::vec3(toInstance * glm::vec4(ray.direction, 0.0f)));
+        }
+
+        // closest intersection of ray with the instances, if it is closer than hit.dist. hit.instance is the
+        // instance that was hit, and hit.hit_ID the first corner of the triangle in its mesh
+        bool intersect(const Ray &ray, Hit &hit) const {
+            m_topLevel.traverse(ray, hit.dist, [&](const bvh_node &leaf) {
+                for (int i = leaf.secondOrFirst; i < leaf.secondOrFirst + leaf.count; i++) {
+                    int index = int(m_order[i]);
+                    int id = hit.hit_ID;
+                    float dist = hit.dist;
+                    meshOf(index).bvh.intersect(toInstance(index, ray), hit);
+                    if (hit.hit_ID != id || hit.dist != dist)
+                        hit.instance = index;
+                }
+                return false; // look for a closer hit
+            });
+            return hit.hit_ID >= 0;
+        }
+
+        // returns true if ray hits an instance at a distance of tMax or less, stopping at the first one found
+        bool occluded(const Ray &ray, float tMax) const {
+            // the nodes entered exactly at tMax can still have an occluder
+            float maxDist = std::nextafter(tMax, FLT_MAX);
+            return m_topLevel.traverse(ray, maxDist, [&](const bvh_node &leaf) {
+                for (int i = leaf.secondOrFirst; i < leaf.secondOrFirst + leaf.count; i++) {
+                    int index = int(m_order[i]);
+                    if (meshOf(index).bvh.occluded(toInstance(index, ray), tMax))
+                        return true;
+                }
+                return false;
+            });
+        }
+
+        // intersect for each ray of packet, the closest hit of the ray in lane i is stored in hits[i]. The rays that
+        // reach an instance go to the bottom level together
+        void intersect(const ray_packet &packet, Hit hits[simd::width]) const {
+            alignas(32) float maxDist[simd::width];
+            for (int lane = 0; lane < simd::width; lane++)
+                maxDist[lane] = packet.active & (1 << lane) ? hits[lane].dist : -1.0f;
+
+            m_topLevel.traverse(packet, maxDist, [&](const bvh_node &leaf, int mask) {
+                for (int i = leaf.secondOrFirst; i < leaf.secondOrFirst + leaf.count; i++) {
+                    int index = int(m_order[i]);
+                    ray_packet local;
+                    int ids[simd::width];
+                    for (int lane = 0; lane < simd::width; lane++)
+                        ids[lane] = hits[lane].hit_ID;
+                    meshOf(index).bvh.intersect(toInstance(index, packet, mask, local), hits);
+                    for (int lane = 0; lane < simd::width; lane++) {
+                        if ((mask & (1 << lane)) && (hits[lane].hit_ID != ids[lane] || hits[lane].dist != maxDist[lane])) {
+                            hits[lane].instance = index;
+                            maxDist[lane] = hits[lane].dist;
+                        }
+                    }
+                }
+                return false;
+            });
+        }
+
+        // occluded for each ray of packet, with the maximum distance in tMax of its lane. Returns the mask of the
+        // occluded rays
+        int occluded(const ray_packet &packet, const float tMax[simd::width]) const {
+            alignas(32) float maxDist[simd::width];
+            for (int lane = 0; lane < simd::width; lane++)
+                maxDist[lane] = packet.active & (1 << lane) ? std::nextafter(tMax[lane], FLT_MAX) : -1.0f;
+            int occludedMask = 0;
+
+            m_topLevel.traverse(packet, maxDist, [&](const bvh_node &leaf, int mask) {
+                for (int i = leaf.secondOrFirst; i < leaf.secondOrFirst + leaf.count && mask; i++) {
+                    int index = int(m_order[i]);
+                    ray_packet local;
+                    int occludedHere = meshOf(index).bvh.occluded(toInstance(index, packet, mask, local), tMax);
+                    for (int lane = 0; lane < simd::width; lane++)
+                        if (occludedHere & (1 << lane))
+                            maxDist[lane] = -1.0f;
+                    occludedMask |= occludedHere;
+                    mask &= ~occludedHere;
+                }
+                return occludedMask == packet.active;
+            });
+            return occludedMask;
+        }
+
+    private:
+        // the rays of packet in mask, in the space of the mesh of instance. Returns local, or packet itself if the
+        // instance is not moved and all its rays are in mask
+        const ray_packet &toInstance(int instance, const ray_packet &packet, int mask, ray_packet &local) const {
+            if (m_transforms[instance].identity && mask == packet.active)
+                return packet;
+            for (int lane = 0; lane < simd::width; lane++)
+                if (mask & (1 << lane))
+                    local.set(lane, toInstance(instance, packet.ray(lane)));
+            return local;
+        }
+
+        // the box of the 8 corners of the box of a mesh, moved to the scene with transform
+        static bvh_box instanceBox(const BVH &bvh, const glm::mat4 &transform) {
+            bvh_box bounds = bvh_box::empty();
+            if (bvh.empty())
+                return bounds;
+            const bvh_node &root = bvh.nodes()[0];
+            for (int corner = 0; corner < 8; corner++) {
+                glm::vec3 p(corner & 1 ? root.boundsMax.x : root.boundsMin.x,
+                            corner & 2 ? root.boundsMax.y : root.boundsMin.y,
+                            corner & 4 ? root.boundsMax.z : root.boundsMin.z);
+                p = glm::vec3(transform * glm::vec4(p, 1.0f));
+                bounds.grow(bvh_box{p, p});
+            }
+            return bounds;
+        }
+
+        struct instance_transforms {
+            glm::mat4 toInstance;
+            glm::mat3 normalMatrix;
+            // the transform is the identity, the rays do not need to be moved
+            bool identity;
+        };
+
+        std::vector<mesh> m_meshes;
+        // the instances as they were at the last update, and what update computed for them
+        std::vector<instance> m_current;
+        std::vector<instance_transforms> m_transforms;
+        std::vector<bvh_box> m_bounds;
+        // the top level, and the instances in the order of its leaves
+        BoxHierarchy m_topLevel;
+        std::vector<uint32_t> m_order;
+        bool m_changed = false;
+        unsigned long long m_version = 0;
+    };
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_RT_SCENE_H
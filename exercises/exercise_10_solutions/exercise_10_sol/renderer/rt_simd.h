@@ -0,0 +1,257 @@
+//
+// SIMD types and kernels of the ray tracer: one ray against a block of triangles, and a packet of rays against a box.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_RT_SIMD_H
+#define ITU_GRAPHICS_PROGRAMMING_RT_SIMD_H
+
+#include <cstdint>
+#include <cfloat>
+#include <cstring>
+#include <glm/glm.hpp>
+#include "rt_types.h"
+
+#if defined(__AVX__)
+#define RT_SIMD_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RT_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+// the kernels are called from the loops of the traversals, which are templates that the compiler might not inline
+// them into, and a call costs about as much as the kernel
+#if defined(_MSC_VER)
+#define RT_SIMD_INLINE __forceinline
+#elif defined(__GNUC__)
+#define RT_SIMD_INLINE inline __attribute__((always_inline))
+#else
+#define RT_SIMD_INLINE inline
+#endif
+
+namespace rt {
+    namespace simd {
+
+        // FLOAT LANES
+        // -----------
+        // width floats processed by the same instructions: 8 with AVX, 4 with SSE2, and 4 plain floats without SIMD
+        // (the compiler can still vectorize the loops). Comparisons return a mask with all bits set in the lanes
+        // where they are true, like the SSE and AVX instructions.
+        // load and store do not need aligned addresses: C++14 does not align the memory of a std::vector to more than
+        // 16 bytes, and on aligned addresses the unaligned instructions are as fast as the aligned ones
+#if defined(RT_SIMD_AVX)
+        struct vfloat {
+            static const int width = 8;
+            __m256 v;
+
+            static vfloat set1(float f) { return vfloat{_mm256_set1_ps(f)}; }
+            static vfloat load(const float *p) { return vfloat{_mm256_loadu_ps(p)}; }
+            void store(float *p) const { _mm256_storeu_ps(p, v); }
+            // bit i is set if lane i of the mask is true
+            int mask() const { return _mm256_movemask_ps(v); }
+
+            friend vfloat operator+(vfloat a, vfloat b) { return vfloat{_mm256_add_ps(a.v, b.v)}; }
+            friend vfloat operator-(vfloat a, vfloat b) { return vfloat{_mm256_sub_ps(a.v, b.v)}; }
+            friend vfloat operator*(vfloat a, vfloat b) { return vfloat{_mm256_mul_ps(a.v, b.v)}; }
+            friend vfloat operator/(vfloat a, vfloat b) { return vfloat{_mm256_div_ps(a.v, b.v)}; }
+            friend vfloat operator<(vfloat a, vfloat b) { return vfloat{_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+            friend vfloat operator<=(vfloat a, vfloat b) { return vfloat{_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)}; }
+            friend vfloat operator&(vfloat a, vfloat b) { return vfloat{_mm256_and_ps(a.v, b.v)}; }
+            friend vfloat operator|(vfloat a, vfloat b) { return vfloat{_mm256_or_ps(a.v, b.v)}; }
+            friend vfloat min(vfloat a, vfloat b) { return vfloat{_mm256_min_ps(a.v, b.v)}; }
+            friend vfloat max(vfloat a, vfloat b) { return vfloat{_mm256_max_ps(a.v, b.v)}; }
+            // b in the lanes where the mask a is false, 0 in the others
+            friend vfloat andNot(vfloat a, vfloat b) { return vfloat{_mm256_andnot_ps(a.v, b.v)}; }
+        };
+#elif defined(RT_SIMD_SSE2)
+        struct vfloat {
+            static const int width = 4;
+            __m128 v;
+
+            static vfloat set1(float f) { return vfloat{_mm_set1_ps(f)}; }
+            static vfloat load(const float *p) { return vfloat{_mm_loadu_ps(p)}; }
+            void store(float *p) const { _mm_storeu_ps(p, v); }
+            int mask() const { return _mm_movemask_ps(v); }
+
+            friend vfloat operator+(vfloat a, vfloat b) { return vfloat{_mm_add_ps(a.v, b.v)}; }
+            friend vfloat operator-(vfloat a, vfloat b) { return vfloat{_mm_sub_ps(a.v, b.v)}; }
+            friend vfloat operator*(vfloat a, vfloat b) { return vfloat{_mm_mul_ps(a.v, b.v)}; }
+            friend vfloat operator/(vfloat a, vfloat b) { return vfloat{_mm_div_ps(a.v, b.v)}; }
+            friend vfloat operator<(vfloat a, vfloat b) { return vfloat{_mm_cmplt_ps(a.v, b.v)}; }
+            friend vfloat operator<=(vfloat a, vfloat b) { return vfloat{_mm_cmple_ps(a.v, b.v)}; }
+            friend vfloat operator&(vfloat a, vfloat b) { return vfloat{_mm_and_ps(a.v, b.v)}; }
+            friend vfloat operator|(vfloat a, vfloat b) { return vfloat{_mm_or_ps(a.v, b.v)}; }
+            friend vfloat min(vfloat a, vfloat b) { return vfloat{_mm_min_ps(a.v, b.v)}; }
+            friend vfloat max(vfloat a, vfloat b) { return vfloat{_mm_max_ps(a.v, b.v)}; }
+            friend vfloat andNot(vfloat a, vfloat b) { return vfloat{_mm_andnot_ps(a.v, b.v)}; }
+        };
+#else
+        struct vfloat {
+            static const int width = 4;
+            float v[width];
+
+            static vfloat set1(float f) { return vfloat{{f, f, f, f}}; }
+            static vfloat load(const float *p) { return vfloat{{p[0], p[1], p[2], p[3]}}; }
+            void store(float *p) const { for (int i = 0; i < width; i++) p[i] = v[i]; }
+            int mask() const {
+                int bits = 0;
+                for (int i = 0; i < width; i++)
+                    bits |= (asBits(v[i]) >> 31) << i;
+                return bits;
+            }
+
+            template<class Op>
+            static vfloat apply(vfloat a, vfloat b, Op op) {
+                vfloat r;
+                for (int i = 0; i < width; i++)
+                    r.v[i] = op(a.v[i], b.v[i]);
+                return r;
+            }
+            static uint32_t asBits(float f) { uint32_t u; std::memcpy(&u, &f, 4); return u; }
+            static float fromBits(uint32_t u) { float f; std::memcpy(&f, &u, 4); return f; }
+            static float fromBool(bool b) { return fromBits(b ? 0xffffffffu : 0u); }
+
+            friend vfloat operator+(vfloat a, vfloat b) { return apply(a, b, [](float x, float y) { return x + y; }); }
+            friend vfloat operator-(vfloat a, vfloat b) { return apply(a, b, [](float x, float y) { return x - y; }); }
+            friend vfloat operator*(vfloat a, vfloat b) { return apply(a, b, [](float x, float y) { return x * y; }); }
+            friend vfloat operator/(vfloat a, vfloat b) { return apply(a, b, [](float x, float y) { return x / y; }); }
+            friend vfloat operator<(vfloat a, vfloat b) { return apply(a, b, [](float x, float y) { return fromBool(x < y); }); }
+            friend vfloat operator<=(vfloat a, vfloat b) { return apply(a, b, [](float x, float y) { return fromBool(x <= y); }); }
+            friend vfloat operator&(vfloat a, vfloat b) { return apply(a, b, [](float x, float y) { return fromBits(asBits(x) & asBits(y)); }); }
+            friend vfloat operator|(vfloat a, vfloat b) { return apply(a, b, [](float x, float y) { return fromBits(asBits(x) | asBits(y)); }); }
+            // the second operand when one is NaN, like minps and maxps
+            friend vfloat min(vfloat a, vfloat b) { return apply(a, b, [](float x, float y) { return x < y ? x : y; }); }
+            friend vfloat max(vfloat a, vfloat b) { return apply(a, b, [](float x, float y) { return x > y ? x : y; }); }
+            friend vfloat andNot(vfloat a, vfloat b) { return apply(a, b, [](float x, float y) { return fromBits(~asBits(x) & asBits(y)); }); }
+        };
+#endif
+
+        const int width = vfloat::width;
+    }
+
+    // TRIANGLE BLOCK
+    // --------------
+    // width triangles in SoA layout (one array per coordinate), with the values of Möller-Trumbore that only depend on
+    // the triangle already computed: the first vertex and the two edges from it. Lanes without a triangle have
+    // edges of length 0, which are never hit
+    struct alignas(32) triangle_block {
+        float v0[3][simd::width];
+        float e1[3][simd::width];
+        float e2[3][simd::width];
+        // the first corner of each triangle in its mesh (see indexed_mesh), like Hit::hit_ID
+        int32_t vertex[simd::width];
+
+        void set(int lane, const glm::vec3 &p1, const glm::vec3 &p2, const glm::vec3 &p3, int32_t firstVertex) {
+            glm::vec3 edge1 = p2 - p1, edge2 = p3 - p1;
+            for (int i = 0; i < 3; i++) {
+                v0[i][lane] = p1[i];
+                e1[i][lane] = edge1[i];
+                e2[i][lane] = edge2[i];
+            }
+            vertex[lane] = firstVertex;
+        }
+
+        void clear(int lane) {
+            set(lane, glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), -1);
+        }
+    };
+
+    // the hits of a ray with the triangles of a block
+    struct block_hits {
+        // bit i is set if the ray hits the triangle of lane i closer than the maximum distance
+        int mask;
+        alignas(32) float dist[simd::width];
+        alignas(32) float u[simd::width];
+        alignas(32) float v[simd::width];
+    };
+
+    // the same test as Renderer::rayTriangleIntersection (Möller-Trumbore, with the same tolerance), for all the
+    // triangles of block at the same time. Only the hits at a distance in [0, maxDist) are reported, or in
+    // [0, maxDist] if inclusive is true.
+    // The operations are the ones of the scalar version in the same order, so the results only differ by rounding
+    // when the compiler fuses a multiplication and an addition in one of them and not in the other
+    RT_SIMD_INLINE void intersectBlock(const Ray &ray, const triangle_block &block, float maxDist, bool inclusive,
+                               block_hits &hits) {
+        using simd::vfloat;
+        const vfloat tolerance = vfloat::set1(10e-7f), zero = vfloat::set1(0.0f), one = vfloat::set1(1.0f);
+        vfloat dx = vfloat::set1(ray.direction.x), dy = vfloat::set1(ray.direction.y), dz = vfloat::set1(ray.direction.z);
+        vfloat e1x = vfloat::load(block.e1[0]), e1y = vfloat::load(block.e1[1]), e1z = vfloat::load(block.e1[2]);
+        vfloat e2x = vfloat::load(block.e2[0]), e2y = vfloat::load(block.e2[1]), e2z = vfloat::load(block.e2[2]);
+
+        // q = cross(direction, e2), a = dot(e1, q)
+        vfloat qx = dy * e2z - e2y * dz, qy = dz * e2x - e2z * dx, qz = dx * e2y - e2x * dy;
+        vfloat a = e1x * qx + e1y * qy + e1z * qz;
+        // abs(a) >= tolerance, the ray is not parallel to the triangle
+        vfloat valid = (tolerance <= a) | (a <= zero - tolerance);
+        vfloat f = one / a;
+
+        // s = origin - p1, u = f * dot(s, q)
+        vfloat sx = vfloat::set1(ray.origin.x) - vfloat::load(block.v0[0]);
+        vfloat sy = vfloat::set1(ray.origin.y) - vfloat::load(block.v0[1]);
+        vfloat sz = vfloat::set1(ray.origin.z) - vfloat::load(block.v0[2]);
+        vfloat u = f * (sx * qx + sy * qy + sz * qz);
+        valid = valid & (zero - tolerance <= u);
+
+        // r = cross(s, e1), v = f * dot(direction, r)
+        vfloat rx = sy * e1z - e1y * sz, ry = sz * e1x - e1z * sx, rz = sx * e1y - e1x * sy;
+        vfloat v = f * (dx * rx + dy * ry + dz * rz);
+        valid = valid & (zero - tolerance <= v) & (u + v <= one);
+
+        vfloat t = f * (e2x * rx + e2y * ry + e2z * rz);
+        vfloat maxT = vfloat::set1(maxDist);
+        valid = valid & (zero <= t) & (inclusive ? t <= maxT : t < maxT);
+
+        hits.mask = valid.mask();
+        t.store(hits.dist);
+        u.store(hits.u);
+        v.store(hits.v);
+    }
+
+    // RAY PACKET
+    // ----------
+    // simd::width rays in SoA layout, traced through the hierarchy together: the boxes are tested against all the rays
+    // at once, and a node is visited if any of the rays enters it. Works best for coherent rays, e.g. the camera rays
+    // of neighbor pixels
+    struct alignas(32) ray_packet {
+        float origin[3][simd::width];
+        float direction[3][simd::width];
+        float invDir[3][simd::width];
+        // bit i is set if lane i has a ray
+        int active = 0;
+
+        void set(int lane, const Ray &ray) {
+            for (int i = 0; i < 3; i++) {
+                origin[i][lane] = ray.origin[i];
+                direction[i][lane] = ray.direction[i];
+                // like in BVH::traverse, a direction of 0 would give 0 * infinity = NaN in the slab test
+                invDir[i][lane] = ray.direction[i] != 0 ? 1.0f / ray.direction[i] : FLT_MAX;
+            }
+            active |= 1 << lane;
+        }
+
+        Ray ray(int lane) const {
+            return Ray(glm::vec3(origin[0][lane], origin[1][lane], origin[2][lane]),
+                       glm::vec3(direction[0][lane], direction[1][lane], direction[2][lane]));
+        }
+    };
+
+    // the slab test of all the rays of packet with the box [boxMin, boxMax]. Returns the mask of the rays that enter
+    // the box closer than their maximum distance in maxDist (rays with a negative maximum distance never do), and
+    // stores the distance at which each ray enters the box in enter
+    RT_SIMD_INLINE int enterBox(const ray_packet &packet, const glm::vec3 &boxMin, const glm::vec3 &boxMax,
+                        simd::vfloat maxDist, simd::vfloat &enter) {
+        using simd::vfloat;
+        vfloat exit = vfloat::set1(FLT_MAX);
+        enter = vfloat::set1(0.0f);
+        for (int i = 0; i < 3; i++) {
+            vfloat origin = vfloat::load(packet.origin[i]), invDir = vfloat::load(packet.invDir[i]);
+            vfloat t1 = (vfloat::set1(boxMin[i]) - origin) * invDir;
+            vfloat t2 = (vfloat::set1(boxMax[i]) - origin) * invDir;
+            enter = max(enter, min(t1, t2));
+            exit = min(exit, max(t1, t2));
+        }
+        return ((enter <= exit) & (enter < maxDist)).mask() & packet.active;
+    }
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_RT_SIMD_H
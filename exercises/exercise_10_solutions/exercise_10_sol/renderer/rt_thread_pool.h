@@ -0,0 +1,165 @@
+//
+// Thread pool of the ray tracer, the jobs are balanced between the threads by work stealing.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_RT_THREAD_POOL_H
+#define ITU_GRAPHICS_PROGRAMMING_RT_THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+
+namespace rt {
+
+    // WORK STEALING THREAD POOL
+    // -------------------------
+    // runs the jobs [0, count) on a group of threads that is kept alive between calls of run (the calling thread is
+    // one of them). Every thread starts with a contiguous range of jobs and takes them from the front. A thread that
+    // runs out of jobs steals the back half of the range of another thread, so threads that got cheap jobs (e.g.
+    // tiles of the background) help the ones that got expensive jobs (e.g. tiles with many reflections), and the
+    // threads mostly work on neighbor jobs.
+    // The range of each thread is a pair of 32 bit indices in a single 64 bit atomic, so taking and stealing jobs
+    // are a compare and swap, without locks.
+    class ThreadPool {
+    public:
+        ThreadPool() = default;
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        ~ThreadPool() {
+            stopThreads();
+        }
+
+        // call job(index, thread) for every index in [0, count) on up to threads threads, thread is in [0, threads).
+        // Returns when all the jobs are done
+        void run(int count, unsigned int threads, const std::function<void(int, unsigned int)> &job) {
+            threads = std::max(1u, std::min(threads, unsigned(std::max(count, 1))));
+            if (threads != m_threadCount)
+                startThreads(threads);
+
+            for (unsigned int t = 0; t < threads; t++) {
+                uint32_t begin = uint32_t(int64_t(count) * t / threads);
+                uint32_t end = uint32_t(int64_t(count) * (t + 1) / threads);
+                m_ranges[t].jobs.store(pack(begin, end));
+            }
+            m_job = &job;
+
+            if (threads > 1) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_running = threads - 1;
+                m_generation++;
+                m_start.notify_all();
+            }
+            work(0);
+            if (threads > 1) {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_done.wait(lock, [&]() { return m_running == 0; });
+            }
+            m_job = nullptr;
+        }
+
+    private:
+        // the jobs [begin, end) of a thread, padded so that each range is in its own cache line
+        struct job_range {
+            std::atomic<uint64_t> jobs;
+            char padding[64 - sizeof(std::atomic<uint64_t>)];
+        };
+
+        static uint64_t pack(uint32_t begin, uint32_t end) { return uint64_t(begin) << 32 | end; }
+        static uint32_t begin(uint64_t jobs) { return uint32_t(jobs >> 32); }
+        static uint32_t end(uint64_t jobs) { return uint32_t(jobs); }
+
+        void startThreads(unsigned int threads) {
+            stopThreads();
+            m_stop = false;
+            m_threadCount = threads;
+            m_ranges.reset(new job_range[threads]);
+            unsigned long long generation = m_generation;
+            for (unsigned int t = 1; t < threads; t++)
+                m_threads.emplace_back([this, t, generation]() { threadLoop(t, generation); });
+        }
+
+        void stopThreads() {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+                m_start.notify_all();
+            }
+            for (auto &thread : m_threads)
+                thread.join();
+            m_threads.clear();
+            m_threadCount = 0;
+        }
+
+        // the helper threads wait for the next call of run (the next generation), do their jobs, and wait again
+        void threadLoop(unsigned int thread, unsigned long long generation) {
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_start.wait(lock, [&]() { return m_stop || m_generation != generation; });
+                    if (m_stop)
+                        return;
+                    generation = m_generation;
+                }
+                work(thread);
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (--m_running == 0)
+                    m_done.notify_one();
+            }
+        }
+
+        void work(unsigned int thread) {
+            std::atomic<uint64_t> &own = m_ranges[thread].jobs;
+            while (true) {
+                // take the first job of our range
+                uint64_t jobs = own.load();
+                while (begin(jobs) < end(jobs) && !own.compare_exchange_weak(jobs, pack(begin(jobs) + 1, end(jobs)))) {}
+                if (begin(jobs) < end(jobs)) {
+                    (*m_job)(int(begin(jobs)), thread);
+                    continue;
+                }
+                // our range is empty, steal from the other threads until one has jobs left
+                if (!steal(thread))
+                    return;
+            }
+        }
+
+        // move the back half of the range of another thread to the range of thread, returns false if all ranges
+        // are empty. Jobs can only move from one range to another, so when all are empty all jobs have been taken
+        bool steal(unsigned int thread) {
+            for (unsigned int i = 1; i < m_threadCount; i++) {
+                std::atomic<uint64_t> &victim = m_ranges[(thread + i) % m_threadCount].jobs;
+                uint64_t jobs = victim.load();
+                while (begin(jobs) < end(jobs)) {
+                    // the stolen half is rounded up, so that a single job left can be stolen too
+                    uint32_t middle = begin(jobs) + (end(jobs) - begin(jobs)) / 2;
+                    if (victim.compare_exchange_weak(jobs, pack(begin(jobs), middle))) {
+                        // only this thread adds jobs to its own range, and it is empty, so it can be stored directly
+                        m_ranges[thread].jobs.store(pack(middle, end(jobs)));
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        std::vector<std::thread> m_threads;
+        unsigned int m_threadCount = 0;
+        std::unique_ptr<job_range[]> m_ranges;
+        const std::function<void(int, unsigned int)> *m_job = nullptr;
+
+        std::mutex m_mutex;
+        std::condition_variable m_start, m_done;
+        unsigned long long m_generation = 0;
+        unsigned int m_running = 0;
+        bool m_stop = false;
+    };
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_RT_THREAD_POOL_H
@@ -37,9 +37,10 @@ namespace rt{
     };
 
     struct Hit{
-        int hit_ID = -1; // negative values for no hit, other values for the index of the first vertex in a triangle
+        int hit_ID = -1; // negative values for no hit, other values for the index of the first vertex (corner) of a triangle
         glm::vec3 barycentric; // the barycentric coordinates of the triangle that was hit (if any)
         float dist = FLT_MAX;  // used to store the intersection distance
+        int instance = -1; // the instance that was hit when tracing a Scene, hit_ID is a vertex of its mesh
     };
 
     struct vertex {
@@ -0,0 +1,289 @@
+// Benchmark of the frame buffer layouts of the software renderer (linear rows and 8x8 Morton tiles).
+// It renders the same scene of many cubes with the triangle renderer in both layouts, without a window, prints the
+// time per frame and the time of the copy to the linear layout needed by glTexImage2D, and checks that both layouts
+// produce the same image.
+// It also checks the textured program (srl::shaders::textured_*, a batched fragment shader): a textured cube seen
+// straight on, so that the texture coordinates of its front face are an affine function of the pixel with known
+// derivatives, is rendered at several sizes (magnified, 1:1 and minified) and each pixel of the face is compared to a
+// sample of the texture at the coordinates and level of detail computed for that pixel in the benchmark. The mip
+// levels are compared to averages of the image computed in the benchmark too.
+// To see the difference in cache misses, run it under a profiler, e.g. perf stat -e cache-misses,cache-references.
+// With --sweep it renders the scene at resolutions from 480x270 to 7680x4320 instead, and prints the memory of the
+// color and depth buffers next to the time of each layout (render and copy), so the resolution at which the buffers
+// outgrow each level of the cache of the machine shows as a change of the speedup of the tiles. A row of the linear
+// buffers is 4 bytes per pixel, so the triangles of a 1920 pixels wide image touch a new 7.5 KB row every line, while
+// a tile of 8x8 pixels is 256 contiguous bytes.
+//
+// usage: exercise_7_sol_framebuffer_bench [width height cubes frames]
+//        exercise_7_sol_framebuffer_bench --sweep [cubes frames]
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+#include <string>
+
+#include "srl_triangle_renderer.h"
+#include "primitives.h"
+
+// small deterministic random generator, so that every run renders the same scene
+static uint32_t lcgState = 12345u;
+static float randomFloat() {
+    lcgState = lcgState * 1664525u + 1013904223u;
+    return float(lcgState >> 8) / float(1u << 24);
+}
+
+struct bench_result {
+    double renderMs;
+    double copyMs;
+    std::vector<uint32_t> image;
+};
+
+template<class Layout>
+static bench_result renderScene(const std::vector<srl::vertex> &cube, const std::vector<glm::mat4> &models,
+                                const glm::mat4 &viewProj, int width, int height, int frames) {
+    srl::TriangleRendererT<srl::shaders::default_varyings, srl::shaders::default_vertex_shader,
+            srl::shaders::default_fragment_shader, Layout> renderer;
+    srl::CustomFrameBuffer<uint32_t, Layout> colorBuffer(width, height);
+    srl::DepthBufferT<Layout> depthBuffer(width, height);
+
+    bench_result result{0, 0, std::vector<uint32_t>(width * height)};
+    for (int frame = 0; frame < frames; frame++) {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        colorBuffer.clearBuffer(srl::Colors::toRGBA32(srl::Colors::black));
+        depthBuffer.clearBuffer(1.0f);
+        for (auto &model : models)
+            renderer.render(cube, model, viewProj, colorBuffer, depthBuffer);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        // what the display loop does before glTexImage2D
+        colorBuffer.copyToLinear(result.image.data());
+        auto t2 = std::chrono::high_resolution_clock::now();
+
+        result.renderMs += std::chrono::duration<double, std::milli>(t1 - t0).count() / frames;
+        result.copyMs += std::chrono::duration<double, std::milli>(t2 - t1).count() / frames;
+    }
+    return result;
+}
+
+// checker of single texels in blue with a gradient in red and green: the mip levels are grey where the base level
+// alternates between dark and bright, so a wrong level of detail changes the colors a lot, and the gradient tells the
+// texels (and the blocks) apart
+static std::vector<uint32_t> makeCheckerImage(int size) {
+    std::vector<uint32_t> rgba(size * size);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            uint32_t checker = ((x + y) & 1) ? 0xe0u : 0x20u;
+            uint32_t r = uint32_t(x * 255 / (size - 1)), g = uint32_t(y * 255 / (size - 1));
+            rgba[x + y * size] = r | g << 8 | checker << 16 | 0xffu << 24;
+        }
+    }
+    return rgba;
+}
+
+// the largest difference of the channels of two RGBA8 colors
+static int channelDifference(uint32_t a, uint32_t b) {
+    int largest = 0;
+    for (int c = 0; c < 32; c += 8)
+        largest = std::max(largest, std::abs(int((a >> c) & 0xffu) - int((b >> c) & 0xffu)));
+    return largest;
+}
+
+// every texel of every mip level of a texture made from image, sampled with the nearest filter at its center, is the
+// average of the 2x2 texels of the level above (rounded), returns the largest difference of a channel
+static int checkMipLevels(const std::vector<uint32_t> &image, int size) {
+    srl::Texture texture;
+    texture.create(size, size, image.data());
+    texture.filtering = srl::Texture::filter::nearest;
+    std::vector<uint32_t> level = image;
+    int largest = 0;
+    for (int l = 0, levelSize = size; l < texture.levels(); l++, levelSize /= 2) {
+        for (int y = 0; y < levelSize; y++) {
+            for (int x = 0; x < levelSize; x++) {
+                glm::vec2 uv((float(x) + .5f) / float(levelSize), (float(y) + .5f) / float(levelSize));
+                uint32_t sampled = srl::Colors::toRGBA32(texture.sample(uv, float(l)));
+                largest = std::max(largest, channelDifference(sampled, level[x + y * levelSize]));
+            }
+        }
+        if (levelSize == 1)
+            break;
+        std::vector<uint32_t> next(levelSize * levelSize / 4);
+        for (int y = 0; y < levelSize / 2; y++) {
+            for (int x = 0; x < levelSize / 2; x++) {
+                uint32_t average = 0;
+                for (int c = 0; c < 32; c += 8) {
+                    uint32_t sum = 2;
+                    for (int t = 0; t < 4; t++)
+                        sum += (level[2 * x + t % 2 + (2 * y + t / 2) * levelSize] >> c) & 0xffu;
+                    average |= (sum / 4) << c;
+                }
+                next[x + y * levelSize / 2] = average;
+            }
+        }
+        level.swap(next);
+    }
+    return largest;
+}
+
+// render the cube with the textured program, seen straight on with an orthographic camera so that its front face
+// covers faceSize x faceSize pixels in the middle of a bufferSize x bufferSize image. Returns the largest difference
+// of a channel between the pixels inside the face and the texture sampled at their coordinates, with the level of
+// detail of a face of that size (the derivatives of the coordinates are 1 / faceSize along x and y)
+static int checkTexturedCube(const std::vector<srl::vertex> &cube, const srl::Texture &texture, int faceSize,
+                             int bufferSize) {
+    srl::TriangleRendererT<srl::shaders::textured_varyings, srl::shaders::textured_vertex_shader,
+            srl::shaders::textured_fragment_shader> renderer;
+    renderer.fragmentShader.texture = &texture;
+    srl::CustomFrameBuffer<uint32_t> colorBuffer(bufferSize, bufferSize);
+    srl::DepthBuffer depthBuffer(bufferSize, bufferSize);
+    colorBuffer.clearBuffer(srl::Colors::toRGBA32(srl::Colors::black));
+    depthBuffer.clearBuffer(1.0f);
+
+    // the cube has a side of 1, its front face spans faceSize pixels of the 2 units of the orthographic view
+    float scale = 2.0f * float(faceSize) / float(bufferSize);
+    glm::mat4 viewProj = glm::ortho(-1.f, 1.f, -1.f, 1.f, .1f, 10.f) *
+                         glm::lookAt(glm::vec3(0, 0, 5.f), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+    renderer.render(cube, glm::scale(glm::vec3(scale)), viewProj, colorBuffer, depthBuffer);
+
+    // the attributes are interpolated at the integer window coordinates, the face starts at the window coordinate
+    // bufferSize / 2 - faceSize / 2 with uv = 0. The pixels on its edges are left out, they can be on either side
+    float lod = texture.lod(glm::vec2(1.f / float(faceSize), 0.f), glm::vec2(0.f, 1.f / float(faceSize)));
+    int first = (bufferSize - faceSize) / 2;
+    // the nearest filter jumps from a texel to the next at their border, where the rounding of the coordinates
+    // decides which one is sampled, the pixels that fall on a border of the sampled level are left out
+    int level = lod <= 0.f ? 0 : std::min(int(lod + .5f), texture.levels() - 1);
+    float levelSize = float(std::max(texture.width() >> level, 1));
+    auto onBorder = [&](float coordinate) {
+        float texel = coordinate * levelSize;
+        return std::abs(texel - std::round(texel)) < 1e-3f;
+    };
+    bool nearest = texture.filtering == srl::Texture::filter::nearest;
+    int largest = 0;
+    for (int y = first + 1; y < first + faceSize; y++) {
+        for (int x = first + 1; x < first + faceSize; x++) {
+            glm::vec2 uv(float(x - first) / float(faceSize), float(y - first) / float(faceSize));
+            if (nearest && (onBorder(uv.x) || onBorder(uv.y)))
+                continue;
+            uint32_t expected = srl::Colors::toRGBA32(texture.sample(uv, lod));
+            largest = std::max(largest, channelDifference(colorBuffer.valueAt(x, y), expected));
+        }
+    }
+    return largest;
+}
+
+// the mip levels and the textured cube at several sizes, returns true if they all match
+static bool checkTextures(const std::vector<srl::vertex> &cube) {
+    const int textureSize = 64, bufferSize = 256;
+    // the renderer and the reference interpolate the coordinates differently, the results differ by rounding
+    const int tolerance = 2;
+    std::vector<uint32_t> image = makeCheckerImage(textureSize);
+    int mipDifference = checkMipLevels(image, textureSize);
+    bool match = mipDifference == 0;
+    std::cout << "mip levels: largest difference " << mipDifference << (match ? "" : " DIFFERENT") << std::endl;
+
+    // a texture without an image is opaque black
+    bool emptyBlack = srl::Colors::toRGBA32(srl::Texture().sample(glm::vec2(.5f))) == 0xff000000u;
+    std::cout << "texture without an image: " << (emptyBlack ? "black" : "DIFFERENT") << std::endl;
+    match = match && emptyBlack;
+
+    // the vertex colors multiply the texture, white keeps it as it is
+    std::vector<srl::vertex> whiteCube = cube;
+    for (auto &v : whiteCube)
+        v.col = srl::Colors::color(1.0f);
+
+    const srl::Texture::filter filters[] = {srl::Texture::filter::nearest, srl::Texture::filter::bilinear,
+                                            srl::Texture::filter::trilinear};
+    const char *filterNames[] = {"nearest", "bilinear", "trilinear"};
+    srl::Texture texture;
+    texture.create(textureSize, textureSize, image.data());
+    for (int f = 0; f < 3; f++) {
+        texture.filtering = filters[f];
+        // a level of detail of -1.6, 0, 1, 2.4 and 3
+        for (int faceSize : {192, 64, 32, 12, 8}) {
+            int difference = checkTexturedCube(whiteCube, texture, faceSize, bufferSize);
+            bool same = difference <= tolerance;
+            std::cout << "textured cube, " << std::setw(9) << filterNames[f] << ", face of " << std::setw(3)
+                      << faceSize << " pixels: largest difference " << difference << (same ? "" : " DIFFERENT")
+                      << std::endl;
+            match = match && same;
+        }
+    }
+    return match;
+}
+
+// render the scene in both layouts at resolutions of growing memory, the buffers of the smallest fit in the second
+// level cache of most processors and the ones of the largest in none
+static bool sweepResolutions(const std::vector<srl::vertex> &cube, const std::vector<glm::mat4> &models, int frames) {
+    const int resolutions[][2] = {{480, 270}, {960, 540}, {1920, 1080}, {3840, 2160}, {7680, 4320}};
+    std::cout << std::setw(12) << "resolution" << std::setw(12) << "buffers MB" << std::setw(12) << "linear ms"
+              << std::setw(12) << "tiled ms" << std::setw(12) << "speedup" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    bool match = true;
+    for (auto &resolution : resolutions) {
+        int width = resolution[0], height = resolution[1];
+        glm::mat4 viewProj = glm::perspectiveFov<float>(glm::radians(60.0f), float(width), float(height), .5f, 50.0f) *
+                             glm::lookAt(glm::vec3(0, 0, 10.f), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+        bench_result linear = renderScene<srl::layouts::linear>(cube, models, viewProj, width, height, frames);
+        bench_result tiled = renderScene<srl::layouts::tiled>(cube, models, viewProj, width, height, frames);
+        // 4 bytes of color and 4 of depth per pixel
+        double megabytes = double(width) * height * 8 / (1024 * 1024);
+        double linearMs = linear.renderMs + linear.copyMs, tiledMs = tiled.renderMs + tiled.copyMs;
+        bool same = linear.image == tiled.image;
+        std::cout << std::setw(12) << std::to_string(width) + "x" + std::to_string(height) << std::setw(12)
+                  << megabytes << std::setw(12) << linearMs << std::setw(12) << tiledMs << std::setw(12)
+                  << linearMs / tiledMs << (same ? "" : " DIFFERENT") << std::endl;
+        match = match && same;
+    }
+    return match;
+}
+
+int main(int argc, char **argv) {
+    bool sweep = argc > 1 && std::string(argv[1]) == "--sweep";
+    int first = sweep ? 2 : 3;
+    int width = !sweep && argc > 2 ? std::atoi(argv[1]) : 1920;
+    int height = !sweep && argc > 2 ? std::atoi(argv[2]) : 1080;
+    int cubes = argc > first ? std::atoi(argv[first]) : 2000;
+    int frames = argc > first + 1 ? std::atoi(argv[first + 1]) : sweep ? 5 : 20;
+
+    std::vector<glm::vec3> points;
+    std::vector<glm::vec4> colors;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> uvs;
+    Primitives::makeCube(1.0f, points, normals, uvs, colors);
+    std::vector<srl::vertex> cube;
+    for (unsigned int i = 0; i < points.size(); i++)
+        cube.push_back(srl::vertex{glm::vec4(points[i], 1.0f), glm::vec4(normals[i], 0.0f), colors[i], uvs[i]});
+
+    // small cubes in a box in front of the camera, most triangles cover a few dozen pixels
+    std::vector<glm::mat4> models;
+    for (int i = 0; i < cubes; i++) {
+        glm::vec3 pos(randomFloat() * 16.f - 8.f, randomFloat() * 9.f - 4.5f, -randomFloat() * 20.f);
+        glm::vec3 axis = glm::normalize(glm::vec3(randomFloat(), randomFloat(), randomFloat()) + 0.1f);
+        models.push_back(glm::translate(pos) * glm::rotate(randomFloat() * 6.28f, axis) * glm::scale(glm::vec3(0.3f)));
+    }
+    if (sweep)
+        return sweepResolutions(cube, models, frames) ? 0 : 1;
+
+    glm::mat4 viewProj = glm::perspectiveFov<float>(glm::radians(60.0f), float(width), float(height), .5f, 50.0f) *
+                         glm::lookAt(glm::vec3(0, 0, 10.f), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+
+    bench_result linear = renderScene<srl::layouts::linear>(cube, models, viewProj, width, height, frames);
+    bench_result tiled = renderScene<srl::layouts::tiled>(cube, models, viewProj, width, height, frames);
+    bool match = linear.image == tiled.image;
+
+    std::cout << "resolution " << width << "x" << height << ", " << cubes << " cubes, " << frames << " frames" << std::endl;
+    std::cout << std::setw(10) << "layout" << std::setw(16) << "render ms" << std::setw(16) << "to linear ms"
+              << std::setw(16) << "Mpix/s" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << std::setw(10) << "linear" << std::setw(16) << linear.renderMs << std::setw(16) << linear.copyMs
+              << std::setw(16) << width * height / linear.renderMs * 1e-3 << std::endl;
+    std::cout << std::setw(10) << "tiled" << std::setw(16) << tiled.renderMs << std::setw(16) << tiled.copyMs
+              << std::setw(16) << width * height / tiled.renderMs * 1e-3 << std::endl;
+    std::cout << "images " << (match ? "same" : "DIFFERENT") << std::endl;
+
+    bool texturesMatch = checkTextures(cube);
+
+    return match && texturesMatch ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+// Throughput benchmark of the two triangle rasterizers (triangle_rasterizer and halfspace_rasterizer).
+// It runs without a window, prints the Mpixels/s of each rasterizer and checks that both cover the same pixels.
+//
+// usage: exercise_7_sol_raster_bench [width height triangles]
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+
+#include "trianglerasterizer.h"
+#include "halfspacerasterizer.h"
+
+struct bench_triangle {
+    int x1, y1, x2, y2, x3, y3;
+};
+
+// small deterministic random generator, so that every run rasterizes the same triangles
+static uint32_t lcgState = 12345u;
+static int randomInt(int range) {
+    lcgState = lcgState * 1664525u + 1013904223u;
+    return int((lcgState >> 8) % uint32_t(range));
+}
+
+// triangles with a bounding box of at most maxSize x maxSize pixels, fully inside the width x height screen
+static std::vector<bench_triangle> makeTriangles(int count, int maxSize, int width, int height) {
+    std::vector<bench_triangle> tris(count);
+    for (auto &t : tris) {
+        int size = std::min(maxSize, std::min(width, height));
+        int ox = randomInt(width - size + 1), oy = randomInt(height - size + 1);
+        t = {ox + randomInt(size), oy + randomInt(size),
+             ox + randomInt(size), oy + randomInt(size),
+             ox + randomInt(size), oy + randomInt(size)};
+    }
+    return tris;
+}
+
+// adds (or removes) the coverage of the scanline rasterizer to a counter buffer
+static long long scanlineRaster(const std::vector<bench_triangle> &tris, std::vector<int> &coverage, int width, int sign) {
+    long long pixels = 0;
+    for (auto &t : tris) {
+        triangle_rasterizer rasterizer(t.x1, t.y1, t.x2, t.y2, t.x3, t.y3);
+        std::vector<glm::ivec2> all = rasterizer.all_pixels();
+        for (auto &p : all)
+            coverage[p.x + p.y * width] += sign;
+        pixels += all.size();
+    }
+    return pixels;
+}
+
+// adds (or removes) the coverage of the half-space rasterizer to a counter buffer
+static long long halfspaceRaster(const std::vector<bench_triangle> &tris, std::vector<int> &coverage, int width, int height, int sign) {
+    long long pixels = 0;
+    for (auto &t : tris) {
+        halfspace_rasterizer rasterizer(t.x1, t.y1, t.x2, t.y2, t.x3, t.y3, width, height);
+        rasterizer.for_each_span([&](int y, int xBegin, int xEnd){
+            int *row = &coverage[y * width];
+            for (int x = xBegin; x < xEnd; x++)
+                row[x] += sign;
+            pixels += xEnd - xBegin;
+        });
+    }
+    return pixels;
+}
+
+int main(int argc, char **argv) {
+    int width = argc > 2 ? std::atoi(argv[1]) : 1920;
+    int height = argc > 2 ? std::atoi(argv[2]) : 1080;
+    int count = argc > 3 ? std::atoi(argv[3]) : 20000;
+
+    std::vector<int> coverage(width * height, 0);
+    int sizes[] = {4, 16, 64, 256};
+    bool allMatch = true;
+
+    std::cout << "resolution " << width << "x" << height << ", " << count << " triangles per run" << std::endl;
+    std::cout << std::setw(10) << "max size" << std::setw(20) << "scanline Mpix/s" << std::setw(20) << "half-space Mpix/s"
+              << std::setw(12) << "coverage" << std::endl;
+
+    for (int size : sizes) {
+        std::vector<bench_triangle> tris = makeTriangles(count, size, width, height);
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        long long scanPixels = scanlineRaster(tris, coverage, width, 1);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        long long halfPixels = halfspaceRaster(tris, coverage, width, height, -1);
+        auto t2 = std::chrono::high_resolution_clock::now();
+
+        // the scanline rasterizer adds one and the half-space rasterizer removes one, so the buffer must be zero again
+        bool match = scanPixels == halfPixels;
+        for (int &c : coverage) {
+            match = match && c == 0;
+            c = 0;
+        }
+        allMatch = allMatch && match;
+
+        double scanSeconds = std::chrono::duration<double>(t1 - t0).count();
+        double halfSeconds = std::chrono::duration<double>(t2 - t1).count();
+        std::cout << std::setw(10) << size
+                  << std::setw(20) << std::fixed << std::setprecision(1) << scanPixels / scanSeconds * 1e-6
+                  << std::setw(20) << halfPixels / halfSeconds * 1e-6
+                  << std::setw(12) << (match ? "same" : "DIFFERENT") << std::endl;
+    }
+
+    return allMatch ? 0 : 1;
+}
@@ -9,6 +9,7 @@
 #include "srl_line_renderer.h"
 #include "srl_triangle_renderer.h"
 #include "primitives.h"
+#include "display_buffer.h"
 
 // glfw callbacks
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -33,6 +34,8 @@ srl::PointRenderer pRenderer;
 srl::LineRenderer lRenderer;
 srl::TriangleRenderer tRenderer;
 srl::Renderer* srlRenderer = &tRenderer;
+// samples per pixel, 1 means no multisample anti-aliasing
+int msaaSamples = 1;
 
 int main()
 {
@@ -101,31 +104,17 @@ int main()
                                               glm::vec3(.0f, 1.f, .0f));
 
 
-    // initialize our custom frame buffer
+    // initialize our custom depth buffer
     // ----------------------------------
-    // every frame we will: draw to it, upload it to a texture, and copy the texture to the window frame buffer.
-    srl::CustomFrameBuffer<std::uint32_t> customBuffer(max_W, max_H);
-    srl::CustomFrameBuffer<float> customZBuffer(max_W, max_H);
-
-
-    // initialize texture we will use to upload our buffer to GPU
-    // ----------------------------------------------------------
-    unsigned int bufferTexture;
-
-    glGenTextures(1, &bufferTexture);
-    glBindTexture(GL_TEXTURE_2D, bufferTexture);
-    // set the texture wrapping parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    // set texture filtering parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    // initialize openGL frame buffer object
-    // ------------------------------------
-    // this helps handling writing the texture content into the window frame buffer
-    GLuint oglFrameBuffer = 0;
-    glGenFramebuffers(1, &oglFrameBuffer);
+    // every frame we will: draw to a custom color buffer, upload it to a texture, and copy the texture to the window
+    // frame buffer. The color buffer is created every frame, in memory provided by the display buffer.
+    srl::DepthBuffer customZBuffer(max_W, max_H);
+    srl::MultisampleBuffer msaaBuffer4(max_W, max_H, 4), msaaBuffer8(max_W, max_H, 8);
+
+
+    // initialize the buffers we use to upload our color buffer to GPU
+    // ---------------------------------------------------------------
+    DisplayBuffer displayBuffer(max_W, max_H);
 
     // render loop
     // -----------
@@ -137,6 +126,7 @@ int main()
     std::cout << "1 - use point renderer" << std::endl;
     std::cout << "2 - use line renderer" << std::endl;
     std::cout << "3 - use triangle renderer" << std::endl;
+    std::cout << "4 - switch anti-aliasing (off, 4x MSAA, 8x MSAA)" << std::endl;
 
     while (!glfwWindowShouldClose(window))
     {
@@ -147,29 +137,28 @@ int main()
 
         // render to our custom frame buffer
         // ---------------------------------
-        customBuffer.clearBuffer(srl::Colors::toRGBA32(srl::Colors::black));
-        customZBuffer.clearBuffer(1.0f);
+        // the color buffer is the memory that will be uploaded, the previous frame may still be uploading meanwhile
+        srl::CustomFrameBuffer<std::uint32_t> customBuffer(max_W, max_H, displayBuffer.beginFrame());
+        if (msaaSamples > 1) {
+            // render to the samples, and average them in the color buffer
+            srl::MultisampleBuffer &msaaBuffer = msaaSamples == 8 ? msaaBuffer8 : msaaBuffer4;
+            msaaBuffer.clearBuffer(srl::Colors::toRGBA32(srl::Colors::black), 1.0f);
+            srlRenderer->render(vtsCube, trackballRotation() * storedRotation, viewProj, msaaBuffer);
+            msaaBuffer.resolve(customBuffer);
+        }
+        else {
+            customBuffer.clearBuffer(srl::Colors::toRGBA32(srl::Colors::black));
+            customZBuffer.clearBuffer(1.0f);
 
-        srlRenderer->render(vtsCube, trackballRotation() * storedRotation, viewProj, customBuffer, customZBuffer);
+            srlRenderer->render(vtsCube, trackballRotation() * storedRotation, viewProj, customBuffer, customZBuffer);
+        }
 
         // show our rendered image
         // -----------------------
-        // upload the custom color buffer to the GPU using the texture
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, bufferTexture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, max_W, max_H, 0, GL_RGBA, GL_UNSIGNED_BYTE, customBuffer.buffer);
-
-        // set opengl frame buffer object to read from our texture, we will copy from it
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, oglFrameBuffer);
-        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, bufferTexture, 0);
-
-        // bind the window frame buffer, where we want to copy the contents of the texture to
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-
-        // copy from the frame buffer object (access the texture) to the window frame buffer
+        // upload the custom color buffer to the GPU and copy it to the window frame buffer
         int size_W, size_H;
         glfwGetFramebufferSize(window, &size_W, &size_H);
-        glBlitFramebuffer(0,0, max_W, max_H, 0, 0, size_W, size_H, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        displayBuffer.endFrame(size_W, size_H);
 
         // display frame buffer
         glfwSwapBuffers(window);
@@ -268,6 +257,9 @@ void key_input_callback(GLFWwindow* window, int button, int other,int action, in
     if (button == GLFW_KEY_3 && action == GLFW_PRESS){
         srlRenderer = &tRenderer;
     }
+    if (button == GLFW_KEY_4 && action == GLFW_PRESS){
+        msaaSamples = msaaSamples == 1 ? 4 : msaaSamples == 4 ? 8 : 1;
+    }
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -0,0 +1,106 @@
+#include "coveragerasterizer.h"
+
+/*
+ * \class coverage_rasterizer
+ * A class which scanconverts a triangle for multisample anti-aliasing, one coverage mask per pixel.
+ */
+
+// division that rounds towards minus infinity, the vertices can have negative coordinates (guard band)
+static int floor_div(int n, int d)
+{
+    return n >= 0 ? n / d : -((-n + d - 1) / d);
+}
+
+/*
+ * Parameterized constructor creates an instance of a coverage rasterizer
+ * \param x1 - the x-coordinate of the first vertex, in 1 / subpixel_scale pixels
+ * \param y1 - the y-coordinate of the first vertex, in 1 / subpixel_scale pixels
+ * \param x2 - the x-coordinate of the second vertex, in 1 / subpixel_scale pixels
+ * \param y2 - the y-coordinate of the second vertex, in 1 / subpixel_scale pixels
+ * \param x3 - the x-coordinate of the third vertex, in 1 / subpixel_scale pixels
+ * \param y3 - the y-coordinate of the third vertex, in 1 / subpixel_scale pixels
+ * \param width - the width of the render target, pixels outside [0, width) are not generated
+ * \param height - the height of the render target, pixels outside [0, height) are not generated
+ * \param sample_offsets - the offsets of the samples from the pixel center, as pairs (x, y) in 1 / subpixel_scale pixels
+ * \param samples - the number of samples per pixel, at most max_samples
+ */
+coverage_rasterizer::coverage_rasterizer(int x1, int y1, int x2, int y2, int x3, int y3, int width, int height,
+                                         const int *sample_offsets, int samples)
+        : samples(std::min(samples, int(max_samples))), valid(false)
+{
+    this->full_mask = this->samples == 32 ? 0xffffffffu : (1u << this->samples) - 1u;
+    this->initialize_triangle(x1, y1, x2, y2, x3, y3, width, height);
+    if (!this->valid)
+        return;
+
+    for (int e = 0; e < 3; e++) {
+        this->min_sample_offset[e] = 0;
+        this->max_sample_offset[e] = 0;
+        for (int s = 0; s < this->samples; s++) {
+            int64_t offset = this->a[e] * sample_offsets[2 * s] + this->b[e] * sample_offsets[2 * s + 1];
+            this->sample_offset[e][s] = offset;
+            this->min_sample_offset[e] = s == 0 ? offset : std::min(this->min_sample_offset[e], offset);
+            this->max_sample_offset[e] = s == 0 ? offset : std::max(this->max_sample_offset[e], offset);
+        }
+    }
+}
+
+/*
+ * Checks if the triangle may cover any sample of the render target
+ * \return false if the triangle is degenerate or outside of the render target, else true is returned
+ */
+bool coverage_rasterizer::more_fragments() const
+{
+    return this->valid;
+}
+
+/*
+ * Initializes the edge functions and the bounding box of the triangle
+ */
+void coverage_rasterizer::initialize_triangle(int x1, int y1, int x2, int y2, int x3, int y3, int width, int height)
+{
+    // twice the signed area of the triangle, positive if the vertices are in counterclockwise order
+    int64_t area = int64_t(x2 - x1) * (y3 - y1) - int64_t(y2 - y1) * (x3 - x1);
+    if (area == 0) {
+        this->valid = false;
+        return;
+    }
+
+    // the edge functions are positive on the left of each edge, so the vertices must be in counterclockwise order
+    if (area < 0) {
+        std::swap(x2, x3);
+        std::swap(y2, y3);
+    }
+
+    this->initialize_edge(0, x1, y1, x2, y2);
+    this->initialize_edge(1, x2, y2, x3, y3);
+    this->initialize_edge(2, x3, y3, x1, y1);
+
+    // the samples of the pixel x are in [x - subpixel_scale / 2, x + subpixel_scale / 2) (in pixels),
+    // so the pixels with a sample inside the bounding box of the vertices are the ones below
+    const int half = subpixel_scale / 2;
+    this->x_min = std::max(floor_div(std::min(x1, std::min(x2, x3)) + half, subpixel_scale), 0);
+    this->y_min = std::max(floor_div(std::min(y1, std::min(y2, y3)) + half, subpixel_scale), 0);
+    this->x_max = std::min(floor_div(std::max(x1, std::max(x2, x3)) + half, subpixel_scale) + 1, width);
+    this->y_max = std::min(floor_div(std::max(y1, std::max(y2, y3)) + half, subpixel_scale) + 1, height);
+
+    this->valid = (this->x_min < this->x_max && this->y_min < this->y_max);
+}
+
+/*
+ * Initializes the edge function of the edge from (x1, y1) to (x2, y2)
+ * \param e - the index of the edge
+ */
+void coverage_rasterizer::initialize_edge(int e, int x1, int y1, int x2, int y2)
+{
+    // E(x, y) = (x2 - x1) * (y - y1) - (y2 - y1) * (x - x1)
+    this->a[e] = int64_t(y1) - y2;
+    this->b[e] = int64_t(x2) - x1;
+    this->c[e] = int64_t(x1) * y2 - int64_t(x2) * y1;
+
+    // same fill rule as halfspace_rasterizer: samples exactly on left and bottom edges are inside,
+    // samples exactly on the other edges are moved to the outside by subtracting one
+    bool left_or_bottom = (y2 < y1) || (y2 == y1 && x2 > x1);
+    if (!left_or_bottom)
+        this->c[e] -= 1;
+}
@@ -0,0 +1,199 @@
+#ifndef __COVERAGE_RASTERIZER_H__
+#define __COVERAGE_RASTERIZER_H__
+
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * \class coverage_rasterizer
+ * A class which scanconverts a triangle for multisample anti-aliasing: instead of testing one point per pixel,
+ * it tests up to 32 sample positions inside each pixel and reports which of them are covered as a bit mask.
+ *
+ * The vertices have sub-pixel precision, they are fixed point numbers with subpixel_bits fractional bits.
+ * The pixel (x, y) is centered at (x, y), like in halfspace_rasterizer, and its samples are at (x, y) plus
+ * their offset, in the range [-subpixel_scale / 2, subpixel_scale / 2) on both axes.
+ * The fill rule is the same top-left rule as halfspace_rasterizer, applied to every sample, so samples shared
+ * by two triangles are covered only once.
+ *
+ * The bounding box is traversed in blocks of 4x4 pixels. Blocks where no sample can be inside are rejected and
+ * blocks where all samples are inside get a full mask without testing the samples. The edge functions are 64 bit
+ * integers, since with sub-pixel precision they do not fit in 32 bits for triangles that reach the guard band.
+ *
+ * Covered pixels are reported as horizontal spans of a block row, with one mask per pixel of the span.
+ */
+class coverage_rasterizer {
+public:
+    /**
+     * The size, in pixels, of the side of the square blocks used to traverse the bounding box
+     */
+    static const int block_size = 4;
+
+    /**
+     * Number of fractional bits of the vertex coordinates and of the sample offsets
+     */
+    static const int subpixel_bits = 8;
+    static const int subpixel_scale = 1 << subpixel_bits;
+
+    /**
+     * The largest supported number of samples per pixel (the number of bits of a mask)
+     */
+    static const int max_samples = 32;
+
+    /**
+     * Parameterized constructor creates an instance of a coverage rasterizer
+     * \param x1 - the x-coordinate of the first vertex, in 1 / subpixel_scale pixels
+     * \param y1 - the y-coordinate of the first vertex, in 1 / subpixel_scale pixels
+     * \param x2 - the x-coordinate of the second vertex, in 1 / subpixel_scale pixels
+     * \param y2 - the y-coordinate of the second vertex, in 1 / subpixel_scale pixels
+     * \param x3 - the x-coordinate of the third vertex, in 1 / subpixel_scale pixels
+     * \param y3 - the y-coordinate of the third vertex, in 1 / subpixel_scale pixels
+     * \param width - the width of the render target, pixels outside [0, width) are not generated
+     * \param height - the height of the render target, pixels outside [0, height) are not generated
+     * \param sample_offsets - the offsets of the samples from the pixel center, as pairs (x, y) in 1 / subpixel_scale pixels
+     * \param samples - the number of samples per pixel, at most max_samples
+     */
+    coverage_rasterizer(int x1, int y1, int x2, int y2, int x3, int y3, int width, int height,
+                        const int *sample_offsets, int samples);
+
+    /**
+     * Checks if the triangle may cover any sample of the render target
+     * \return false if the triangle is degenerate or outside of the render target, else true is returned
+     */
+    bool more_fragments() const;
+
+    /**
+     * Visits all the pixels with at least one sample inside the triangle, one horizontal span at a time.
+     * The visitor is called as visit(y, x_begin, x_end, masks) for the pixels [x_begin, x_end) of the row y,
+     * where bit s of masks[x - x_begin] tells if sample s of the pixel x is covered.
+     * Spans never cross the border of a block, and some of their masks can be 0.
+     * \param visit - the function object which receives the spans
+     */
+    template<class SpanVisitor>
+    void for_each_span(SpanVisitor &&visit) const;
+
+private:
+
+    /**
+     * Initializes the edge functions and the bounding box of the triangle
+     */
+    void initialize_triangle(int x1, int y1, int x2, int y2, int x3, int y3, int width, int height);
+
+    /**
+     * Initializes the edge function of the edge from (x1, y1) to (x2, y2)
+     * \param e - the index of the edge
+     */
+    void initialize_edge(int e, int x1, int y1, int x2, int y2);
+
+    /**
+     * The edge functions E(x, y) = a * x + b * y + c in sub-pixel coordinates, which are >= 0 for the points
+     * inside the triangle. The fill rule is already included in c.
+     */
+    int64_t a[3];
+    int64_t b[3];
+    int64_t c[3];
+
+    /**
+     * The value of a * ox + b * oy of each edge function for each sample offset (ox, oy)
+     */
+    int64_t sample_offset[3][max_samples];
+
+    /**
+     * The smallest and largest sample_offset of each edge function
+     */
+    int64_t min_sample_offset[3];
+    int64_t max_sample_offset[3];
+
+    int samples;
+    uint32_t full_mask;
+
+    /**
+     * The pixels that may have a sample in the triangle, clipped to the render target ([x_min, x_max) and [y_min, y_max))
+     */
+    int x_min; int y_min;
+    int x_max; int y_max;
+
+    bool valid;
+};
+
+
+template<class SpanVisitor>
+void coverage_rasterizer::for_each_span(SpanVisitor &&visit) const
+{
+    if (!this->valid)
+        return;
+
+    const int bs = block_size;
+    const int bx_start = this->x_min & ~(bs - 1);
+    const int by_start = this->y_min & ~(bs - 1);
+    const int64_t step = subpixel_scale;
+
+    // how much each edge function can grow (or shrink) from the pixel center of the block origin
+    // to the samples of the other pixels of the block
+    int64_t max_offset[3], min_offset[3];
+    for (int e = 0; e < 3; e++) {
+        max_offset[e] = (std::max<int64_t>(a[e], 0) + std::max<int64_t>(b[e], 0)) * step * (bs - 1) + max_sample_offset[e];
+        min_offset[e] = (std::min<int64_t>(a[e], 0) + std::min<int64_t>(b[e], 0)) * step * (bs - 1) + min_sample_offset[e];
+    }
+
+    uint32_t masks[block_size];
+
+    // edge functions at the center of the first pixel of the current block row
+    int64_t row[3];
+    for (int e = 0; e < 3; e++)
+        row[e] = a[e] * bx_start * step + b[e] * by_start * step + c[e];
+
+    for (int by = by_start; by < this->y_max; by += bs) {
+        int64_t e0 = row[0], e1 = row[1], e2 = row[2];
+        const int y_begin = std::max(by, this->y_min);
+        const int y_end = std::min(by + bs, this->y_max);
+
+        for (int bx = bx_start; bx < this->x_max; bx += bs, e0 += a[0] * step * bs, e1 += a[1] * step * bs, e2 += a[2] * step * bs) {
+            // trivial reject, one edge function is negative for all the samples of the block
+            if (e0 + max_offset[0] < 0 || e1 + max_offset[1] < 0 || e2 + max_offset[2] < 0)
+                continue;
+
+            const int x_begin = std::max(bx, this->x_min);
+            const int x_end = std::min(bx + bs, this->x_max);
+
+            // trivial accept, all edge functions are positive for all the samples of the block
+            if (e0 + min_offset[0] >= 0 && e1 + min_offset[1] >= 0 && e2 + min_offset[2] >= 0) {
+                std::fill(masks, masks + bs, this->full_mask);
+                for (int y = y_begin; y < y_end; y++)
+                    visit(y, x_begin, x_end, static_cast<const uint32_t *>(masks));
+                continue;
+            }
+
+            // partially covered block, test the samples one pixel at a time
+            for (int y = y_begin; y < y_end; y++) {
+                const int64_t dy = (y - by) * step;
+                bool any = false;
+                for (int x = x_begin; x < x_end; x++) {
+                    const int64_t dx = (x - bx) * step;
+                    const int64_t w0 = e0 + a[0] * dx + b[0] * dy;
+                    const int64_t w1 = e1 + a[1] * dx + b[1] * dy;
+                    const int64_t w2 = e2 + a[2] * dx + b[2] * dy;
+                    uint32_t mask = 0;
+                    // all the samples of the pixel are on the same side of the edges
+                    if (w0 + min_sample_offset[0] >= 0 && w1 + min_sample_offset[1] >= 0 && w2 + min_sample_offset[2] >= 0)
+                        mask = this->full_mask;
+                    else if (w0 + max_sample_offset[0] >= 0 && w1 + max_sample_offset[1] >= 0 && w2 + max_sample_offset[2] >= 0) {
+                        for (int s = 0; s < this->samples; s++) {
+                            // a sample is outside if the sign bit of one of its edge functions is set
+                            int64_t inside = (w0 + sample_offset[0][s]) | (w1 + sample_offset[1][s]) | (w2 + sample_offset[2][s]);
+                            mask |= uint32_t(inside >= 0) << s;
+                        }
+                    }
+                    masks[x - x_begin] = mask;
+                    any |= mask != 0;
+                }
+                if (any)
+                    visit(y, x_begin, x_end, static_cast<const uint32_t *>(masks));
+            }
+        }
+
+        for (int e = 0; e < 3; e++)
+            row[e] += b[e] * step * bs;
+    }
+}
+
+#endif
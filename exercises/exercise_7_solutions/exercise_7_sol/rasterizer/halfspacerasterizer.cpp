@@ -0,0 +1,83 @@
+#include "halfspacerasterizer.h"
+
+/*
+ * \class halfspace_rasterizer
+ * A class which scanconverts a triangle by evaluating its three edge functions over the bounding box.
+ */
+
+/*
+ * Parameterized constructor creates an instance of a half-space triangle rasterizer
+ * \param x1 - the x-coordinate of the first vertex
+ * \param y1 - the y-coordinate of the first vertex
+ * \param x2 - the x-coordinate of the second vertex
+ * \param y2 - the y-coordinate of the second vertex
+ * \param x3 - the x-coordinate of the third vertex
+ * \param y3 - the y-coordinate of the third vertex
+ * \param width - the width of the render target, pixels outside [0, width) are not generated
+ * \param height - the height of the render target, pixels outside [0, height) are not generated
+ */
+halfspace_rasterizer::halfspace_rasterizer(int x1, int y1, int x2, int y2, int x3, int y3, int width, int height)
+        : valid(false)
+{
+    this->initialize_triangle(x1, y1, x2, y2, x3, y3, width, height);
+}
+
+/*
+ * Checks if the triangle may cover any pixel of the render target
+ * \return false if the triangle is degenerate or outside of the render target, else true is returned
+ */
+bool halfspace_rasterizer::more_fragments() const
+{
+    return this->valid;
+}
+
+/*
+ * Initializes the edge functions and the bounding box of the triangle
+ */
+void halfspace_rasterizer::initialize_triangle(int x1, int y1, int x2, int y2, int x3, int y3, int width, int height)
+{
+    // twice the signed area of the triangle, positive if the vertices are in counterclockwise order
+    int area = (x2 - x1) * (y3 - y1) - (y2 - y1) * (x3 - x1);
+    if (area == 0) {
+        // degenerate triangle, triangle_rasterizer does not draw these either
+        this->valid = false;
+        return;
+    }
+
+    // the edge functions are positive on the left of each edge, so the vertices must be in counterclockwise order
+    if (area < 0) {
+        std::swap(x2, x3);
+        std::swap(y2, y3);
+    }
+
+    this->initialize_edge(0, x1, y1, x2, y2);
+    this->initialize_edge(1, x2, y2, x3, y3);
+    this->initialize_edge(2, x3, y3, x1, y1);
+
+    // the right and top pixels of the bounding box are never inside (fill rule)
+    this->x_min = std::max(std::min(x1, std::min(x2, x3)), 0);
+    this->y_min = std::max(std::min(y1, std::min(y2, y3)), 0);
+    this->x_max = std::min(std::max(x1, std::max(x2, x3)), width);
+    this->y_max = std::min(std::max(y1, std::max(y2, y3)), height);
+
+    this->valid = (this->x_min < this->x_max && this->y_min < this->y_max);
+}
+
+/*
+ * Initializes the edge function of the edge from (x1, y1) to (x2, y2)
+ * \param e - the index of the edge
+ */
+void halfspace_rasterizer::initialize_edge(int e, int x1, int y1, int x2, int y2)
+{
+    // E(x, y) = (x2 - x1) * (y - y1) - (y2 - y1) * (x - x1)
+    this->a[e] = y1 - y2;
+    this->b[e] = x2 - x1;
+    this->c[e] = x1 * y2 - x2 * y1;
+
+    // in a counterclockwise triangle, left edges point down and bottom edges point right.
+    // Pixels exactly on these edges are inside, pixels exactly on the other edges are outside,
+    // and since E is an integer we move these to the outside by subtracting one.
+    bool left_or_bottom = (y2 < y1) || (y2 == y1 && x2 > x1);
+    if (!left_or_bottom)
+        this->c[e] -= 1;
+}
@@ -0,0 +1,214 @@
+#ifndef __HALFSPACE_RASTERIZER_H__
+#define __HALFSPACE_RASTERIZER_H__
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HALFSPACE_RASTERIZER_SSE2
+#include <emmintrin.h>
+#endif
+
+/**
+ * \class halfspace_rasterizer
+ * A class which scanconverts a triangle by evaluating its three edge functions over the bounding box.
+ * The bounding box is traversed in blocks of 4x4 pixels, blocks that are completely outside of the triangle
+ * are rejected and blocks that are completely inside are accepted without testing the individual pixels.
+ * The remaining blocks are tested one row of 4 pixels at a time (with SSE2 when available).
+ *
+ * The coverage is the same as the one of triangle_rasterizer: a pixel (x, y) is inside if it is on the
+ * left edge or to the right of it, strictly to the left of the right edge, and in the rows [y_min, y_max).
+ * This is the top-left fill rule for a window whose y-axis points up, so pixels shared by two triangles
+ * are drawn only once.
+ *
+ * Covered pixels are reported as horizontal spans to a visitor, so no memory is allocated per triangle.
+ */
+class halfspace_rasterizer {
+public:
+    /**
+     * The size, in pixels, of the side of the square blocks used to traverse the bounding box
+     */
+    static const int block_size = 4;
+
+    /**
+     * Parameterized constructor creates an instance of a half-space triangle rasterizer
+     * \param x1 - the x-coordinate of the first vertex
+     * \param y1 - the y-coordinate of the first vertex
+     * \param x2 - the x-coordinate of the second vertex
+     * \param y2 - the y-coordinate of the second vertex
+     * \param x3 - the x-coordinate of the third vertex
+     * \param y3 - the y-coordinate of the third vertex
+     * \param width - the width of the render target, pixels outside [0, width) are not generated
+     * \param height - the height of the render target, pixels outside [0, height) are not generated
+     */
+    halfspace_rasterizer(int x1, int y1, int x2, int y2, int x3, int y3, int width, int height);
+
+    /**
+     * Checks if the triangle may cover any pixel of the render target
+     * \return false if the triangle is degenerate or outside of the render target, else true is returned
+     */
+    bool more_fragments() const;
+
+    /**
+     * Visits all the pixels inside the triangle, one horizontal span at a time.
+     * The visitor is called as visit(y, x_begin, x_end) for the pixels [x_begin, x_end) of the row y.
+     * A row of the triangle may be reported as several consecutive spans, one per block.
+     * \param visit - the function object which receives the spans
+     */
+    template<class SpanVisitor>
+    void for_each_span(SpanVisitor &&visit) const;
+
+    /**
+     * Visits all the pixels inside the triangle, one horizontal span at a time, and lets the caller skip blocks.
+     * Before the spans of a block are visited, the block test is called as accept_block(bx, by) with the
+     * origin of the block (a multiple of block_size). If it returns false, the spans of the block are not visited.
+     * Blocks that do not overlap the triangle are rejected before the block test is called.
+     * \param visit - the function object which receives the spans
+     * \param accept_block - the function object which decides if a block is rasterized (e.g. a coarse depth test)
+     */
+    template<class SpanVisitor, class BlockTest>
+    void for_each_span(SpanVisitor &&visit, BlockTest &&accept_block) const;
+
+private:
+
+    /**
+     * Initializes the edge functions and the bounding box of the triangle
+     */
+    void initialize_triangle(int x1, int y1, int x2, int y2, int x3, int y3, int width, int height);
+
+    /**
+     * Initializes the edge function of the edge from (x1, y1) to (x2, y2)
+     * \param e - the index of the edge
+     */
+    void initialize_edge(int e, int x1, int y1, int x2, int y2);
+
+    /**
+     * The edge functions E(x, y) = a * x + b * y + c, which are >= 0 for the pixels inside the triangle.
+     * The fill rule is already included in c.
+     */
+    int a[3];
+    int b[3];
+    int c[3];
+
+    /**
+     * The bounding box of the triangle clipped to the render target ([x_min, x_max) and [y_min, y_max))
+     */
+    int x_min; int y_min;
+    int x_max; int y_max;
+
+    bool valid;
+};
+
+
+template<class SpanVisitor>
+void halfspace_rasterizer::for_each_span(SpanVisitor &&visit) const
+{
+    this->for_each_span(visit, [](int, int) { return true; });
+}
+
+
+template<class SpanVisitor, class BlockTest>
+void halfspace_rasterizer::for_each_span(SpanVisitor &&visit, BlockTest &&accept_block) const
+{
+    if (!this->valid)
+        return;
+
+    const int bs = block_size;
+    const int bx_start = this->x_min & ~(bs - 1);
+    const int by_start = this->y_min & ~(bs - 1);
+
+    // how much each edge function can grow (or shrink) from the block origin to the other pixels of the block
+    int max_offset[3], min_offset[3];
+    for (int e = 0; e < 3; e++) {
+        max_offset[e] = (std::max(a[e], 0) + std::max(b[e], 0)) * (bs - 1);
+        min_offset[e] = (std::min(a[e], 0) + std::min(b[e], 0)) * (bs - 1);
+    }
+
+#ifdef HALFSPACE_RASTERIZER_SSE2
+    // edge function offsets of the 4 pixels in a block row
+    const __m128i lane_a0 = _mm_set_epi32(3 * a[0], 2 * a[0], a[0], 0);
+    const __m128i lane_a1 = _mm_set_epi32(3 * a[1], 2 * a[1], a[1], 0);
+    const __m128i lane_a2 = _mm_set_epi32(3 * a[2], 2 * a[2], a[2], 0);
+    const __m128i step_b0 = _mm_set1_epi32(b[0]);
+    const __m128i step_b1 = _mm_set1_epi32(b[1]);
+    const __m128i step_b2 = _mm_set1_epi32(b[2]);
+#endif
+
+    // edge functions at the origin of the first block of the current block row
+    int row0 = a[0] * bx_start + b[0] * by_start + c[0];
+    int row1 = a[1] * bx_start + b[1] * by_start + c[1];
+    int row2 = a[2] * bx_start + b[2] * by_start + c[2];
+
+    for (int by = by_start; by < this->y_max; by += bs) {
+        int e0 = row0, e1 = row1, e2 = row2;
+        const int y_begin = std::max(by, this->y_min);
+        const int y_end = std::min(by + bs, this->y_max);
+
+        for (int bx = bx_start; bx < this->x_max; bx += bs, e0 += a[0] * bs, e1 += a[1] * bs, e2 += a[2] * bs) {
+            // trivial reject, one edge function is negative in the whole block
+            if (e0 + max_offset[0] < 0 || e1 + max_offset[1] < 0 || e2 + max_offset[2] < 0)
+                continue;
+
+            // rejected by the caller
+            if (!accept_block(bx, by))
+                continue;
+
+            const int x_begin = std::max(bx, this->x_min);
+            const int x_end = std::min(bx + bs, this->x_max);
+
+            // trivial accept, all edge functions are positive in the whole block
+            if (e0 + min_offset[0] >= 0 && e1 + min_offset[1] >= 0 && e2 + min_offset[2] >= 0) {
+                for (int y = y_begin; y < y_end; y++)
+                    visit(y, x_begin, x_end);
+                continue;
+            }
+
+            // partially covered block, test the pixels one row at a time
+            // the pixels inside the triangle in one row are always contiguous
+            const int x_mask = ((1 << (x_end - bx)) - 1) & ~((1 << (x_begin - bx)) - 1);
+#ifdef HALFSPACE_RASTERIZER_SSE2
+            const int dy = y_begin - by;
+            __m128i w0 = _mm_add_epi32(_mm_set1_epi32(e0 + b[0] * dy), lane_a0);
+            __m128i w1 = _mm_add_epi32(_mm_set1_epi32(e1 + b[1] * dy), lane_a1);
+            __m128i w2 = _mm_add_epi32(_mm_set1_epi32(e2 + b[2] * dy), lane_a2);
+            for (int y = y_begin; y < y_end; y++) {
+                // a pixel is outside if the sign bit of one of its edge functions is set
+                __m128i outside = _mm_or_si128(_mm_or_si128(w0, w1), w2);
+                int mask = ~_mm_movemask_ps(_mm_castsi128_ps(outside)) & x_mask;
+                if (mask) {
+                    int first = 0, last = bs;
+                    while (!(mask & (1 << first))) first++;
+                    while (!(mask & (1 << (last - 1)))) last--;
+                    visit(y, bx + first, bx + last);
+                }
+                w0 = _mm_add_epi32(w0, step_b0);
+                w1 = _mm_add_epi32(w1, step_b1);
+                w2 = _mm_add_epi32(w2, step_b2);
+            }
+#else
+            for (int y = y_begin; y < y_end; y++) {
+                const int dy = y - by;
+                int mask = 0;
+                for (int i = 0; i < bs; i++) {
+                    int w0 = e0 + a[0] * i + b[0] * dy;
+                    int w1 = e1 + a[1] * i + b[1] * dy;
+                    int w2 = e2 + a[2] * i + b[2] * dy;
+                    mask |= ((w0 | w1 | w2) >= 0) << i;
+                }
+                mask &= x_mask;
+                if (mask) {
+                    int first = 0, last = bs;
+                    while (!(mask & (1 << first))) first++;
+                    while (!(mask & (1 << (last - 1)))) last--;
+                    visit(y, bx + first, bx + last);
+                }
+            }
+#endif
+        }
+
+        row0 += b[0] * bs;
+        row1 += b[1] * bs;
+        row2 += b[2] * bs;
+    }
+}
+
+#endif
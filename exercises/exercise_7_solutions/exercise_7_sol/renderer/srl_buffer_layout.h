@@ -0,0 +1,93 @@
+//
+// Memory layouts of the Software Render Library frame buffers.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_SRL_BUFFER_LAYOUT_H
+#define ITU_GRAPHICS_PROGRAMMING_SRL_BUFFER_LAYOUT_H
+
+#include <cstring>
+#include <algorithm>
+
+namespace srl {
+
+    // A layout tells where the pixel (x, y) of a W x H buffer is stored, it is a template parameter of the buffers
+    // and of the renderers. Every layout provides:
+    //
+    // - size(W, H): the number of elements the buffer must allocate
+    // - index(x, y, W): the position of the pixel (x, y) in the buffer
+    // - toLinear(src, dst, W, H): copies a buffer to dst with the linear layout (e.g. to upload it with glTexImage2D)
+    namespace layouts {
+
+        // LINEAR
+        // ------
+        // rows stored one after the other, the layout expected by OpenGL
+        struct linear {
+            static unsigned int size(unsigned int W, unsigned int H) { return W * H; }
+
+            static unsigned int index(unsigned int x, unsigned int y, unsigned int W) { return x + y * W; }
+
+            template<class T>
+            static void toLinear(const T *src, T *dst, unsigned int W, unsigned int H) {
+                std::memcpy(dst, src, sizeof(T) * W * H);
+            }
+        };
+
+        // TILED
+        // -----
+        // tiles of 8x8 pixels stored one after the other (one row of tiles at a time), and the pixels of a tile in
+        // Morton (Z) order, so that pixels close in x and y are close in memory. The buffer is padded to full tiles.
+        // A triangle touches fewer cache lines than with the linear layout, where the pixels of the rows of a small
+        // region are W pixels apart.
+        struct tiled {
+            static const unsigned int tileSize = 8;
+            static const unsigned int tilePixels = tileSize * tileSize;
+
+            static unsigned int tilesW(unsigned int W) { return (W + tileSize - 1) / tileSize; }
+            static unsigned int tilesH(unsigned int H) { return (H + tileSize - 1) / tileSize; }
+
+            static unsigned int size(unsigned int W, unsigned int H) { return tilesW(W) * tilesH(H) * tilePixels; }
+
+            // Morton order: the bits of x and y inside the tile are interleaved (x0 y0 x1 y1 x2 y2)
+            static unsigned int mortonX(unsigned int x) { return (x & 1u) | ((x & 2u) << 1) | ((x & 4u) << 2); }
+            static unsigned int mortonY(unsigned int y) { return ((y & 1u) << 1) | ((y & 2u) << 2) | ((y & 4u) << 3); }
+
+            static unsigned int index(unsigned int x, unsigned int y, unsigned int W) {
+                unsigned int tile = (y / tileSize) * tilesW(W) + x / tileSize;
+                return tile * tilePixels + (mortonX(x % tileSize) | mortonY(y % tileSize));
+            }
+
+            template<class T>
+            static void toLinear(const T *src, T *dst, unsigned int W, unsigned int H) {
+                unsigned int tw = tilesW(W), th = tilesH(H);
+                for (unsigned int ty = 0; ty < th; ty++) {
+                    // tileSize + 0 is a copy, std::min takes references and tileSize has no definition to refer to
+                    unsigned int rows = std::min(tileSize + 0, H - ty * tileSize);
+                    for (unsigned int tx = 0; tx < tw; tx++) {
+                        const T *tile = src + (ty * tw + tx) * tilePixels;
+                        T *out = dst + ty * tileSize * W + tx * tileSize;
+                        if (tx * tileSize + tileSize <= W) {
+                            // complete row of a tile: in Morton order, pixels 2x and 2x+1 of a row are next to
+                            // each other, so a row is copied as 4 pairs (0, 1), (4, 5), (16, 17) and (20, 21)
+                            for (unsigned int r = 0; r < rows; r++, out += W) {
+                                const T *in = tile + mortonY(r);
+                                std::memcpy(out, in, 2 * sizeof(T));
+                                std::memcpy(out + 2, in + 4, 2 * sizeof(T));
+                                std::memcpy(out + 4, in + 16, 2 * sizeof(T));
+                                std::memcpy(out + 6, in + 20, 2 * sizeof(T));
+                            }
+                        }
+                        else {
+                            // tile at the right border of the buffer
+                            unsigned int cols = W - tx * tileSize;
+                            for (unsigned int r = 0; r < rows; r++, out += W)
+                                for (unsigned int c = 0; c < cols; c++)
+                                    out[c] = tile[mortonX(c) | mortonY(r)];
+                        }
+                    }
+                }
+            }
+        };
+    }
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_SRL_BUFFER_LAYOUT_H
@@ -0,0 +1,178 @@
+//
+// Depth buffer of the Software Render Library, with a coarse (per tile) summary of its content.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_SRL_DEPTH_BUFFER_H
+#define ITU_GRAPHICS_PROGRAMMING_SRL_DEPTH_BUFFER_H
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include "srl_buffer_layout.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SRL_DEPTH_BUFFER_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace srl {
+
+    // DEPTH BUFFER
+    // ------------
+    // the pixels are stored like in CustomFrameBuffer<float, Layout>, and the buffer is also divided in tiles of
+    // tileSize x tileSize pixels. For each tile we keep the smallest and largest depth stored in it, so that the
+    // rasterizer can skip the parts of a triangle that are behind everything already drawn in a tile (hierarchical
+    // z-buffer), and a cleared flag, so that clearing the buffer only touches the tiles. The pixels of a cleared tile
+    // are only filled when it is written to.
+    template<class Layout = layouts::linear>
+    class DepthBufferT {
+    public:
+        static const unsigned int tileSize = 8;
+
+        unsigned int W, H;
+        // number of tiles in a row and in a column of the buffer
+        unsigned int tilesW, tilesH;
+        // depth of the pixels, the values in cleared tiles are outdated (use valueAt, or prepareTileWrite before accessing)
+        float *buffer;
+
+        DepthBufferT(unsigned int width, unsigned int height): W(width), H(height),
+                tilesW((width + tileSize - 1) / tileSize), tilesH((height + tileSize - 1) / tileSize) {
+            buffer = new float[Layout::size(W, H)];
+            m_tiles.resize(tilesW * tilesH);
+            clearBuffer(1.0f);
+        }
+
+        ~DepthBufferT(){delete[] buffer;} // clean our memory
+
+        DepthBufferT(const DepthBufferT &) = delete;
+        DepthBufferT &operator=(const DepthBufferT &) = delete;
+
+        // only the tiles are cleared, the cost does not depend on the number of pixels
+        void clearBuffer(float value){
+            m_clearValue = value;
+            for (auto &t : m_tiles)
+                t = tile{value, value, true, false};
+        }
+
+        void paintAt(unsigned int x, unsigned int y, float value){
+            assert (x < W && y < H);
+            unsigned int tx = x / tileSize, ty = y / tileSize;
+            prepareTileWrite(tx, ty);
+            buffer[Layout::index(x, y, W)] = value;
+            tile &t = m_tiles[tx + ty * tilesW];
+            t.minDepth = std::min(t.minDepth, value);
+            t.maxDepth = std::max(t.maxDepth, value);
+            t.dirty = true;
+        }
+
+        float valueAt(unsigned int x, unsigned int y) const {
+            assert (x < W && y < H);
+            if (m_tiles[(x / tileSize) + (y / tileSize) * tilesW].cleared)
+                return m_clearValue;
+            return buffer[Layout::index(x, y, W)];
+        }
+
+        // test if a fragment at depth (or farther) would fail the depth test in every pixel of the tile (tx, ty)
+        bool isHidden(unsigned int tx, unsigned int ty, float depth){
+            assert (tx < tilesW && ty < tilesH);
+            tile &t = m_tiles[tx + ty * tilesW];
+            // the maximum of a tile is never smaller than the depth of its pixels,
+            // it is only larger if the tile has been written to after the maximum was computed
+            if (depth > t.maxDepth)
+                return true;
+            // in front of the closest pixel, the test fails whatever the actual maximum is
+            if (!t.dirty || depth <= t.minDepth)
+                return false;
+
+            // recompute the maximum, only when it can change the result of the test
+            t.maxDepth = computeTileMax(tx, ty);
+            t.dirty = false;
+            return depth > t.maxDepth;
+        }
+
+        // must be called before reading or writing the pixels of the tile (tx, ty) through buffer,
+        // fills the pixels of the tile if it is cleared
+        void prepareTileWrite(unsigned int tx, unsigned int ty){
+            assert (tx < tilesW && ty < tilesH);
+            tile &t = m_tiles[tx + ty * tilesW];
+            if (t.cleared) {
+                tile_memory mem = tileMemory(tx, ty, Layout());
+                for (unsigned int r = 0; r < mem.runs; r++)
+                    std::fill(mem.first + r * mem.stride, mem.first + r * mem.stride + mem.length, m_clearValue);
+                t.cleared = false;
+            }
+        }
+
+        // must be called after writing smaller depth values to the tile (tx, ty) through buffer,
+        // minWritten is the smallest of the values written
+        void markTileWritten(unsigned int tx, unsigned int ty, float minWritten){
+            assert (tx < tilesW && ty < tilesH);
+            tile &t = m_tiles[tx + ty * tilesW];
+            t.minDepth = std::min(t.minDepth, minWritten);
+            t.dirty = true;
+        }
+
+    private:
+        // the pixels of a tile are stored in runs of length contiguous values, stride values apart
+        struct tile_memory {
+            float *first;
+            unsigned int runs, length, stride;
+        };
+
+        // one run per row of the tile
+        tile_memory tileMemory(unsigned int tx, unsigned int ty, layouts::linear) const {
+            unsigned int x0 = tx * tileSize, y0 = ty * tileSize;
+            // std::min takes references, and tileSize has no definition to refer to
+            unsigned int size = tileSize;
+            return tile_memory{buffer + x0 + y0 * W, std::min(size, H - y0), std::min(size, W - x0), W};
+        }
+
+        // a single run, the tiles of the layout are the tiles of the depth buffer. Tiles at the border of the buffer
+        // include pixels outside of it, which only hold the clear value
+        tile_memory tileMemory(unsigned int tx, unsigned int ty, layouts::tiled) const {
+            static_assert(layouts::tiled::tileSize == tileSize, "the tiles of the layout must be the tiles of the depth buffer");
+            return tile_memory{buffer + (tx + ty * tilesW) * layouts::tiled::tilePixels, 1, layouts::tiled::tilePixels, 0};
+        }
+
+        float computeTileMax(unsigned int tx, unsigned int ty) const {
+            tile_memory mem = tileMemory(tx, ty, Layout());
+            float maxDepth = mem.first[0];
+#ifdef SRL_DEPTH_BUFFER_SSE
+            __m128 max4 = _mm_set1_ps(maxDepth);
+#endif
+            for (unsigned int r = 0; r < mem.runs; r++) {
+                const float *run = mem.first + r * mem.stride;
+                unsigned int i = 0;
+#ifdef SRL_DEPTH_BUFFER_SSE
+                for (; i + 4 <= mem.length; i += 4)
+                    max4 = _mm_max_ps(max4, _mm_loadu_ps(run + i));
+#endif
+                for (; i < mem.length; i++)
+                    maxDepth = std::max(maxDepth, run[i]);
+            }
+#ifdef SRL_DEPTH_BUFFER_SSE
+            float lanes[4];
+            _mm_storeu_ps(lanes, max4);
+            maxDepth = std::max(std::max(maxDepth, lanes[0]), std::max(std::max(lanes[1], lanes[2]), lanes[3]));
+#endif
+            return maxDepth;
+        }
+
+        struct tile {
+            float minDepth;
+            float maxDepth;
+            // all pixels have the clear value, which has not been written to them yet
+            bool cleared;
+            // the tile has been written to, maxDepth may be larger than the actual maximum
+            bool dirty;
+        };
+
+        std::vector<tile> m_tiles;
+        float m_clearValue = 1.0f;
+    };
+
+    // depth buffer with the rows stored one after the other
+    using DepthBuffer = DepthBufferT<layouts::linear>;
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_SRL_DEPTH_BUFFER_H
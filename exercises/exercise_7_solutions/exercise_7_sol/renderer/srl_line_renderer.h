@@ -10,18 +10,33 @@
 #include "srl_renderer.h"
 #include "rasterizer/linerasterizer.h"
 #include "srl_types.h"
+#include "srl_line_setup.h"
+#include "srl_tiles.h"
 
 namespace srl {
-    class LineRenderer : public Renderer {
+    template<class Varyings, class VertexShader, class FragmentShader, class Layout = layouts::linear>
+    class LineRendererT : public RendererT<Varyings, VertexShader, FragmentShader, Layout> {
+    public:
+        // number of threads used to draw the lines, draw calls with few lines always use one
+        unsigned int m_threads = std::thread::hardware_concurrency();
+
     private:
+        using vertex_out = shaded_vertex<Varyings>;
+        using fragment = shaded_fragment<Varyings>;
+        using color_buffer = typename RendererT<Varyings, VertexShader, FragmentShader, Layout>::color_buffer;
+        using depth_buffer = typename RendererT<Varyings, VertexShader, FragmentShader, Layout>::depth_buffer;
+
+        // below this number of lines, waking the threads costs more than it saves
+        static const int minLinesPerThread = 2048;
+
         // create line primitives
-        void assemblePrimitives(const std::vector<vertex> &vts) {
+        void assemblePrimitives(const std::vector<vertex_out> &vts) {
             m_primitives.clear();
             // make sure a single allocation will happen
             m_primitives.reserve(vts.size()/3 * (wireframe ? 3 : 1));
             int increment =  wireframe ? 3 : 2;
-            for(int i = 0, size = vts.size()-1; i < size; i += increment){
-                line l;
+            for(int i = 0, size = int(vts.size()) - (wireframe ? 2 : 1); i < size; i += increment){
+                line<vertex_out> l;
                 l.v1 = vts[i];
                 l.v2 = vts[i+1];
                 m_primitives.push_back(l);
@@ -36,9 +51,31 @@ namespace srl {
             }
         }
 
-        void clipLine(line &l, int side){
-            vertex &v1 = l.v1;
-            vertex &v2 = l.v2;
+        // create line primitives from indices, in wireframe mode every three indices form a triangle
+        void assemblePrimitives(const std::vector<vertex_out> &vts, const std::vector<unsigned int> &indices) {
+            m_primitives.clear();
+            m_primitives.reserve(indices.size()/3 * (wireframe ? 3 : 1));
+            int increment =  wireframe ? 3 : 2;
+            // the last complete primitive, a triangle needs 3 indices and a line 2
+            for(int i = 0, size = int(indices.size()) - (wireframe ? 2 : 1); i < size; i += increment){
+                line<vertex_out> l;
+                l.v1 = vts[indices[i]];
+                l.v2 = vts[indices[i+1]];
+                m_primitives.push_back(l);
+                if(wireframe) {
+                    l.v1 = vts[indices[i + 1]];
+                    l.v2 = vts[indices[i + 2]];
+                    m_primitives.push_back(l);
+                    l.v1 = vts[indices[i + 2]];
+                    l.v2 = vts[indices[i]];
+                    m_primitives.push_back(l);
+                }
+            }
+        }
+
+        void clipLine(line<vertex_out> &l, int side){
+            vertex_out &v1 = l.v1;
+            vertex_out &v2 = l.v2;
 
             // index to x, y or z coordinate (x=0, y=1, z=2)
             int idx = side % 3;
@@ -71,7 +108,7 @@ namespace srl {
                 float t = (p1[idx] - p1.w * wMult) / denom;
 
                 // interpolate and update the value of one of the variables
-                vertex &vTarget = p1[idx] * wMult > p1.w ? v1 : v2;
+                vertex_out &vTarget = p1[idx] * wMult > p1.w ? v1 : v2;
                 vTarget = v1 + (v2 - v1) * t;
             }
         }
@@ -99,8 +136,8 @@ namespace srl {
 
         // normalized device coordinates to screen space
         void toScreenSpace(int width, int height)  {
-            float halfW = width / 2;
-            float halfH = height / 2;
+            float halfW = width / 2.0f;
+            float halfH = height / 2.0f;
             glm::mat4 toWindowSpace = glm::scale(glm::vec3(halfW, halfH, 1.f)) * glm::translate(glm::vec3(1.f, 1.f, 0.f));
             for(auto &line : m_primitives) {
                 line.v1.pos = toWindowSpace * line.v1.pos;
@@ -125,28 +162,154 @@ namespace srl {
                 std::vector<glm::ivec2> pixels = rasterizer.all_pixels();
 
                 // create a fragment for each pixel in the rasterization
-                for (auto &pxl : pixels){
+                for (int i = 0, size = pixels.size(); i < size; i++){
                     fragment frag;
 
-                    frag.pos = pxl;
-                    // screen space interpolation factor
-                    float interp = glm::length(glm::vec2(pxl - iv1)) / glm::length(glm::vec2(iv2 - iv1));
-                    // hyperbolic interpolation correction
-                    float hypInterp = interp * line.v2.hypInterp + (1.f-interp) * line.v1.hypInterp;
-                    // interpolate and then apply the correction
-                    frag.depth = (interp * line.v2.pos.z + (1.f-interp) * line.v1.pos.z) / hypInterp;
-                    frag.col = (interp * line.v2.col + (1.f-interp) *line.v1.col) / hypInterp;
+                    frag.pos = pixels[i];
+                    // screen space interpolation factor, each pixel is one step along the major axis of the line
+                    float interp = float(i) / float(size - 1);
+                    interpolate(line, interp, frag.depth, frag.var);
 
                     outFrs.push_back(frag);
                 }
             }
         }
 
+        // depth and varyings at interp (0 to 1) from the first to the second vertex of the line
+        static void interpolate(const line<vertex_out> &line, float interp, float &depth, Varyings &var) {
+            // hyperbolic interpolation correction
+            float hypInterp = interp * line.v2.hypInterp + (1.f-interp) * line.v1.hypInterp;
+            // interpolate and then apply the correction
+            depth = (interp * line.v2.pos.z + (1.f-interp) * line.v1.pos.z) / hypInterp;
+            var = (line.v2.var * interp + line.v1.var * (1.f-interp)) / hypInterp;
+        }
+
+        // rasterize the lines and write their fragments directly to the buffers, without storing them.
+        // The lines are set up in batches (SIMD), and large draw calls are split in screen tiles drawn by several threads
+        void rasterAndWritePrimitives(color_buffer &fb, depth_buffer &db) override {
+            // window coordinates of the visible lines, in SoA layout for the batched setup
+            m_visible.clear();
+            m_x1.clear(); m_y1.clear(); m_x2.clear(); m_y2.clear();
+            for (int i = 0, size = m_primitives.size(); i < size; i++) {
+                const line<vertex_out> &l = m_primitives[i];
+                if (l.rejected)
+                    continue;
+                m_visible.push_back(i);
+                m_x1.push_back(l.v1.pos.x); m_y1.push_back(l.v1.pos.y);
+                m_x2.push_back(l.v2.pos.x); m_y2.push_back(l.v2.pos.y);
+            }
+            int count = m_visible.size();
+            setupLines(m_x1.data(), m_y1.data(), m_x2.data(), m_y2.data(), count, m_setup);
+
+            pixel_rect screen{0, 0, int(fb.W), int(fb.H)};
+            if (count < minLinesPerThread || m_threads <= 1) {
+                for (int i = 0; i < count; i++)
+                    drawLine(i, screen, fb, db);
+                return;
+            }
+
+            m_bins.reset(fb.W, fb.H);
+            for (int i = 0; i < count; i++) {
+                if (m_setup.steps[i] == 0)
+                    continue;
+                m_bins.add(std::min(m_setup.x[i], m_setup.xEnd[i]), std::min(m_setup.y[i], m_setup.yEnd[i]),
+                           std::max(m_setup.x[i], m_setup.xEnd[i]), std::max(m_setup.y[i], m_setup.yEnd[i]), i);
+            }
+            m_pool.run(m_bins.count(), m_threads, [&](int tile){
+                pixel_rect rect = m_bins.rect(tile);
+                for (uint32_t i : m_bins.bin(tile))
+                    drawLine(i, rect, fb, db);
+            });
+        }
+
+        // draw the pixels of the visible line i that are inside rect (Bresenham, see LineRasterizer)
+        void drawLine(int i, const pixel_rect &rect, color_buffer &fb, depth_buffer &db) const {
+            const line_setups &s = m_setup;
+            int steps = s.steps[i];
+            if (steps == 0)
+                return;
+            const line<vertex_out> &l = m_primitives[m_visible[i]];
+
+            int x = s.x[i], y = s.y[i], d = s.d[i];
+            bool xMajor = s.xMajor[i] != 0, leftRight = s.leftRight[i] != 0;
+            int &major = xMajor ? x : y;
+            int &minor = xMajor ? y : x;
+            int majorStep = xMajor ? s.sx[i] : s.sy[i], minorStep = xMajor ? s.sy[i] : s.sx[i];
+            int a2major = xMajor ? s.a2dx[i] : s.a2dy[i], a2minor = xMajor ? s.a2dy[i] : s.a2dx[i];
+            int majorBegin = xMajor ? rect.x0 : rect.y0, majorEnd = xMajor ? rect.x1 : rect.y1;
+            int minorBegin = xMajor ? rect.y0 : rect.x0, minorEnd = xMajor ? rect.y1 : rect.x1;
+
+            // the line is drawn from where it enters rect to where it leaves it, rather than walked from its first
+            // pixel in every tile. Both coordinates only move in one direction, and the minor one moves once for every
+            // multiple of a2major the decision variable passes: before the decision of step j it is
+            // d + j a2minor - moves a2major, and each decision brings it back to (-a2major, 0] (to [-a2major, 0) with
+            // leftRight). So the moves of the first steps, and the first step after some moves, are divisions
+            int64_t bias = leftRight ? 0 : 1;
+            // number of moves along the minor axis during the first k steps
+            auto movesBefore = [&](int64_t k) {
+                return k <= 0 ? int64_t(0) : floorDivide(d + (k - 1) * a2minor - bias, a2major) + 1;
+            };
+            // first step whose pixel has moved count times along the minor axis (a2minor is not 0)
+            auto firstStepAfter = [&](int64_t count) {
+                if (count <= 0)
+                    return int64_t(0);
+                return 1 + std::max(-floorDivide(d - bias - (count - 1) * a2major, a2minor), int64_t(0));
+            };
+
+            int64_t first = majorStep > 0 ? majorBegin - major : major - (majorEnd - 1);
+            int64_t last = std::min<int64_t>(steps, majorStep > 0 ? majorEnd - 1 - major : major - majorBegin);
+            int64_t fewestMoves = minorStep > 0 ? minorBegin - minor : minor - (minorEnd - 1);
+            int64_t mostMoves = minorStep > 0 ? minorEnd - 1 - minor : minor - minorBegin;
+            if (a2minor == 0) {
+                if (fewestMoves > 0 || mostMoves < 0)
+                    return;
+            }
+            else {
+                first = std::max(first, firstStepAfter(fewestMoves));
+                last = std::min(last, firstStepAfter(mostMoves + 1) - 1);
+            }
+            first = std::max(first, int64_t(0));
+            if (first > last)
+                return;
+
+            int64_t moves = movesBefore(first);
+            major += int(first) * majorStep;
+            minor += int(moves) * minorStep;
+            d = int(d + first * a2minor - moves * a2major);
+            for (int step = int(first); step <= int(last); step++) {
+                float depth;
+                Varyings var;
+                interpolate(l, float(step) / float(steps), depth, var);
+                this->writeFragment(x, y, depth, var, fb, db);
+                if (d > 0 || (d == 0 && leftRight)) {
+                    minor += minorStep;
+                    d -= a2major;
+                }
+                major += majorStep;
+                d += a2minor;
+            }
+        }
+
+        // a / b rounded down, b is positive
+        static int64_t floorDivide(int64_t a, int64_t b) {
+            return a >= 0 ? a / b : -((-a + b - 1) / b);
+        }
+
         // lists of line primitives.
-        std::vector<line> m_primitives;
+        std::vector<line<vertex_out>> m_primitives;
+        // indices in m_primitives of the lines that are not rejected, and their setup
+        std::vector<int> m_visible;
+        std::vector<float> m_x1, m_y1, m_x2, m_y2;
+        line_setups m_setup;
+        TileBins m_bins;
+        // the threads that draw the tiles, kept between draw calls
+        ThreadPool m_pool;
         bool wireframe = true;
     };
 
+    // line renderer with the default shader program
+    using LineRenderer = LineRendererT<shaders::default_varyings, shaders::default_vertex_shader, shaders::default_fragment_shader>;
+
 }
 
 #endif //GRAPHICSPROGRAMMINGEXERCISES_OGLLINERENDERER_H
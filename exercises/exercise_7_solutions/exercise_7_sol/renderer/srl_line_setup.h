@@ -0,0 +1,113 @@
+//
+// Batched setup of the lines rasterized by the Software Render Library.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_SRL_LINE_SETUP_H
+#define ITU_GRAPHICS_PROGRAMMING_SRL_LINE_SETUP_H
+
+#include <vector>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SRL_LINE_SETUP_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace srl {
+
+    // Bresenham setup of many lines, in SoA layout (one array per value). The pixels are the same as the ones of
+    // LineRasterizer: line i has steps[i] + 1 pixels, from (x[i], y[i]) to (xEnd[i], yEnd[i]). Along the major axis
+    // (x if xMajor[i] is not 0, else y) every step moves one pixel, and along the minor axis the pixel moves when
+    // the decision variable d is positive (or 0 and leftRight[i] is not 0). Lines with 0 steps have no pixels.
+    struct line_setups {
+        std::vector<int32_t> x, y, xEnd, yEnd;
+        // direction of the line along x and y (1 or -1)
+        std::vector<int32_t> sx, sy;
+        // 2 |dx| and 2 |dy|, the increments of the decision variable
+        std::vector<int32_t> a2dx, a2dy;
+        std::vector<int32_t> d, steps, xMajor, leftRight;
+
+        void resize(size_t size) {
+            for (auto *v : {&x, &y, &xEnd, &yEnd, &sx, &sy, &a2dx, &a2dy, &d, &steps, &xMajor, &leftRight})
+                v->resize(size);
+        }
+    };
+
+    // set up count lines from (x1, y1) to (x2, y2) in window coordinates, the vertices are rounded like in the
+    // line renderer. With SSE2, 4 lines are set up at the same time
+    inline void setupLines(const float *x1, const float *y1, const float *x2, const float *y2, int count,
+                           line_setups &out) {
+        out.resize(count);
+        int i = 0;
+
+#ifdef SRL_LINE_SETUP_SSE2
+        const __m128 half = _mm_set1_ps(.5f);
+        const __m128i one = _mm_set1_epi32(1);
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 4 <= count; i += 4) {
+            // round to the closest pixel (truncation, the coordinates are not negative after clipping)
+            __m128i ix1 = _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(x1 + i), half));
+            __m128i iy1 = _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(y1 + i), half));
+            __m128i ix2 = _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(x2 + i), half));
+            __m128i iy2 = _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(y2 + i), half));
+
+            __m128i dx = _mm_sub_epi32(ix2, ix1);
+            __m128i dy = _mm_sub_epi32(iy2, iy1);
+            // all bits set in the lanes where the difference is negative
+            __m128i negX = _mm_srai_epi32(dx, 31);
+            __m128i negY = _mm_srai_epi32(dy, 31);
+            __m128i absX = _mm_sub_epi32(_mm_xor_si128(dx, negX), negX);
+            __m128i absY = _mm_sub_epi32(_mm_xor_si128(dy, negY), negY);
+            __m128i a2dx = _mm_slli_epi32(absX, 1);
+            __m128i a2dy = _mm_slli_epi32(absY, 1);
+            __m128i sx = _mm_or_si128(negX, one);
+            __m128i sy = _mm_or_si128(negY, one);
+
+            // x-major lanes take the first value, y-major lanes the second one
+            __m128i xMajor = _mm_cmpgt_epi32(a2dx, a2dy);
+            auto select = [&](__m128i ifX, __m128i ifY) {
+                return _mm_or_si128(_mm_and_si128(xMajor, ifX), _mm_andnot_si128(xMajor, ifY));
+            };
+            __m128i d = select(_mm_sub_epi32(a2dy, absX), _mm_sub_epi32(a2dx, absY));
+            __m128i steps = select(absX, absY);
+            __m128i leftRight = select(_mm_cmpgt_epi32(sx, zero), _mm_cmpgt_epi32(sy, zero));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&out.x[i]), ix1);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&out.y[i]), iy1);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&out.xEnd[i]), ix2);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&out.yEnd[i]), iy2);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&out.sx[i]), sx);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&out.sy[i]), sy);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&out.a2dx[i]), a2dx);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&out.a2dy[i]), a2dy);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&out.d[i]), d);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&out.steps[i]), steps);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&out.xMajor[i]), xMajor);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&out.leftRight[i]), leftRight);
+        }
+#endif
+
+        // remaining lines (or all of them without SIMD), the same as LineRasterizer::initialize_line
+        for (; i < count; i++) {
+            int ix1 = int(x1[i] + .5f), iy1 = int(y1[i] + .5f);
+            int ix2 = int(x2[i] + .5f), iy2 = int(y2[i] + .5f);
+            int dx = ix2 - ix1, dy = iy2 - iy1;
+            int absX = dx < 0 ? -dx : dx, absY = dy < 0 ? -dy : dy;
+            bool xMajor = absX > absY;
+            out.x[i] = ix1;
+            out.y[i] = iy1;
+            out.xEnd[i] = ix2;
+            out.yEnd[i] = iy2;
+            out.sx[i] = dx < 0 ? -1 : 1;
+            out.sy[i] = dy < 0 ? -1 : 1;
+            out.a2dx[i] = 2 * absX;
+            out.a2dy[i] = 2 * absY;
+            out.d[i] = xMajor ? 2 * absY - absX : 2 * absX - absY;
+            out.steps[i] = xMajor ? absX : absY;
+            out.xMajor[i] = xMajor ? -1 : 0;
+            out.leftRight[i] = (xMajor ? dx >= 0 : dy >= 0) ? -1 : 0;
+        }
+    }
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_SRL_LINE_SETUP_H
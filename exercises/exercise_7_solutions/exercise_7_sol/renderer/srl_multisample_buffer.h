@@ -0,0 +1,100 @@
+//
+// Multisample render target of the Software Render Library.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_SRL_MULTISAMPLE_BUFFER_H
+#define ITU_GRAPHICS_PROGRAMMING_SRL_MULTISAMPLE_BUFFER_H
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "glm/glm.hpp"
+#include "srl_types.h"
+
+namespace srl {
+
+    // MULTISAMPLE BUFFER
+    // ------------------
+    // color and depth of 4 or 8 samples per pixel, for multisample anti-aliasing (MSAA). The renderers test the
+    // coverage and the depth of every sample, but run the fragment shader once per pixel and write its color to all
+    // the covered samples that pass the depth test. So edges are smoothed like with supersampling, for about the
+    // shading cost of a single sample per pixel. When the frame is complete, resolve averages the samples of each
+    // pixel into a frame buffer.
+    //
+    // The samples of a pixel are stored next to each other, and they are placed in the standard 4x and 8x patterns
+    // (the ones of Direct3D and of most GPUs), which are rotated grids that sample edges at many different heights.
+    // With a single sample, at the pixel center, it is a plain render target whose triangles are rasterized with the
+    // sub-pixel precision of coverage_rasterizer instead of the vertices snapped to the pixel grid.
+    class MultisampleBuffer {
+    public:
+        unsigned int W, H;
+        int samples;
+
+        MultisampleBuffer(unsigned int width, unsigned int height, int sampleCount = 4)
+                : W(width), H(height), samples(sampleCount == 8 ? 8 : sampleCount == 1 ? 1 : 4),
+                  colors(size_t(W) * H * samples), depths(size_t(W) * H * samples) {
+            const int *offsets = sampleOffsets();
+            for (int s = 0; s < samples; s++)
+                m_offsets[s] = glm::vec2(float(offsets[2 * s]), float(offsets[2 * s + 1])) * (1.0f / offsetScale);
+        }
+
+        void clearBuffer(uint32_t color, float depth) {
+            std::fill(colors.begin(), colors.end(), color);
+            std::fill(depths.begin(), depths.end(), depth);
+        }
+
+        // the samples of pixel (x, y)
+        uint32_t *colorsAt(unsigned int x, unsigned int y) { return &colors[(size_t(x) + size_t(y) * W) * samples]; }
+        float *depthsAt(unsigned int x, unsigned int y) { return &depths[(size_t(x) + size_t(y) * W) * samples]; }
+
+        // sample offsets are in 1/16 of a pixel, the renderers scale them to the sub-pixel units of coverage_rasterizer
+        static const int offsetScale = 16;
+
+        // offsets (x, y) of the samples from the pixel center, in 1/offsetScale of a pixel
+        const int *sampleOffsets() const {
+            static const int pattern4[] = {-2, -6, 6, -2, -6, 2, 2, 6};
+            static const int pattern8[] = {1, -3, -1, 3, 5, 1, -3, -5, -5, 5, -7, -1, 3, 7, 7, -7};
+            static const int pattern1[] = {0, 0};
+            return samples == 8 ? pattern8 : samples == 1 ? pattern1 : pattern4;
+        }
+
+        // offset of sample s from the pixel center, in pixels
+        glm::vec2 sampleOffset(int s) const { return m_offsets[s]; }
+
+        // average the samples of each pixel and write them to fb, which has the same size
+        template<class Layout>
+        void resolve(CustomFrameBuffer<uint32_t, Layout> &fb) const {
+            const uint32_t *in = colors.data();
+            for (unsigned int y = 0; y < H; y++) {
+                for (unsigned int x = 0; x < W; x++, in += samples) {
+                    uint32_t first = in[0];
+                    bool uniform = true;
+                    for (int s = 1; s < samples; s++)
+                        uniform &= in[s] == first;
+                    // pixels inside of a triangle (most of them) have the same color in all samples
+                    if (uniform) {
+                        fb.buffer[Layout::index(x, y, W)] = first;
+                        continue;
+                    }
+                    uint32_t r = 0, g = 0, b = 0, a = 0;
+                    for (int s = 0; s < samples; s++) {
+                        r += in[s] & 0xffu;
+                        g += (in[s] >> 8) & 0xffu;
+                        b += (in[s] >> 16) & 0xffu;
+                        a += in[s] >> 24;
+                    }
+                    int half = samples / 2;
+                    fb.buffer[Layout::index(x, y, W)] = (r + half) / samples | ((g + half) / samples) << 8 |
+                                                        ((b + half) / samples) << 16 | ((a + half) / samples) << 24;
+                }
+            }
+        }
+
+    private:
+        std::vector<uint32_t> colors;
+        std::vector<float> depths;
+        glm::vec2 m_offsets[8];
+    };
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_SRL_MULTISAMPLE_BUFFER_H
@@ -9,25 +9,50 @@
 #include <glm/gtx/transform.hpp>
 #include "srl_renderer.h"
 #include "srl_types.h"
+#include "srl_tiles.h"
 
 namespace srl {
-    class PointRenderer : public Renderer {
+    template<class Varyings, class VertexShader, class FragmentShader, class Layout = layouts::linear>
+    class PointRendererT : public RendererT<Varyings, VertexShader, FragmentShader, Layout> {
+    public:
+        // number of threads used to draw the points, draw calls with few points always use one
+        unsigned int m_threads = std::thread::hardware_concurrency();
+
     private:
+        using vertex_out = shaded_vertex<Varyings>;
+        using fragment = shaded_fragment<Varyings>;
+        using color_buffer = typename RendererT<Varyings, VertexShader, FragmentShader, Layout>::color_buffer;
+        using depth_buffer = typename RendererT<Varyings, VertexShader, FragmentShader, Layout>::depth_buffer;
+
+        // below this number of points, waking the threads costs more than it saves
+        static const int minPointsPerThread = 16384;
 
         // create point primitives
-        void assemblePrimitives(const std::vector<vertex> &vts) override {
+        void assemblePrimitives(const std::vector<vertex_out> &vts) override {
             m_primitives.clear();
             // preallocate
             m_primitives.reserve(vts.size());
 
             for(int i = 0, size = vts.size()-1; i < size; i ++){
-                point p;
+                point<vertex_out> p;
                 p.v1 = vts[i];
                 m_primitives.push_back(p);
             }
         }
 
-        static void clipPoint(point &p, int side){
+        // create point primitives, one for each index
+        void assemblePrimitives(const std::vector<vertex_out> &vts, const std::vector<unsigned int> &indices) override {
+            m_primitives.clear();
+            m_primitives.reserve(indices.size());
+
+            for(unsigned int idx : indices){
+                point<vertex_out> p;
+                p.v1 = vts[idx];
+                m_primitives.push_back(p);
+            }
+        }
+
+        static void clipPoint(point<vertex_out> &p, int side){
             // index to x, y or z coordinate (x=0, y=1, z=2)
             int idx = side % 3;
             // we check if the variable is in the range of the clipping plane using w
@@ -66,8 +91,8 @@ namespace srl {
 
         // normalized device coordinates to screen space
         void toScreenSpace(int width, int height) override  {
-            float halfW = width / 2;
-            float halfH = height / 2;
+            float halfW = width / 2.0f;
+            float halfH = height / 2.0f;
             glm::mat4 toWindowSpace = glm::scale(glm::vec3(halfW, halfH, 1.f)) * glm::translate(glm::vec3(1.f, 1.f, 0.f));
             for(auto &p : m_primitives) {
                 p.v1.pos = toWindowSpace * p.v1.pos;
@@ -86,18 +111,62 @@ namespace srl {
                 fragment frag{};
                 frag.pos = glm::ivec2(p.v1.pos.x + .5f, p.v1.pos.y + .5f);
                 frag.depth = p.v1.pos.z;
-                frag.col = p.v1.col;
-                frag.norm = p.v1.norm;
-                frag.uv = p.v1.uv;
+                frag.var = p.v1.var;
 
                 outFrs.push_back(frag);
             }
         }
 
+        // splat the points directly to the buffers, without storing fragments.
+        // Large draw calls are split in screen tiles drawn by several threads
+        void rasterAndWritePrimitives(color_buffer &fb, depth_buffer &db) override {
+            // pixels of the visible points, points that round to a pixel outside the buffers are discarded here
+            m_visible.clear();
+            m_pixels.clear();
+            for (int i = 0, size = m_primitives.size(); i < size; i++) {
+                const point<vertex_out> &p = m_primitives[i];
+                glm::ivec2 pos(p.v1.pos.x + .5f, p.v1.pos.y + .5f);
+                if (p.rejected || pos.x < 0 || pos.x >= int(fb.W) || pos.y < 0 || pos.y >= int(fb.H))
+                    continue;
+                m_visible.push_back(i);
+                m_pixels.push_back(pos);
+            }
+            int count = m_visible.size();
+
+            if (count < minPointsPerThread || m_threads <= 1) {
+                for (int i = 0; i < count; i++)
+                    drawPoint(i, fb, db);
+                return;
+            }
+
+            m_bins.reset(fb.W, fb.H);
+            for (int i = 0; i < count; i++)
+                m_bins.add(m_pixels[i].x, m_pixels[i].y, m_pixels[i].x, m_pixels[i].y, i);
+            m_pool.run(m_bins.count(), m_threads, [&](int tile){
+                for (uint32_t i : m_bins.bin(tile))
+                    drawPoint(i, fb, db);
+            });
+        }
+
+        // depth test, shade and write the visible point i
+        void drawPoint(int i, color_buffer &fb, depth_buffer &db) const {
+            const point<vertex_out> &p = m_primitives[m_visible[i]];
+            this->writeFragment(m_pixels[i].x, m_pixels[i].y, p.v1.pos.z, p.v1.var, fb, db);
+        }
+
 
         // lists of point primitives, part of the class so that we avoid reallocating memory every frame
-        std::vector<point> m_primitives;
+        std::vector<point<vertex_out>> m_primitives;
+        // indices in m_primitives of the points inside the buffers, and their pixels
+        std::vector<int> m_visible;
+        std::vector<glm::ivec2> m_pixels;
+        TileBins m_bins;
+        // the threads that draw the tiles, kept between draw calls
+        ThreadPool m_pool;
     };
 
+    // point renderer with the default shader program
+    using PointRenderer = PointRendererT<shaders::default_varyings, shaders::default_vertex_shader, shaders::default_fragment_shader>;
+
 }
 #endif //ITU_GRAPHICS_PROGRAMMING_SRL_POINT_RENDERER_H
@@ -9,46 +9,174 @@
 #include <algorithm>
 #include "glm/glm.hpp"
 #include "srl_types.h"
+#include "srl_shaders.h"
+#include "srl_vertex_transform.h"
+#include "srl_depth_buffer.h"
+#include "srl_multisample_buffer.h"
 
 
 namespace srl {
-    class Renderer {
+    // the base class of the renderers, it is templated on the shader program (see srl_shaders.h),
+    // so that the shaders are inlined in the pipeline and only the declared varyings are clipped and interpolated,
+    // and on the memory layout of the frame buffers (see srl_buffer_layout.h)
+    template<class Varyings, class VertexShader, class FragmentShader, class Layout = layouts::linear>
+    class RendererT {
+        static_assert(!(is_batched<FragmentShader>::value && is_positioned<FragmentShader>::value),
+                      "a fragment shader cannot be both batched and positioned");
 
     public:
+        // the buffers the renderer draws to
+        using color_buffer = CustomFrameBuffer<uint32_t, Layout>;
+        using depth_buffer = DepthBufferT<Layout>;
+
+        // the vertex and fragment shaders, their members can be used to set uniforms
+        VertexShader vertexShader;
+        FragmentShader fragmentShader;
 
         // render vertices with mvp transformation in the fb framebuffer
         void render(const std::vector<vertex> &vts,
                             const glm::mat4 &m,
                             const glm::mat4 &vp,
-                            CustomFrameBuffer <uint32_t> &fb,
-                            CustomFrameBuffer <float> &db) {
+                            color_buffer &fb,
+                            depth_buffer &db) {
 
             // TODO exercise 7 / assignment 3
             //  to make the Software Render Library work, you have to call all methods
             //  in this class, in the right order and with the right parameters.
 
-            std::vector<vertex> _vts = vts; // copy all vertices from vts to _vts (since vts is a const)
-            std::vector<fragment> _frs;    // vector that will store the fragments
-            glm::mat4 modelViewProjection = vp * m; // the matrix that transform points from local space to clipping space
+            uniforms u{m, vp, vp * m}; // the model view projection matrix transform points from local space to clipping space
 
-            processVertices(modelViewProjection, _vts);
-            assemblePrimitives(_vts);
-            clipPrimitives();
-            divideByW();
-            toScreenSpace(fb.W, fb.H);
-            backfaceCulling();
-            rasterPrimitives(_frs);
-            processFragments(_frs);
-            writeToFrameBuffer(_frs, fb, db);
+            processVertices(u, vts); // transformed vertices are stored in m_vertices
+            assemblePrimitives(m_vertices);
+            renderPrimitives(fb, db);
 
             //  MIND THAT THE METHODS BELOW ARE NOT DECLARED/DEFINED IN THE RIGHT ORDER!
 
         }
 
-        virtual ~Renderer(){};
+        // render indexed vertices with mvp transformation in the fb framebuffer
+        // every group of three (triangles), two (lines) or one (points) indices in indices forms a primitive,
+        // vertices shared by several primitives are only transformed once
+        void render(const std::vector<vertex> &vts,
+                    const std::vector<unsigned int> &indices,
+                    const glm::mat4 &m,
+                    const glm::mat4 &vp,
+                    color_buffer &fb,
+                    depth_buffer &db) {
+
+            uniforms u{m, vp, vp * m};
+
+            processVertices(u, vts, indices);
+            assemblePrimitives(m_vertices, indices);
+            renderPrimitives(fb, db);
+        }
+
+        // render vertices with mvp transformation in the multisample buffer msb, with one depth test per sample.
+        // The image is only in the frame buffer after msb.resolve, once all the draw calls of the frame are done
+        void render(const std::vector<vertex> &vts,
+                    const glm::mat4 &m,
+                    const glm::mat4 &vp,
+                    MultisampleBuffer &msb) {
+            uniforms u{m, vp, vp * m};
+
+            processVertices(u, vts);
+            assemblePrimitives(m_vertices);
+            renderPrimitives(msb);
+        }
+
+        // render indexed vertices with mvp transformation in the multisample buffer msb
+        void render(const std::vector<vertex> &vts,
+                    const std::vector<unsigned int> &indices,
+                    const glm::mat4 &m,
+                    const glm::mat4 &vp,
+                    MultisampleBuffer &msb) {
+            uniforms u{m, vp, vp * m};
+
+            processVertices(u, vts, indices);
+            assemblePrimitives(m_vertices, indices);
+            renderPrimitives(msb);
+        }
+
+        // when true, all fragments are generated and stored before being shaded and written to the frame buffer.
+        // It is slower and uses a lot of memory, but the fragments of the last frame can be inspected while debugging
+        bool m_twoPhaseRaster = false;
+
+        virtual ~RendererT(){};
+
+    protected:
+        // the types that flow through the pipeline, with the varyings of the shader program
+        using vertex_out = shaded_vertex<Varyings>;
+        using fragment = shaded_fragment<Varyings>;
+
+        // clipping outcodes of the vertices in m_vertices (see srl_vertex_transform.h)
+        std::vector<uint32_t> m_outcodes;
+
+        // run the fragment shader for a group of count fragments, whose varyings have the derivatives ddx and ddy
+        void shadeFragments(const Varyings *in, int count, const Varyings &/*ddx*/, const Varyings &/*ddy*/,
+                            Colors::color *out, std::false_type) const {
+            for (int i = 0; i < count; i++)
+                out[i] = fragmentShader(in[i]);
+        }
+
+        void shadeFragments(const Varyings *in, int count, const Varyings &ddx, const Varyings &ddy,
+                            Colors::color *out, std::true_type) const {
+            fragmentShader(in, count, ddx, ddy, out);
+        }
+
+        // depth test, shade and write the fragment at pixel (x, y), which must be inside the buffers.
+        // The buffers are accessed directly, and the coarse depth of the depth buffer tile is kept up to date
+        void writeFragment(int x, int y, float depth, const Varyings &var, color_buffer &fb, depth_buffer &db) const {
+            unsigned int tx = x / depth_buffer::tileSize, ty = y / depth_buffer::tileSize;
+            db.prepareTileWrite(tx, ty);
+            unsigned int idx = Layout::index(x, y, fb.W);
+            if (!(depth < db.buffer[idx]))
+                return;
+            fb.buffer[idx] = Colors::toRGBA32(shadePixel(var, x, y, is_positioned<FragmentShader>()));
+            db.buffer[idx] = depth;
+            db.markTileWritten(tx, ty, depth);
+        }
+
+        // run the fragment shader for a single fragment at pixel (x, y) that passed the depth test
+        Colors::color shadePixel(const Varyings &in, int /*x*/, int /*y*/, std::false_type) const {
+            return shadeFragment(in);
+        }
+
+        Colors::color shadePixel(const Varyings &in, int x, int y, std::true_type) const {
+            return fragmentShader(in, x, y);
+        }
+
     private:
 
-        virtual void assemblePrimitives(const std::vector<vertex> &vts) = 0;
+        // all the stages after primitive assembly
+        void renderPrimitives(color_buffer &fb, depth_buffer &db) {
+            setupPrimitives(fb.W, fb.H);
+            if (m_twoPhaseRaster) {
+                rasterPrimitives(m_fragments);
+                processFragments(m_fragments);
+                writeToFrameBuffer(m_fragments, fb, db);
+            }
+            else {
+                rasterAndWritePrimitives(fb, db);
+            }
+        }
+
+        // all the stages after primitive assembly, multisampled (the two phase raster is not supported)
+        void renderPrimitives(MultisampleBuffer &msb) {
+            setupPrimitives(msb.W, msb.H);
+            rasterAndWriteSamples(msb);
+        }
+
+        // the stages between primitive assembly and rasterization
+        void setupPrimitives(int width, int height) {
+            clipPrimitives();
+            divideByW();
+            toScreenSpace(width, height);
+            backfaceCulling();
+        }
+
+        virtual void assemblePrimitives(const std::vector<vertex_out> &vts) = 0;
+        // create the primitives from the vertices referenced by indices
+        virtual void assemblePrimitives(const std::vector<vertex_out> &vts, const std::vector<unsigned int> &indices) = 0;
         // performs the perspective division
 
         // remove all geometry outside the visible volume (performed in clipping space)
@@ -63,27 +191,108 @@ namespace srl {
         virtual void toScreenSpace(int width, int height) = 0;
         // generate the fragments, with final window pixel locations, used to render the primitives
         virtual void rasterPrimitives(std::vector<fragment> &outFrs) = 0;
+        // generate the fragments and depth test, shade and write each of them as soon as it is generated.
+        // Renderers that do not override this store all fragments first (same as m_twoPhaseRaster)
+        virtual void rasterAndWritePrimitives(color_buffer &fb, depth_buffer &db) {
+            rasterPrimitives(m_fragments);
+            processFragments(m_fragments);
+            writeToFrameBuffer(m_fragments, fb, db);
+        }
+
+        // multisampled version of rasterAndWritePrimitives. Renderers that do not override this generate the fragments
+        // of the pixel centers, and write them to all the samples of their pixel (no anti-aliasing)
+        virtual void rasterAndWriteSamples(MultisampleBuffer &msb) {
+            rasterPrimitives(m_fragments);
+            processFragments(m_fragments);
+            for (auto &frg : m_fragments) {
+                if (frg.pos.x < 0 || frg.pos.x >= int(msb.W) || frg.pos.y < 0 || frg.pos.y >= int(msb.H))
+                    continue;
+                uint32_t col = Colors::toRGBA32(frg.col);
+                uint32_t *colors = msb.colorsAt(frg.pos.x, frg.pos.y);
+                float *depths = msb.depthsAt(frg.pos.x, frg.pos.y);
+                for (int s = 0; s < msb.samples; s++) {
+                    if (frg.depth < depths[s]) {
+                        colors[s] = col;
+                        depths[s] = frg.depth;
+                    }
+                }
+            }
+        }
+
+        // run the vertex shader on vertex i, its clip space position has already been computed by transformPositions
+        void processVertex(const uniforms &u, const vertex &in, int i) {
+            vertex_out &out = m_vertices[i];
+            out.pos = m_clipPositions.at(i);
+            out.var = vertexShader(in, u, out.pos);
+            out.hypInterp = 1.0f;
+            // the vertex shader is allowed to move the vertex
+            if (out.pos != m_clipPositions.at(i))
+                m_outcodes[i] = outcodes::compute(out.pos);
+        }
 
         // perform vertex operations in the vertex stream (i.e. the equivalent to a vertex shader)
-        static void processVertices(const glm::mat4 &mvp, std::vector<vertex> &vInOut) {
-            for (auto &vtx : vInOut){
-                // this is the equivalent to a vertex shader
-                vtx.pos = mvp * vtx.pos;
+        void processVertices(const uniforms &u, const std::vector<vertex> &vIn) {
+            int size = vIn.size();
+            m_vertices.resize(size);
+            m_outcodes.resize(size);
+            // positions and outcodes are computed in batches (SIMD), the varyings one vertex at a time
+            transformPositions(u.modelViewProjection, vIn.data(), size, m_clipPositions, m_outcodes.data());
+            for (int i = 0; i < size; i++){
+                processVertex(u, vIn[i], i);
+            }
+        }
+
+        // perform vertex operations for indexed vertices, the vertex shader only runs for the vertices referenced by indices
+        // m_vertices works as a post-transform cache: m_vertexFrame[i] == m_frame tells that vertex i
+        // has already been transformed this frame, and can be reused by all primitives that share it
+        void processVertices(const uniforms &u, const std::vector<vertex> &vIn, const std::vector<unsigned int> &indices) {
+            m_frame++;
+            if (m_vertexFrame.size() != vIn.size() || m_frame == 0) {
+                // new vertex buffer (or the frame counter wrapped around), invalidate the whole cache
+                m_vertexFrame.assign(vIn.size(), 0);
+                m_frame = 1;
+            }
+            int size = vIn.size();
+            m_vertices.resize(size);
+            m_outcodes.resize(size);
+            // transforming all positions in batches is cheaper than transforming the referenced ones individually
+            transformPositions(u.modelViewProjection, vIn.data(), size, m_clipPositions, m_outcodes.data());
+
+            for (unsigned int idx : indices){
+                if (m_vertexFrame[idx] == m_frame)
+                    continue; // cache hit
+                m_vertexFrame[idx] = m_frame;
+                processVertex(u, vIn[idx], idx);
             }
         }
 
         // perform fragment operations in the fragment stream (i.e. fragment shader)
-        static void processFragments(std::vector<fragment>& fInOut) {
-            // fragment shader - not necessary for now since we are not modifying the color
+        void processFragments(std::vector<fragment>& fInOut) const {
             for (auto &frg : fInOut){
-                // example: uncomment this to make all fragments darker
-                // frg.col = frg.col * 0.5f;
+                frg.col = shadeFragment(frg.var);
             }
         }
 
+        // run the fragment shader for a single fragment
+        Colors::color shadeFragment(const Varyings &in) const {
+            return shadeFragment(in, is_batched<FragmentShader>());
+        }
+
+        Colors::color shadeFragment(const Varyings &in, std::false_type) const {
+            return fragmentShader(in);
+        }
+
+        // a batched fragment shader gets a group of one fragment, without derivatives (e.g. the base mip level)
+        Colors::color shadeFragment(const Varyings &in, std::true_type) const {
+            Varyings zero = in * 0.0f;
+            Colors::color out;
+            fragmentShader(&in, 1, zero, zero, &out);
+            return out;
+        }
+
         // fragment operations and copy color to frame buffer
         // blending test and z/depth-buffer can come here
-        static void writeToFrameBuffer(const std::vector<fragment> &frs, CustomFrameBuffer <uint32_t> &fb, CustomFrameBuffer <float> &db) {
+        static void writeToFrameBuffer(const std::vector<fragment> &frs, color_buffer &fb, depth_buffer &db) {
 			int width = fb.W;
 			int height = fb.H;
             for (int i = 0, size = frs.size(); i < size; i++) {
@@ -101,7 +310,20 @@ namespace srl {
 				}
             }
         }
+
+        // transformed vertices, part of the class so that we avoid reallocating memory every frame
+        std::vector<vertex_out> m_vertices;
+        // clip space positions of the vertices, output of the batched position transform
+        clip_positions m_clipPositions;
+        // frame in which each vertex of m_vertices was last transformed (indexed rendering only)
+        std::vector<unsigned int> m_vertexFrame;
+        unsigned int m_frame = 0;
+        // fragments generated by the last two phase rasterization, part of the class so that we avoid reallocating memory every frame
+        std::vector<fragment> m_fragments;
     };
+
+    // renderer with the default shader program, which interpolates all vertex attributes and outputs the vertex color
+    using Renderer = RendererT<shaders::default_varyings, shaders::default_vertex_shader, shaders::default_fragment_shader>;
 }
 
 #endif //GRAPHICSPROGRAMMINGEXERCISES_RENDERER_H
@@ -0,0 +1,206 @@
+//
+// Shader programs for the Software Render Library.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_SRL_SHADERS_H
+#define ITU_GRAPHICS_PROGRAMMING_SRL_SHADERS_H
+
+#include <type_traits>
+#include "glm/glm.hpp"
+#include "srl_types.h"
+#include "srl_texture.h"
+
+namespace srl {
+
+    // values that are constant during a draw call, available to the vertex shader
+    struct uniforms {
+        glm::mat4 model;
+        glm::mat4 viewProjection;
+        glm::mat4 modelViewProjection;
+    };
+
+    // A shader program is made of three types, which are template parameters of the renderers:
+    //
+    // - Varyings: the values passed from the vertex shader to the fragment shader, only these are clipped and interpolated
+    // - VertexShader: a function object called as
+    //       Varyings operator()(const vertex &in, const uniforms &u, glm::vec4 &clipPos) const
+    //   clipPos holds u.modelViewProjection * in.pos when the shader is called, and can be modified by it
+    // - FragmentShader: a function object called as
+    //       Colors::color operator()(const Varyings &in) const
+    //
+    // The shaders are called directly by the pipeline (no virtual functions), so their code is inlined in the
+    // vertex and raster loops. Their members can be used as extra uniforms (e.g. the light direction).
+    //
+    // A fragment shader that defines static const bool batched = true is instead called once for a group of
+    // neighbouring fragments of a triangle (up to the 4 pixels of a span of a raster block), as
+    //       void operator()(const Varyings *in, int count, const Varyings &ddx, const Varyings &ddy,
+    //                       Colors::color *out) const
+    // ddx and ddy are the screen space derivatives of the varyings, e.g. to select the mip level of a texture once
+    // per group. Outside of the triangle raster loop the groups have a single fragment and no derivatives.
+    template<class FragmentShader, class = void>
+    struct is_batched : std::false_type {};
+
+    template<class FragmentShader>
+    struct is_batched<FragmentShader, typename std::enable_if<FragmentShader::batched>::type> : std::true_type {};
+
+    // A fragment shader that defines static const bool positioned = true is also called with the pixel of the fragment,
+    // after the fragment passed the depth test, as
+    //       Colors::color operator()(const Varyings &in, int x, int y) const
+    // so it can write more values per pixel to buffers of its own (e.g. the G-buffer of a deferred renderer); the last
+    // call for a pixel is the fragment that stays in the frame buffer. It is called like that by the single pass
+    // raster of the triangle, line and point renderers, and by the multisampled raster of the triangle renderer (once
+    // per pixel with a visible sample, so the last call is the closest fragment only with a single sample per pixel).
+    // The pipelines that shade the fragments before their depth test (m_twoPhaseRaster, and the multisampled raster
+    // of lines and points) call the plain operator, which it must define too. Positioned shaders cannot be batched
+    template<class FragmentShader, class = void>
+    struct is_positioned : std::false_type {};
+
+    template<class FragmentShader>
+    struct is_positioned<FragmentShader, typename std::enable_if<FragmentShader::positioned>::type> : std::true_type {};
+
+    namespace shaders {
+
+        // DEFAULT PROGRAM
+        // ---------------
+        // all vertex attributes are interpolated, the color is the interpolated vertex color
+        struct default_varyings {
+            glm::vec4 norm;
+            Colors::color col;
+            glm::vec2 uv;
+
+            friend default_varyings operator/(default_varyings v, float sc) {
+                return default_varyings{v.norm / sc, v.col / sc, v.uv / sc};
+            }
+
+            friend default_varyings operator*(default_varyings v, float sc) {
+                return default_varyings{v.norm * sc, v.col * sc, v.uv * sc};
+            }
+
+            friend default_varyings operator-(default_varyings v1, const default_varyings &v2) {
+                return default_varyings{v1.norm - v2.norm, v1.col - v2.col, v1.uv - v2.uv};
+            }
+
+            friend default_varyings operator+(default_varyings v1, const default_varyings &v2) {
+                return default_varyings{v1.norm + v2.norm, v1.col + v2.col, v1.uv + v2.uv};
+            }
+        };
+
+        struct default_vertex_shader {
+            default_varyings operator()(const vertex &in, const uniforms &/*u*/, glm::vec4 &/*clipPos*/) const {
+                return default_varyings{in.norm, in.col, in.uv};
+            }
+        };
+
+        struct default_fragment_shader {
+            Colors::color operator()(const default_varyings &in) const {
+                // example: uncomment this to make all fragments darker
+                // return in.col * 0.5f;
+                return in.col;
+            }
+        };
+
+
+        // UNLIT PROGRAM
+        // -------------
+        // only the vertex color is interpolated
+        struct unlit_varyings {
+            Colors::color col;
+
+            friend unlit_varyings operator/(unlit_varyings v, float sc) { return unlit_varyings{v.col / sc}; }
+            friend unlit_varyings operator*(unlit_varyings v, float sc) { return unlit_varyings{v.col * sc}; }
+            friend unlit_varyings operator-(unlit_varyings v1, const unlit_varyings &v2) { return unlit_varyings{v1.col - v2.col}; }
+            friend unlit_varyings operator+(unlit_varyings v1, const unlit_varyings &v2) { return unlit_varyings{v1.col + v2.col}; }
+        };
+
+        struct unlit_vertex_shader {
+            unlit_varyings operator()(const vertex &in, const uniforms &/*u*/, glm::vec4 &/*clipPos*/) const {
+                return unlit_varyings{in.col};
+            }
+        };
+
+        struct unlit_fragment_shader {
+            Colors::color operator()(const unlit_varyings &in) const {
+                return in.col;
+            }
+        };
+
+
+        // LIT PROGRAM
+        // -----------
+        // diffuse lighting with a directional light, the normal is interpolated in world space
+        struct lit_varyings {
+            glm::vec3 norm;
+            Colors::color col;
+
+            friend lit_varyings operator/(lit_varyings v, float sc) { return lit_varyings{v.norm / sc, v.col / sc}; }
+            friend lit_varyings operator*(lit_varyings v, float sc) { return lit_varyings{v.norm * sc, v.col * sc}; }
+            friend lit_varyings operator-(lit_varyings v1, const lit_varyings &v2) { return lit_varyings{v1.norm - v2.norm, v1.col - v2.col}; }
+            friend lit_varyings operator+(lit_varyings v1, const lit_varyings &v2) { return lit_varyings{v1.norm + v2.norm, v1.col + v2.col}; }
+        };
+
+        struct lit_vertex_shader {
+            lit_varyings operator()(const vertex &in, const uniforms &u, glm::vec4 &/*clipPos*/) const {
+                // we assume there is no non-uniform scale in the model matrix
+                return lit_varyings{glm::vec3(u.model * in.norm), in.col};
+            }
+        };
+
+        struct lit_fragment_shader {
+            glm::vec3 lightDirection = glm::normalize(glm::vec3(1.0f, 1.0f, 1.0f)); // towards the light, world space
+            float ambient = .2f;
+
+            Colors::color operator()(const lit_varyings &in) const {
+                float diffuse = glm::max(glm::dot(glm::normalize(in.norm), lightDirection), 0.0f);
+                return glm::vec4(glm::vec3(in.col) * (ambient + (1.0f - ambient) * diffuse), in.col.a);
+            }
+        };
+
+
+        // TEXTURED PROGRAM
+        // ----------------
+        // the texture color modulated by the vertex color, it is a batched fragment shader. Without a texture it is
+        // the vertex color
+        struct textured_varyings {
+            glm::vec2 uv;
+            Colors::color col;
+
+            friend textured_varyings operator/(textured_varyings v, float sc) { return textured_varyings{v.uv / sc, v.col / sc}; }
+            friend textured_varyings operator*(textured_varyings v, float sc) { return textured_varyings{v.uv * sc, v.col * sc}; }
+            friend textured_varyings operator-(textured_varyings v1, const textured_varyings &v2) { return textured_varyings{v1.uv - v2.uv, v1.col - v2.col}; }
+            friend textured_varyings operator+(textured_varyings v1, const textured_varyings &v2) { return textured_varyings{v1.uv + v2.uv, v1.col + v2.col}; }
+        };
+
+        struct textured_vertex_shader {
+            textured_varyings operator()(const vertex &in, const uniforms &/*u*/, glm::vec4 &/*clipPos*/) const {
+                return textured_varyings{in.uv, in.col};
+            }
+        };
+
+        struct textured_fragment_shader {
+            static const bool batched = true;
+            const Texture *texture = nullptr;
+
+            void operator()(const textured_varyings *in, int count, const textured_varyings &ddx,
+                            const textured_varyings &ddy, Colors::color *out) const {
+                if (!texture) {
+                    for (int i = 0; i < count; i++)
+                        out[i] = in[i].col;
+                    return;
+                }
+                // one level of detail for the whole group
+                float lod = texture->lod(ddx.uv, ddy.uv);
+                glm::vec2 uvs[4];
+                for (int i = 0; i < count; i += 4) {
+                    int n = std::min(count - i, 4);
+                    for (int j = 0; j < n; j++)
+                        uvs[j] = in[i + j].uv;
+                    texture->sample(uvs, n, lod, out + i);
+                    for (int j = 0; j < n; j++)
+                        out[i + j] *= in[i + j].col;
+                }
+            }
+        };
+    }
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_SRL_SHADERS_H
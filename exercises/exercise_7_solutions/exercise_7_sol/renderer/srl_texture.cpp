@@ -0,0 +1,74 @@
+#include "srl_texture.h"
+#include <iostream>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+namespace srl {
+
+    bool Texture::load(const std::string &path) {
+        int width, height, nrComponents;
+        // always 4 components, so that every texel is an RGBA8 uint32
+        unsigned char *data = stbi_load(path.c_str(), &width, &height, &nrComponents, 4);
+        if (!data) {
+            std::cout << "Texture failed to load at path: " << path << std::endl;
+            return false;
+        }
+
+        std::vector<uint32_t> rgba(width * height);
+        for (int i = 0; i < width * height; i++)
+            rgba[i] = uint32_t(data[i * 4]) | uint32_t(data[i * 4 + 1]) << 8 |
+                      uint32_t(data[i * 4 + 2]) << 16 | uint32_t(data[i * 4 + 3]) << 24;
+        stbi_image_free(data);
+
+        create(width, height, rgba.data());
+        return true;
+    }
+
+    void Texture::create(int width, int height, const uint32_t *rgba) {
+        m_levels.clear();
+
+        m_levels.push_back(makeLevel(width, height, rgba));
+        std::vector<uint32_t> current(rgba, rgba + width * height);
+
+        // each level is the average of 2x2 texels of the previous one (the last texel of odd sizes is repeated)
+        while (width > 1 || height > 1) {
+            int nextW = std::max(width / 2, 1), nextH = std::max(height / 2, 1);
+            std::vector<uint32_t> next(nextW * nextH);
+            for (int y = 0; y < nextH; y++) {
+                int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+                for (int x = 0; x < nextW; x++) {
+                    int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+                    uint32_t texels[4] = {current[x0 + y0 * width], current[x1 + y0 * width],
+                                          current[x0 + y1 * width], current[x1 + y1 * width]};
+                    uint32_t avg = 0;
+                    for (int c = 0; c < 32; c += 8) {
+                        uint32_t sum = 2; // round to the closest value
+                        for (uint32_t t : texels)
+                            sum += (t >> c) & 0xffu;
+                        avg |= (sum / 4) << c;
+                    }
+                    next[x + y * nextW] = avg;
+                }
+            }
+
+            width = nextW;
+            height = nextH;
+            current.swap(next);
+            m_levels.push_back(makeLevel(width, height, current.data()));
+        }
+    }
+
+    Texture::level Texture::makeLevel(int width, int height, const uint32_t *rgba) {
+        level lvl;
+        lvl.W = width;
+        lvl.H = height;
+        lvl.blocksW = (width + blockSize - 1) / blockSize;
+        int blocksH = (height + blockSize - 1) / blockSize;
+        lvl.texels.assign(lvl.blocksW * blocksH * blockSize * blockSize, 0);
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+                lvl.at(x, y) = rgba[x + y * width];
+        return lvl;
+    }
+}
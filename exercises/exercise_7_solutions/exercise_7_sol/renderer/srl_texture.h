@@ -0,0 +1,149 @@
+//
+// Textures of the Software Render Library.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_SRL_TEXTURE_H
+#define ITU_GRAPHICS_PROGRAMMING_SRL_TEXTURE_H
+
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include "glm/glm.hpp"
+#include "srl_types.h"
+
+namespace srl {
+
+    // TEXTURE
+    // -------
+    // an RGBA8 image and its mip chain (each level is half the size of the previous one, down to 1x1).
+    // The texels of each level are stored in blocks of 4x4, one row of blocks after the other, so that the 16 texels
+    // of a block are in the same 64 bytes cache line and the footprint of a filtered lookup is usually in one block.
+    // Texture coordinates repeat outside of [0, 1], and v = 0 is the first row of the image (like in OpenGL).
+    class Texture {
+    public:
+        enum class filter {
+            nearest,   // nearest texel of the closest mip level
+            bilinear,  // bilinear interpolation of the 4 closest texels of the closest mip level
+            trilinear  // bilinear interpolation in the two closest mip levels, and linear between the two
+        };
+
+        static const int blockSize = 4;
+
+        filter filtering = filter::trilinear;
+
+        // load an image file (any format supported by stb_image) and build its mip chain, returns false on error
+        bool load(const std::string &path);
+
+        // copy width x height RGBA8 texels (one row after the other) and build the mip chain
+        void create(int width, int height, const uint32_t *rgba);
+
+        int width() const { return m_levels.empty() ? 0 : m_levels[0].W; }
+        int height() const { return m_levels.empty() ? 0 : m_levels[0].H; }
+        int levels() const { return int(m_levels.size()); }
+
+        // level of detail for texture coordinates with screen space derivatives ddx and ddy:
+        // log2 of the number of texels covered by one pixel along its longest axis, 0 means one texel per pixel
+        float lod(glm::vec2 ddx, glm::vec2 ddy) const {
+            glm::vec2 size(width(), height());
+            glm::vec2 dx = ddx * size, dy = ddy * size;
+            float rho2 = std::max(glm::dot(dx, dx), glm::dot(dy, dy));
+            return rho2 > 0 ? 0.5f * std::log2(rho2) : 0.0f;
+        }
+
+        // sample the texture at uv, from the mip levels selected by lod. A texture without an image (nothing was
+        // loaded or created) is opaque black, like an incomplete texture in OpenGL
+        Colors::color sample(glm::vec2 uv, float lod = 0.0f) const {
+            Colors::color out;
+            sample(&uv, 1, lod, &out);
+            return out;
+        }
+
+        // sample the texture at count coordinates that share the same level of detail (e.g. the fragments of a quad),
+        // the mip levels and the filter are only selected once for the whole batch
+        void sample(const glm::vec2 *uv, int count, float lod, Colors::color *out) const {
+            if (m_levels.empty()) {
+                std::fill(out, out + count, Colors::color(0.0f, 0.0f, 0.0f, 1.0f));
+                return;
+            }
+
+            // magnification, or a texture without mip maps
+            int last = levels() - 1;
+            if (lod <= 0.0f || last == 0) {
+                if (filtering == filter::nearest)
+                    for (int i = 0; i < count; i++) out[i] = nearest(m_levels[0], uv[i]);
+                else
+                    for (int i = 0; i < count; i++) out[i] = bilinear(m_levels[0], uv[i]);
+                return;
+            }
+
+            lod = std::min(lod, float(last));
+            if (filtering == filter::trilinear) {
+                int l0 = int(lod);
+                int l1 = std::min(l0 + 1, last);
+                float t = lod - float(l0);
+                for (int i = 0; i < count; i++)
+                    out[i] = glm::mix(bilinear(m_levels[l0], uv[i]), bilinear(m_levels[l1], uv[i]), t);
+                return;
+            }
+
+            const level &lvl = m_levels[int(lod + 0.5f)];
+            if (filtering == filter::nearest)
+                for (int i = 0; i < count; i++) out[i] = nearest(lvl, uv[i]);
+            else
+                for (int i = 0; i < count; i++) out[i] = bilinear(lvl, uv[i]);
+        }
+
+    private:
+        struct level {
+            int W, H;
+            // number of blocks in a row of blocks
+            int blocksW;
+            std::vector<uint32_t> texels;
+
+            int index(int x, int y) const {
+                return ((y / blockSize) * blocksW + x / blockSize) * blockSize * blockSize
+                       + (y % blockSize) * blockSize + x % blockSize;
+            }
+            uint32_t at(int x, int y) const { return texels[index(x, y)]; }
+            uint32_t &at(int x, int y) { return texels[index(x, y)]; }
+        };
+
+        // repeat wrap mode
+        static int wrap(int i, int size) {
+            i %= size;
+            return i < 0 ? i + size : i;
+        }
+
+        static Colors::color unpack(uint32_t texel) {
+            return Colors::color(float(texel & 0xffu), float((texel >> 8) & 0xffu),
+                                 float((texel >> 16) & 0xffu), float(texel >> 24)) * (1.0f / 255.0f);
+        }
+
+        static Colors::color nearest(const level &lvl, glm::vec2 uv) {
+            int x = wrap(int(std::floor(uv.x * float(lvl.W))), lvl.W);
+            int y = wrap(int(std::floor(uv.y * float(lvl.H))), lvl.H);
+            return unpack(lvl.at(x, y));
+        }
+
+        static Colors::color bilinear(const level &lvl, glm::vec2 uv) {
+            // texel centers are at half integer coordinates
+            float s = uv.x * float(lvl.W) - 0.5f, t = uv.y * float(lvl.H) - 0.5f;
+            float fs = std::floor(s), ft = std::floor(t);
+            float ws = s - fs, wt = t - ft;
+            int x0 = wrap(int(fs), lvl.W), x1 = x0 + 1 < lvl.W ? x0 + 1 : 0;
+            int y0 = wrap(int(ft), lvl.H), y1 = y0 + 1 < lvl.H ? y0 + 1 : 0;
+            Colors::color bottom = glm::mix(unpack(lvl.at(x0, y0)), unpack(lvl.at(x1, y0)), ws);
+            Colors::color top = glm::mix(unpack(lvl.at(x0, y1)), unpack(lvl.at(x1, y1)), ws);
+            return glm::mix(bottom, top, wt);
+        }
+
+        // a level of width x height texels, copied from rgba (one row after the other) to the 4x4 blocks
+        static level makeLevel(int width, int height, const uint32_t *rgba);
+
+        std::vector<level> m_levels;
+    };
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_SRL_TEXTURE_H
@@ -0,0 +1,171 @@
+//
+// Screen tiles, to render the primitives of the Software Render Library with several threads.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_SRL_TILES_H
+#define ITU_GRAPHICS_PROGRAMMING_SRL_TILES_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+namespace srl {
+
+    // a rectangle of pixels [x0, x1) x [y0, y1)
+    struct pixel_rect {
+        int x0, y0, x1, y1;
+
+        bool contains(int x, int y) const { return x >= x0 && x < x1 && y >= y0 && y < y1; }
+    };
+
+    // TILE BINS
+    // ---------
+    // the frame buffer is divided in tiles of tileSize x tileSize pixels, and each primitive is added to the bin of every
+    // tile its bounding box overlaps. Then the tiles can be rendered in parallel: each tile is drawn by a single thread,
+    // so two threads never write the same pixel, and the primitives of a bin are in the order they were added, so the
+    // image is the same for any number of threads.
+    // tileSize is a multiple of the depth buffer tiles (and of the tiles of layouts::tiled), so the coarse depth of a
+    // depth buffer tile is also only updated by one thread.
+    class TileBins {
+    public:
+        static const int tileSize = 64;
+
+        // empty the bins, for a frame buffer of width x height pixels
+        void reset(int width, int height) {
+            m_width = width;
+            m_height = height;
+            m_tilesW = (width + tileSize - 1) / tileSize;
+            m_tilesH = (height + tileSize - 1) / tileSize;
+            m_bins.resize(m_tilesW * m_tilesH);
+            // clear keeps the memory of the bins, so that it is not allocated again every frame
+            for (auto &bin : m_bins)
+                bin.clear();
+        }
+
+        // add primitive to the tiles overlapped by the pixels [xMin, xMax] x [yMin, yMax]
+        void add(int xMin, int yMin, int xMax, int yMax, uint32_t primitive) {
+            int tx0 = std::max(xMin, 0) / tileSize, tx1 = std::min(xMax, m_width - 1) / tileSize;
+            int ty0 = std::max(yMin, 0) / tileSize, ty1 = std::min(yMax, m_height - 1) / tileSize;
+            for (int ty = ty0; ty <= ty1; ty++)
+                for (int tx = tx0; tx <= tx1; tx++)
+                    m_bins[tx + ty * m_tilesW].push_back(primitive);
+        }
+
+        int count() const { return m_tilesW * m_tilesH; }
+
+        const std::vector<uint32_t> &bin(int tile) const { return m_bins[tile]; }
+
+        // the pixels of a tile, clamped to the frame buffer
+        pixel_rect rect(int tile) const {
+            int x0 = (tile % m_tilesW) * tileSize, y0 = (tile / m_tilesW) * tileSize;
+            return pixel_rect{x0, y0, std::min(x0 + tileSize, m_width), std::min(y0 + tileSize, m_height)};
+        }
+
+    private:
+        int m_width = 0, m_height = 0;
+        int m_tilesW = 0, m_tilesH = 0;
+        std::vector<std::vector<uint32_t>> m_bins;
+    };
+
+    // THREAD POOL
+    // -----------
+    // runs the jobs [0, count) on a group of threads that is kept alive between calls of run (the calling thread is
+    // one of them), so a draw call does not pay for starting and joining threads. The jobs are taken one at a time
+    // from a shared counter, so threads that get cheap tiles take more of them
+    class ThreadPool {
+    public:
+        ThreadPool() = default;
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        ~ThreadPool() {
+            stopThreads();
+        }
+
+        // call job(i) for every i in [0, count) on up to threads threads, returns when all the jobs are done
+        void run(int count, unsigned int threads, const std::function<void(int)> &job) {
+            threads = std::max(1u, std::min(threads, unsigned(std::max(count, 1))));
+            if (threads > m_threads.size() + 1)
+                startThreads(threads);
+
+            m_next = 0;
+            m_count = count;
+            m_job = &job;
+            unsigned int helpers = threads - 1;
+            if (helpers > 0) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_helpers = helpers;
+                m_running = helpers;
+                m_generation++;
+                m_start.notify_all();
+            }
+            work();
+            if (helpers > 0) {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_done.wait(lock, [&]() { return m_running == 0; });
+            }
+            m_job = nullptr;
+        }
+
+    private:
+        void startThreads(unsigned int threads) {
+            stopThreads();
+            m_stop = false;
+            unsigned long long generation = m_generation;
+            for (unsigned int t = 1; t < threads; t++)
+                m_threads.emplace_back([this, t, generation]() { threadLoop(t, generation); });
+        }
+
+        void stopThreads() {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+                m_start.notify_all();
+            }
+            for (auto &thread : m_threads)
+                thread.join();
+            m_threads.clear();
+        }
+
+        // the helper threads wait for the next call of run (the next generation), and the ones it needs take jobs
+        // until there are none left. A pool started for more threads than a call asks for leaves the others asleep
+        void threadLoop(unsigned int thread, unsigned long long generation) {
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_start.wait(lock, [&]() { return m_stop || (m_generation != generation && thread <= m_helpers); });
+                    if (m_stop)
+                        return;
+                    generation = m_generation;
+                }
+                work();
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (--m_running == 0)
+                    m_done.notify_one();
+            }
+        }
+
+        void work() {
+            for (int i = m_next++; i < m_count; i = m_next++)
+                (*m_job)(i);
+        }
+
+        std::vector<std::thread> m_threads;
+        std::atomic<int> m_next{0};
+        int m_count = 0;
+        const std::function<void(int)> *m_job = nullptr;
+
+        std::mutex m_mutex;
+        std::condition_variable m_start, m_done;
+        unsigned long long m_generation = 0;
+        unsigned int m_helpers = 0, m_running = 0;
+        bool m_stop = false;
+    };
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_SRL_TILES_H
@@ -8,35 +8,76 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/transform.hpp>
 #include "srl_renderer.h"
-#include "rasterizer/trianglerasterizer.h"
+#include "rasterizer/halfspacerasterizer.h"
+#include "rasterizer/coveragerasterizer.h"
 #include <glm/gtc/matrix_access.hpp>
 #include <iostream>
 #include "srl_types.h"
 
 namespace srl {
 
-    class TriangleRenderer : public Renderer {
+    template<class Varyings, class VertexShader, class FragmentShader, class Layout = layouts::linear>
+    class TriangleRendererT : public RendererT<Varyings, VertexShader, FragmentShader, Layout> {
     public:
         bool m_clipToFrustum = true;
+        // reject the triangles that are not facing the camera (clockwise on screen), false to draw both sides
+        bool m_cullBackFaces = true;
 
     private:
+        using vertex_out = shaded_vertex<Varyings>;
+        using fragment = shaded_fragment<Varyings>;
+        using color_buffer = CustomFrameBuffer<uint32_t, Layout>;
+        using depth_buffer = DepthBufferT<Layout>;
 
         // create triangle primitives
-        void assemblePrimitives(const std::vector<vertex> &vts) override {
+        void assemblePrimitives(const std::vector<vertex_out> &vts) override {
             m_primitives.clear();
             m_primitives.reserve(vts.size()/3);
+            m_clipList.clear();
 
             for(int i = 0, size = vts.size()-2; i < size; i+=3){
-                triangle t;
-                t.v1 = vts[i];
-                t.v2 = vts[i+1];
-                t.v3 = vts[i+2];
+                addTriangle(vts, i, i+1, i+2);
+            }
+        }
 
-                m_primitives.push_back(t);
+        // create triangle primitives from every three indices
+        void assemblePrimitives(const std::vector<vertex_out> &vts, const std::vector<unsigned int> &indices) override {
+            m_primitives.clear();
+            m_primitives.reserve(indices.size()/3);
+            m_clipList.clear();
+
+            for(int i = 0, size = indices.size()-2; i < size; i+=3){
+                addTriangle(vts, indices[i], indices[i+1], indices[i+2]);
             }
         }
 
-        bool clipTriangle(triangle &tIn, int i){
+        // add the triangle made of the vertices i1, i2 and i3 of vts, unless it is completely outside of the frustum.
+        // The outcodes of the vertices tell which planes it has to be clipped against
+        void addTriangle(const std::vector<vertex_out> &vts, unsigned int i1, unsigned int i2, unsigned int i3){
+            const std::vector<uint32_t> &codes = this->m_outcodes;
+
+            // all vertices are outside of the same frustum plane, the triangle is not visible
+            if (codes[i1] & codes[i2] & codes[i3] & outcodes::frustum)
+                return;
+
+            triangle<vertex_out> t;
+            t.v1 = vts[i1];
+            t.v2 = vts[i2];
+            t.v3 = vts[i3];
+
+            // triangles that cross the near or far planes, or the guard band, are clipped against all the frustum planes
+            // they cross. Triangles that only cross the sides of the frustum are not clipped, their pixels outside the
+            // viewport are never generated by the rasterizer
+            uint32_t crossed = codes[i1] | codes[i2] | codes[i3];
+            if (crossed & outcodes::mustClip) {
+                t.clipPlanes = crossed & outcodes::frustum;
+                m_clipList.push_back(m_primitives.size());
+            }
+
+            m_primitives.push_back(t);
+        }
+
+        bool clipTriangle(triangle<vertex_out> &tIn, int i){
             // index to x, y or z coordinate (x=0, y=1, z=2)
             int idx = i % 3;
             // we check if the variable is in the range of the clipping plane using w
@@ -52,8 +93,8 @@ namespace srl {
             glm::vec4 p3 = tIn.v3.pos;
 
             // store a pointer to the vertices in and out the desired half-space
-            vertex* inVts[3]; int inCount = 0;
-            vertex* outVts[3]; int outCount = 0;
+            vertex_out* inVts[3]; int inCount = 0;
+            vertex_out* outVts[3]; int outCount = 0;
             int outIdx;
 
             // test if the points are in the valid
@@ -81,14 +122,14 @@ namespace srl {
                 // find the weight t
                 float t = (inVts[0]->pos[idx] - inVts[0]->pos.w * wMult) / (inOutVec.w * wMult - inOutVec[idx]);
                 // compute edge intersection 1
-                vertex edgeVtx1 = (*inVts[0]) + (*outVts[0] - *inVts[0]) * t;
+                vertex_out edgeVtx1 = (*inVts[0]) + (*outVts[0] - *inVts[0]) * t;
 
                 // vector from in position to second out position
                 inOutVec = outVts[1]->pos - inVts[0]->pos;
                 // find the weight t
                 t = (inVts[0]->pos[idx] - inVts[0]->pos.w * wMult) / (inOutVec.w * wMult - inOutVec[idx]);
                 // compute edge intersection 2
-                vertex edgeVtx2 = (*inVts[0]) + (*outVts[1] - *inVts[0]) * t;
+                vertex_out edgeVtx2 = (*inVts[0]) + (*outVts[1] - *inVts[0]) * t;
 
                 // update the two triangle vertices in the invalid half-space
                 *(outVts[0]) = edgeVtx1;
@@ -101,26 +142,29 @@ namespace srl {
                 // find the weight t
                 float t = (inVts[0]->pos[idx] - inVts[0]->pos.w * wMult) / (inOutVec.w * wMult - inOutVec[idx]);
                 // compute edge intersection 1
-                vertex edgeVtx1 = (*inVts[0]) + (*outVts[0] - *inVts[0]) * t;
+                vertex_out edgeVtx1 = (*inVts[0]) + (*outVts[0] - *inVts[0]) * t;
 
                 // vector from second in position to out position
                 inOutVec = outVts[0]->pos - inVts[1]->pos;
                 // find the weight t
                 t = (inVts[1]->pos[idx] - inVts[1]->pos.w * wMult) / (inOutVec.w * wMult - inOutVec[idx]);
                 // compute edge intersection 2
-                vertex edgeVtx2 = (*inVts[1]) + (*outVts[0] - *inVts[1]) * t;
+                vertex_out edgeVtx2 = (*inVts[1]) + (*outVts[0] - *inVts[1]) * t;
 
                 // update the location of the vertex in the invalid side of the half-space
                 *outVts[0] = edgeVtx1;
 
                 // we have fixed the triangle that was already stored, now lets create the triangle that is missing
                 // using the two edge points and the second in vertex
-                triangle newT;
+                triangle<vertex_out> newT;
                 // ensure the winding order of new triangles is correct (so that they are not culled during backface culling)
                 if(outIdx == 0){newT.v1 = *inVts[1]; newT.v2 = edgeVtx2; newT.v3 = edgeVtx1;}
                 else if(outIdx == 1){newT.v1 =  *inVts[1]; newT.v2 = edgeVtx1; newT.v3 = edgeVtx2;}
                 else {newT.v1 = edgeVtx1; newT.v2 = *inVts[1]; newT.v3 = edgeVtx2;}
+                // the new triangle still has to be clipped against the remaining planes
+                newT.clipPlanes = tIn.clipPlanes;
 
+                m_clipList.push_back(m_primitives.size());
                 m_primitives.push_back(newT);
             }
 
@@ -129,18 +173,32 @@ namespace srl {
 
 
         // clip primitives so that they are contained within the render volume
+        // only the triangles in m_clipList are clipped, and only against the planes they cross
         void clipPrimitives() override {
             for (int side = 0; side < 6; side ++){
-                for(int i = 0, size = m_primitives.size(); i < size; i++){
-                    if (!m_primitives[i].rejected)
-                        clipTriangle(m_primitives[i], side);
+                for(int i = 0, size = m_clipList.size(); i < size; i++){
+                    triangle<vertex_out> &tri = m_primitives[m_clipList[i]];
+                    if (!tri.rejected && (tri.clipPlanes & (1u << side)))
+                        clipTriangle(tri, side);
                 }
             }
         }
 
         // perspective division (canonical perspective volume to normalized device coordinates)
-        void divideByW() override {
+        // it is done in toScreenSpace, so that all the triangles are set up in a single pass
+        void divideByW() override {}
+
+        // perspective division, normalized device coordinates to window coordinates and backface culling
+        void toScreenSpace(int width, int height) override  {
+            m_width = width;
+            m_height = height;
+            float halfW = width / 2.0f;
+            float halfH = height / 2.0f;
+            glm::mat4 toWindowSpace = glm::scale(glm::vec3(halfW, halfH, 1.f)) * glm::translate(glm::vec3(1.f, 1.f, 0.f));
             for(auto &tri : m_primitives) {
+                if (tri.rejected)
+                    continue;
+
                 // the division of position x, y and z coordinates will place all vertices in the normalized device coordinates
                 // however, we divide all parameters (not only position) to perform hyperbolic interpolation later on
                 tri.v1.pos.z = tri.v1.pos.z / tri.v1.pos.w;
@@ -150,25 +208,11 @@ namespace srl {
                 tri.v3.pos.z = tri.v3.pos.z / tri.v3.pos.w;
                 tri.v3 = tri.v3 / tri.v3.pos.w;
 
-            }
-        }
-
-        // normalized device coordinates to window coordinates
-        void toScreenSpace(int width, int height) override  {
-            float halfW = width / 2;
-            float halfH = height / 2;
-            glm::mat4 toWindowSpace = glm::scale(glm::vec3(halfW, halfH, 1.f)) * glm::translate(glm::vec3(1.f, 1.f, 0.f));
-            for(auto &tri : m_primitives) {
                 tri.v1.pos = toWindowSpace * tri.v1.pos;
                 tri.v2.pos = toWindowSpace * tri.v2.pos;
                 tri.v3.pos = toWindowSpace * tri.v3.pos;
-            }
-        }
 
-
-        // only draw triangles in a counterclockwise winding order (which we define as facing the camera)
-        void backfaceCulling() override{
-            for(auto &tri : m_primitives) {
+                // only draw triangles in a counterclockwise winding order (which we define as facing the camera)
                 // two vectors along the edges of the triangle
                 glm::vec3 v1 = tri.v2.pos - tri.v1.pos;
                 glm::vec3 v2 = tri.v3.pos - tri.v1.pos;
@@ -177,7 +221,7 @@ namespace srl {
                 float nz = v1.x * v2.y - v1.y * v2.x;
 
                 // bigger than 0 means the normal is not pointing towards the camera
-                if (nz < 0) {
+                if (nz < 0 && m_cullBackFaces) {
                     tri.rejected = true;
                 }
             }
@@ -193,40 +237,273 @@ namespace srl {
                     continue;
 
                 // vertices of the triangle, rounded to the closest integer (aka pixel location)
-                glm::ivec2 iv1(tri.v1.pos.x + .5f, tri.v1.pos.y + .5f);
-                glm::ivec2 iv2(tri.v2.pos.x + .5f, tri.v2.pos.y + .5f);
-                glm::ivec2 iv3(tri.v3.pos.x + .5f, tri.v3.pos.y + .5f);
-                // run the rasterization and collect all pixel locations
-                triangle_rasterizer rasterizer(iv1.x, iv1.y, iv2.x, iv2.y, iv3.x, iv3.y);
-                std::vector<glm::ivec2> pixels = rasterizer.all_pixels();
-
-                // create a fragment for each pixel
-                for (auto &pxl : pixels){
-                    fragment frag{};
-
-                    frag.pos = pxl;
-
-                    // barycentric coordinates (in 2D projected space)
-                    glm::vec3 bar = tri.barycentricCoordinatesAt(pxl);
-                    // hyperbolic interpolation correction
-                    float hypInterp = bar.x * tri.v1.hypInterp + bar.y * tri.v2.hypInterp + bar.z * tri.v3.hypInterp;
-                    bar = bar / hypInterp;
-                    frag.depth = bar.x * tri.v1.pos.z + bar.y * tri.v2.pos.z + bar.z * tri.v3.pos.z;
-                    frag.col = bar.x * tri.v1.col + bar.y * tri.v2.col + bar.z * tri.v3.col;
-                    frag.norm = bar.x * tri.v1.norm + bar.y * tri.v2.norm + bar.z * tri.v3.norm;
-                    frag.uv = bar.x * tri.v1.uv + bar.y * tri.v2.uv + bar.z * tri.v3.uv;
-
-
-                    outFrs.push_back(frag);
+                // they can be outside of the frame buffer (within the guard band), so we round with floor
+                glm::ivec2 iv1 = glm::ivec2(glm::floor(glm::vec2(tri.v1.pos) + .5f));
+                glm::ivec2 iv2 = glm::ivec2(glm::floor(glm::vec2(tri.v2.pos) + .5f));
+                glm::ivec2 iv3 = glm::ivec2(glm::floor(glm::vec2(tri.v3.pos) + .5f));
+                // run the rasterization, pixels outside the frame buffer are never generated (scissor)
+                halfspace_rasterizer rasterizer(iv1.x, iv1.y, iv2.x, iv2.y, iv3.x, iv3.y, m_width, m_height);
+
+                // triangle setup, the interpolation below only needs to step these planes from pixel to pixel
+                attribute_planes<vertex_out> planes = tri.attributePlanes();
+
+                // create a fragment for each pixel, the rasterizer hands them over one horizontal span at a time
+                rasterizer.for_each_span([&](int y, int xBegin, int xEnd){
+                    // attributes at the first pixel of the span
+                    vertex_out attr = planes.valueAt(float(xBegin), float(y));
+
+                    for (int x = xBegin; x < xEnd; x++, attr = attr + planes.ddx){
+                        fragment frag;
+
+                        frag.pos = glm::ivec2(x, y);
+
+                        // hyperbolic interpolation correction, a single division per fragment
+                        float w = 1.0f / attr.hypInterp;
+                        frag.depth = attr.pos.z * w;
+                        frag.var = attr.var * w;
+
+                        outFrs.push_back(frag);
+                    }
+                });
+            }
+        }
+
+
+        // rasterize the triangles and depth test, shade and write each fragment as soon as it is generated
+        // no fragment is stored, and fragments that fail the depth test are neither interpolated nor shaded (early-z).
+        // Blocks of pixels behind everything drawn in their depth buffer tile are not even rasterized (coarse z)
+        void rasterAndWritePrimitives(color_buffer &fb, depth_buffer &db) override {
+            for(auto &tri : m_primitives) {
+                // skip this primitive if it has been rejected during clipping or culling
+                if(tri.rejected)
+                    continue;
+
+                // vertices of the triangle, rounded to the closest integer (aka pixel location)
+                // they can be outside of the frame buffer (within the guard band), so we round with floor
+                glm::ivec2 iv1 = glm::ivec2(glm::floor(glm::vec2(tri.v1.pos) + .5f));
+                glm::ivec2 iv2 = glm::ivec2(glm::floor(glm::vec2(tri.v2.pos) + .5f));
+                glm::ivec2 iv3 = glm::ivec2(glm::floor(glm::vec2(tri.v3.pos) + .5f));
+                // run the rasterization, pixels outside the frame buffer are never generated (scissor)
+                halfspace_rasterizer rasterizer(iv1.x, iv1.y, iv2.x, iv2.y, iv3.x, iv3.y, m_width, m_height);
+
+                // triangle setup, the interpolation below only needs to step these planes from pixel to pixel
+                attribute_planes<vertex_out> planes = tri.attributePlanes();
+
+                // the depth of the fragments is interpolated between the depth of the vertices,
+                // so no fragment of the triangle is closer than the closest vertex
+                float minDepth = std::min(std::min(tri.v1.pos.z / tri.v1.hypInterp, tri.v2.pos.z / tri.v2.hypInterp),
+                                          tri.v3.pos.z / tri.v3.hypInterp);
+
+                auto coarseDepthTest = [&](int bx, int by){
+                    unsigned int tx = bx / depth_buffer::tileSize, ty = by / depth_buffer::tileSize;
+                    // the whole triangle is behind all the pixels of the tile
+                    if (db.isHidden(tx, ty, minDepth))
+                        return false;
+                    db.prepareTileWrite(tx, ty);
+                    return true;
+                };
+
+                rasterizer.for_each_span([&](int y, int xBegin, int xEnd){
+                    float minWritten = writeSpan(y, xBegin, xEnd, planes, fb, db, is_batched<FragmentShader>());
+                    // spans never cross the border of a block, so all its pixels are in the same tile
+                    if (minWritten < 2.0f)
+                        db.markTileWritten(xBegin / depth_buffer::tileSize, y / depth_buffer::tileSize, minWritten);
+                }, coarseDepthTest);
+            }
+        }
+
+        // multisampled rasterization: coverage and depth are tested for each sample, the fragment shader runs once per
+        // pixel (at the pixel center, even if it is not covered) and its color is written to the samples that passed
+        void rasterAndWriteSamples(MultisampleBuffer &msb) override {
+            const float subpixelScale = float(coverage_rasterizer::subpixel_scale);
+            // the sample offsets in the sub-pixel units of the rasterizer
+            static_assert(coverage_rasterizer::subpixel_scale % MultisampleBuffer::offsetScale == 0,
+                          "the sample offsets must be exact in sub-pixel units");
+            const int offsetUnit = coverage_rasterizer::subpixel_scale / MultisampleBuffer::offsetScale;
+            int offsets[2 * coverage_rasterizer::max_samples];
+            for (int i = 0; i < 2 * msb.samples; i++)
+                offsets[i] = msb.sampleOffsets()[i] * offsetUnit;
+            for(auto &tri : m_primitives) {
+                if(tri.rejected)
+                    continue;
+
+                // vertices of the triangle in fixed point, with sub-pixel precision
+                glm::ivec2 fv1 = glm::ivec2(glm::floor(glm::vec2(tri.v1.pos) * subpixelScale + .5f));
+                glm::ivec2 fv2 = glm::ivec2(glm::floor(glm::vec2(tri.v2.pos) * subpixelScale + .5f));
+                glm::ivec2 fv3 = glm::ivec2(glm::floor(glm::vec2(tri.v3.pos) * subpixelScale + .5f));
+                coverage_rasterizer rasterizer(fv1.x, fv1.y, fv2.x, fv2.y, fv3.x, fv3.y, msb.W, msb.H,
+                                               offsets, msb.samples);
+
+                // triangle setup at the first covered span: the triangles smaller than a pixel often cover no sample
+                attribute_planes<vertex_out> planes;
+                bool setUp = false;
+
+                rasterizer.for_each_span([&](int y, int xBegin, int xEnd, const uint32_t *masks){
+                    if (!setUp) {
+                        planes = tri.attributePlanes();
+                        setUp = true;
+                    }
+                    writeSamplesSpan(y, xBegin, xEnd, masks, planes, msb);
+                });
+            }
+        }
+
+        // depth test the covered samples of the pixels [xBegin, xEnd) of row y,
+        // and shade the pixels with at least one visible sample together
+        void writeSamplesSpan(int y, int xBegin, int xEnd, const uint32_t *masks,
+                              const attribute_planes<vertex_out> &planes, MultisampleBuffer &msb) const {
+            const int maxCount = coverage_rasterizer::block_size;
+            Varyings vars[maxCount];
+            Colors::color cols[maxCount];
+            uint32_t written[maxCount];
+            int xs[maxCount];
+            Varyings ddx, ddy;
+            int count = 0;
+
+            vertex_out attr = planes.valueAt(float(xBegin), float(y));
+            for (int x = xBegin; x < xEnd; x++, attr = attr + planes.ddx){
+                uint32_t mask = masks[x - xBegin];
+                if (!mask)
+                    continue;
+
+                // depth at the pixel center, and its derivatives to get the depth of each sample
+                float w = 1.0f / attr.hypInterp;
+                float depth = attr.pos.z * w;
+                float dzdx = (planes.ddx.pos.z - depth * planes.ddx.hypInterp) * w;
+                float dzdy = (planes.ddy.pos.z - depth * planes.ddy.hypInterp) * w;
+
+                float *depths = msb.depthsAt(x, y);
+                uint32_t visible = 0;
+                for (int s = 0; s < msb.samples; s++) {
+                    if (!(mask & (1u << s)))
+                        continue;
+                    glm::vec2 offset = msb.sampleOffset(s);
+                    float sampleDepth = depth + dzdx * offset.x + dzdy * offset.y;
+                    if (sampleDepth < depths[s]) {
+                        depths[s] = sampleDepth;
+                        visible |= 1u << s;
+                    }
+                }
+                if (!visible)
+                    continue;
+
+                vars[count] = attr.var * w;
+                if (count == 0 && is_batched<FragmentShader>::value) {
+                    // only batched fragment shaders use them (see writeSpan)
+                    ddx = (planes.ddx.var - vars[0] * planes.ddx.hypInterp) * w;
+                    ddy = (planes.ddy.var - vars[0] * planes.ddy.hypInterp) * w;
                 }
+                written[count] = visible;
+                xs[count] = x;
+                count++;
+            }
+            if (count == 0)
+                return;
+
+            // fragment shader, once per pixel
+            if (is_positioned<FragmentShader>::value) {
+                for (int i = 0; i < count; i++)
+                    cols[i] = this->shadePixel(vars[i], xs[i], y, is_positioned<FragmentShader>());
+            }
+            else
+                this->shadeFragments(vars, count, ddx, ddy, cols, is_batched<FragmentShader>());
+
+            for (int i = 0; i < count; i++) {
+                uint32_t col = Colors::toRGBA32(cols[i]);
+                uint32_t *colors = msb.colorsAt(xs[i], y);
+                for (int s = 0; s < msb.samples; s++)
+                    if (written[i] & (1u << s))
+                        colors[s] = col;
+            }
+        }
+
+        // depth test, shade and write the pixels [xBegin, xEnd) of row y, returns the smallest depth written
+        // (or 2 if every fragment failed the depth test)
+        float writeSpan(int y, int xBegin, int xEnd, const attribute_planes<vertex_out> &planes,
+                        color_buffer &fb, depth_buffer &db, std::false_type) const {
+            // attributes at the first pixel of the span
+            vertex_out attr = planes.valueAt(float(xBegin), float(y));
+            float minWritten = 2.0f; // larger than any depth that can pass the depth test
+
+            for (int x = xBegin; x < xEnd; x++, attr = attr + planes.ddx){
+                // hyperbolic interpolation correction, a single division per fragment
+                float w = 1.0f / attr.hypInterp;
+                float depth = attr.pos.z * w;
+
+                // both buffers have the same layout, so the pixel is at the same index
+                unsigned int idx = Layout::index(x, y, fb.W);
+
+                // early z/depth-test, nothing else is computed for hidden fragments
+                if (!(depth < db.buffer[idx]))
+                    continue;
+
+                // fragment shader
+                Colors::color col = this->shadePixel(attr.var * w, x, y, is_positioned<FragmentShader>());
+
+                fb.buffer[idx] = Colors::toRGBA32(col);
+                db.buffer[idx] = depth;
+                minWritten = std::min(minWritten, depth);
             }
+            return minWritten;
         }
 
+        // same with a batched fragment shader: the fragments of the span that pass the depth test are shaded together,
+        // with the screen space derivatives of their varyings (a span has at most the 4 pixels of a row of a block)
+        float writeSpan(int y, int xBegin, int xEnd, const attribute_planes<vertex_out> &planes,
+                        color_buffer &fb, depth_buffer &db, std::true_type) const {
+            const int maxCount = halfspace_rasterizer::block_size;
+            Varyings vars[maxCount];
+            Colors::color cols[maxCount];
+            unsigned int indices[maxCount];
+            float depths[maxCount];
+            Varyings ddx, ddy;
+            int count = 0;
+
+            vertex_out attr = planes.valueAt(float(xBegin), float(y));
+            for (int x = xBegin; x < xEnd; x++, attr = attr + planes.ddx){
+                float w = 1.0f / attr.hypInterp;
+                float depth = attr.pos.z * w;
+                unsigned int idx = Layout::index(x, y, fb.W);
+                if (!(depth < db.buffer[idx]))
+                    continue;
+
+                vars[count] = attr.var * w;
+                if (count == 0) {
+                    // derivatives of var = attr.var / attr.hypInterp, where both are linear in screen space:
+                    // d(var)/dx = (d(attr.var)/dx - var * d(attr.hypInterp)/dx) / attr.hypInterp, the same for y
+                    ddx = (planes.ddx.var - vars[0] * planes.ddx.hypInterp) * w;
+                    ddy = (planes.ddy.var - vars[0] * planes.ddy.hypInterp) * w;
+                }
+                indices[count] = idx;
+                depths[count] = depth;
+                count++;
+            }
+            if (count == 0)
+                return 2.0f;
+
+            // fragment shader, once for the whole span
+            this->fragmentShader(vars, count, ddx, ddy, cols);
+
+            float minWritten = 2.0f;
+            for (int i = 0; i < count; i++) {
+                fb.buffer[indices[i]] = Colors::toRGBA32(cols[i]);
+                db.buffer[indices[i]] = depths[i];
+                minWritten = std::min(minWritten, depths[i]);
+            }
+            return minWritten;
+        }
 
         // lists of triangle primitives, part of the class so that we avoid reallocating memory every frame
-        std::vector<triangle> m_primitives;
+        std::vector<triangle<vertex_out>> m_primitives;
+        // indices of the triangles in m_primitives that need clipping
+        std::vector<int> m_clipList;
+        // size of the frame buffer we are rendering to, used to discard pixels during rasterization
+        int m_width = 0, m_height = 0;
     };
 
+    // triangle renderer with the default shader program
+    using TriangleRenderer = TriangleRendererT<shaders::default_varyings, shaders::default_vertex_shader, shaders::default_fragment_shader>;
+
 }
 
 #endif //GRAPHICSPROGRAMMINGEXERCISES_OGLTRIANGLERENDERER_H
@@ -5,38 +5,55 @@
 #ifndef ITU_GRAPHICS_PROGRAMMING_SRL_TYPES_H
 #define ITU_GRAPHICS_PROGRAMMING_SRL_TYPES_H
 
+#include "srl_buffer_layout.h"
 
 
 namespace srl {
 
-    template<class T>
+    // the pixels are stored in buffer as defined by Layout (see srl_buffer_layout.h)
+    template<class T, class Layout = layouts::linear>
     class CustomFrameBuffer {
     public:
         unsigned int W, H;
         T *buffer;
 
         CustomFrameBuffer(unsigned int width, unsigned int height): W(width), H(height) {
-            buffer = new T[W * H];
+            buffer = new T[Layout::size(W, H)];
         }
 
-        ~CustomFrameBuffer(){delete[] buffer;} // clean our memory
+        // use memory allocated somewhere else (e.g. a mapped OpenGL buffer), with room for Layout::size(width, height)
+        // values. The memory is not deleted with the frame buffer
+        CustomFrameBuffer(unsigned int width, unsigned int height, T *memory): W(width), H(height), buffer(memory),
+                ownsBuffer(false) {}
+
+        ~CustomFrameBuffer(){if (ownsBuffer) delete[] buffer;} // clean our memory
+
+        CustomFrameBuffer(const CustomFrameBuffer &) = delete;
+        CustomFrameBuffer &operator=(const CustomFrameBuffer &) = delete;
 
         void clearBuffer(T value){
-            int size = W * H;
+            int size = Layout::size(W, H);
             for (int i = 0; i < size; i++)
                 buffer[i] = value;
         }
 
         void paintAt(unsigned int x, unsigned int y, T value){
             assert (x < W && y < H); // ensure valid position, crash if not (sooo dramatic!)
-            buffer[x + y * W] = value;
+            buffer[Layout::index(x, y, W)] = value;
         }
 
         T valueAt(unsigned int x, unsigned int y){
             assert (x < W && y < H);
-            return buffer[x + y * W];
+            return buffer[Layout::index(x, y, W)];
         }
 
+        // copy the W x H pixels to dst, one row after the other (the layout expected by glTexImage2D)
+        void copyToLinear(T *dst) const {
+            Layout::toLinear(buffer, dst, W, H);
+        }
+
+    private:
+        bool ownsBuffer = true;
     };
 
     namespace Colors {
@@ -64,6 +81,7 @@ namespace srl {
 
     // VERTEX AND FRAGMENT
     // -------------------
+    // input vertex, the attributes available to the vertex shader
     struct vertex {
         glm::vec4 pos;
         glm::vec4 norm;
@@ -90,49 +108,121 @@ namespace srl {
         }
     };
 
-    struct fragment {
-        glm::vec4 norm;
+    // vertex after the vertex shader: clip space position, the varyings output by the shader and hypInterp,
+    // which becomes 1/w after the perspective division (used for hyperbolic interpolation).
+    // Varyings can be any struct with the operators +, - (with another Varyings) and *, / (with a float),
+    // only its members are clipped and interpolated (see srl_shaders.h for examples)
+    template<class Varyings>
+    struct shaded_vertex {
+        glm::vec4 pos;
+        Varyings var;
+        float hypInterp = 1.0;
+
+        friend shaded_vertex operator/(shaded_vertex v, float sc) {
+            return shaded_vertex{v.pos / sc, v.var / sc, v.hypInterp / sc};
+        }
+
+        friend shaded_vertex operator*(shaded_vertex v, float sc) {
+            return shaded_vertex{v.pos * sc, v.var * sc, v.hypInterp * sc};
+        }
+
+        friend shaded_vertex operator-(shaded_vertex v1, const shaded_vertex &v2) {
+            return shaded_vertex{v1.pos - v2.pos, v1.var - v2.var, v1.hypInterp - v2.hypInterp};
+        }
+
+        friend shaded_vertex operator+(shaded_vertex v1, const shaded_vertex &v2) {
+            return shaded_vertex{v1.pos + v2.pos, v1.var + v2.var, v1.hypInterp + v2.hypInterp};
+        }
+    };
+
+    template<class Varyings>
+    struct shaded_fragment {
+        Varyings var;
         Colors::color col;
         glm::ivec2 pos;
-        glm::vec2 uv;
         float depth;
     };
 
 
     // PRIMITIVES
     // ----------
+    template<class Vertex>
     struct point {
-        vertex v1;
+        Vertex v1;
         bool rejected = false;
     };
 
+    template<class Vertex>
     struct line {
-        vertex v1;
-        vertex v2;
+        Vertex v1;
+        Vertex v2;
         bool rejected = false;
     };
 
+    // screen space plane equations of all the attributes of a vertex (one plane per float).
+    // The attributes at pixel (x, y) are origin + ddx * (x - at.x) + ddy * (y - at.y), so moving one pixel
+    // to the right only requires adding ddx.
+    template<class Vertex>
+    struct attribute_planes {
+        Vertex origin;
+        Vertex ddx;
+        Vertex ddy;
+        glm::vec2 at;
+
+        Vertex valueAt(float x, float y) const {
+            return origin + ddx * (x - at.x) + ddy * (y - at.y);
+        }
+    };
+
+    template<class Vertex>
     struct triangle {
-        vertex v1;
-        vertex v2;
-        vertex v3;
+        Vertex v1;
+        Vertex v2;
+        Vertex v3;
         glm::ivec2 p1, p2, p3;
         bool rejected = false;
+        // frustum planes the triangle must be clipped against, one bit per plane (see srl_vertex_transform.h)
+        uint32_t clipPlanes = 0;
 
         glm::mat2x2 inverse = glm::mat2x2(1.0f);
         bool inverseReady = false;
 
         glm::vec3 barycentricCoordinatesAt(glm::vec2 at){
+            computeInverse();
+            glm::vec3 barycentric = glm::vec3(inverse * (at - glm::vec2(v3.pos.x, v3.pos.y)), 0);
+            barycentric.z = 1.0f - barycentric.x - barycentric.y;
+
+            return barycentric;
+        }
+
+        // triangle setup, the barycentric coordinates are linear in screen space, so are all the attributes
+        // (the attributes are divided by w, see divideByW, and need the hyperbolic correction after interpolation)
+        attribute_planes<Vertex> attributePlanes(){
+            computeInverse();
+            // derivatives of the first two barycentric coordinates (the third is 1 - the other two)
+            glm::vec2 dBarDx(inverse[0][0], inverse[0][1]);
+            glm::vec2 dBarDy(inverse[1][0], inverse[1][1]);
+
+            Vertex d13 = v1 - v3;
+            Vertex d23 = v2 - v3;
+
+            attribute_planes<Vertex> planes;
+            planes.origin = v3;
+            planes.ddx = d13 * dBarDx.x + d23 * dBarDx.y;
+            planes.ddy = d13 * dBarDy.x + d23 * dBarDy.y;
+            planes.at = glm::vec2(v3.pos.x, v3.pos.y);
+            return planes;
+        }
+
+    private:
+        void computeInverse(){
             if(!inverseReady){
                 // we only need to compute this inverse once per triangle
                 inverse[0] = glm::vec2(v1.pos.x - v3.pos.x, v1.pos.y - v3.pos.y);
                 inverse[1] = glm::vec2(v2.pos.x - v3.pos.x, v2.pos.y - v3.pos.y);
                 inverse = glm::inverse(inverse);
+                inverseReady = true;
             }
-            glm::vec3 barycentric = glm::vec3(inverse * (at - glm::vec2(v3.pos.x, v3.pos.y)), 0);
-            barycentric.z = 1.0f - barycentric.x - barycentric.y;
-
-            return barycentric;
         }
     };
 }
@@ -0,0 +1,177 @@
+//
+// Batched transform of vertex positions to clipping space, and the clipping outcodes of the transformed positions.
+//
+
+#ifndef ITU_GRAPHICS_PROGRAMMING_SRL_VERTEX_TRANSFORM_H
+#define ITU_GRAPHICS_PROGRAMMING_SRL_VERTEX_TRANSFORM_H
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include "glm/glm.hpp"
+#include "srl_types.h"
+
+#if defined(__AVX__)
+#define SRL_VERTEX_TRANSFORM_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SRL_VERTEX_TRANSFORM_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace srl {
+
+    // OUTCODES
+    // --------
+    // one bit for each plane a position is outside of.
+    // The bits 0 to 5 are the sides of the viewing frustum in the same order used for clipping (x, y, z at +w, then
+    // x, y, z at -w), the bits 6 to 9 are the sides of the guard band, a region guardBand times larger than the viewport.
+    // Triangles that cross the frustum sides but not the guard band do not need to be clipped, the pixels outside of
+    // the viewport are discarded during rasterization. This also keeps the window coordinates small enough for the
+    // integer edge functions of the rasterizer.
+    namespace outcodes {
+        const float guardBand = 4.0f;
+
+        const uint32_t frustum = 0x3fu;
+        const uint32_t nearFar = (1u << 2) | (1u << 5);
+        const uint32_t guardBandSides = 0xfu << 6;
+        // planes that really need clipping: near, far and the guard band
+        const uint32_t mustClip = nearFar | guardBandSides;
+
+        inline uint32_t compute(const glm::vec4 &p){
+            float gw = p.w * guardBand;
+            return uint32_t(p.x > p.w) | uint32_t(p.y > p.w) << 1 | uint32_t(p.z > p.w) << 2 |
+                   uint32_t(-p.x > p.w) << 3 | uint32_t(-p.y > p.w) << 4 | uint32_t(-p.z > p.w) << 5 |
+                   uint32_t(p.x > gw) << 6 | uint32_t(p.y > gw) << 7 |
+                   uint32_t(-p.x > gw) << 8 | uint32_t(-p.y > gw) << 9;
+        }
+    }
+
+    // clip space positions in SoA layout (one array per coordinate)
+    struct clip_positions {
+        std::vector<float> x, y, z, w;
+
+        void resize(size_t size) { x.resize(size); y.resize(size); z.resize(size); w.resize(size); }
+        glm::vec4 at(size_t i) const { return glm::vec4(x[i], y[i], z[i], w[i]); }
+    };
+
+    // transform the positions of count vertices by mvp and compute their outcodes,
+    // 8 (with AVX) or 4 (with SSE) vertices are processed at the same time
+    inline void transformPositions(const glm::mat4 &mvp, const vertex *in, int count,
+                                   clip_positions &out, uint32_t *codes){
+        out.resize(count);
+        int i = 0;
+
+#if defined(SRL_VERTEX_TRANSFORM_AVX) || defined(SRL_VERTEX_TRANSFORM_SSE)
+#ifdef SRL_VERTEX_TRANSFORM_AVX
+        typedef __m256 simd;
+        const int width = 8;
+        #define SIMD_SET1 _mm256_set1_ps
+        #define SIMD_ADD _mm256_add_ps
+        #define SIMD_MUL _mm256_mul_ps
+        #define SIMD_SUB _mm256_sub_ps
+        #define SIMD_AND _mm256_and_ps
+        #define SIMD_OR _mm256_or_ps
+        #define SIMD_GT(a, b) _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+        #define SIMD_STORE _mm256_storeu_ps
+        #define SIMD_ZERO _mm256_setzero_ps
+#else
+        typedef __m128 simd;
+        const int width = 4;
+        #define SIMD_SET1 _mm_set1_ps
+        #define SIMD_ADD _mm_add_ps
+        #define SIMD_MUL _mm_mul_ps
+        #define SIMD_SUB _mm_sub_ps
+        #define SIMD_AND _mm_and_ps
+        #define SIMD_OR _mm_or_ps
+        #define SIMD_GT _mm_cmpgt_ps
+        #define SIMD_STORE _mm_storeu_ps
+        #define SIMD_ZERO _mm_setzero_ps
+#endif
+        // matrix elements, broadcast to all lanes
+        simd m[4][4];
+        for (int c = 0; c < 4; c++)
+            for (int r = 0; r < 4; r++)
+                m[c][r] = SIMD_SET1(mvp[c][r]);
+
+        // outcode bits as floats, so that they can be combined with the comparison masks
+        simd bits[10];
+        for (int b = 0; b < 10; b++) {
+            uint32_t bit = 1u << b;
+            float f;
+            memcpy(&f, &bit, sizeof(float));
+            bits[b] = SIMD_SET1(f);
+        }
+        const simd guard = SIMD_SET1(outcodes::guardBand);
+        const simd zero = SIMD_ZERO();
+
+        for (; i + width <= count; i += width) {
+            // load the positions (AoS) and transpose them to SoA, 4 at a time
+            simd px, py, pz, pw;
+#ifdef SRL_VERTEX_TRANSFORM_AVX
+            __m128 lo[4], hi[4];
+            for (int k = 0; k < 4; k++) {
+                lo[k] = _mm_loadu_ps(&in[i + k].pos.x);
+                hi[k] = _mm_loadu_ps(&in[i + 4 + k].pos.x);
+            }
+            _MM_TRANSPOSE4_PS(lo[0], lo[1], lo[2], lo[3]);
+            _MM_TRANSPOSE4_PS(hi[0], hi[1], hi[2], hi[3]);
+            px = _mm256_insertf128_ps(_mm256_castps128_ps256(lo[0]), hi[0], 1);
+            py = _mm256_insertf128_ps(_mm256_castps128_ps256(lo[1]), hi[1], 1);
+            pz = _mm256_insertf128_ps(_mm256_castps128_ps256(lo[2]), hi[2], 1);
+            pw = _mm256_insertf128_ps(_mm256_castps128_ps256(lo[3]), hi[3], 1);
+#else
+            px = _mm_loadu_ps(&in[i].pos.x);
+            py = _mm_loadu_ps(&in[i + 1].pos.x);
+            pz = _mm_loadu_ps(&in[i + 2].pos.x);
+            pw = _mm_loadu_ps(&in[i + 3].pos.x);
+            _MM_TRANSPOSE4_PS(px, py, pz, pw);
+#endif
+            // clip position = mvp * position
+            simd c[4];
+            for (int r = 0; r < 4; r++)
+                c[r] = SIMD_ADD(SIMD_ADD(SIMD_MUL(m[0][r], px), SIMD_MUL(m[1][r], py)),
+                                SIMD_ADD(SIMD_MUL(m[2][r], pz), SIMD_MUL(m[3][r], pw)));
+
+            SIMD_STORE(&out.x[i], c[0]);
+            SIMD_STORE(&out.y[i], c[1]);
+            SIMD_STORE(&out.z[i], c[2]);
+            SIMD_STORE(&out.w[i], c[3]);
+
+            // outcodes, each comparison sets all bits of the lanes where it is true
+            simd gw = SIMD_MUL(c[3], guard);
+            simd nx = SIMD_SUB(zero, c[0]), ny = SIMD_SUB(zero, c[1]), nz = SIMD_SUB(zero, c[2]);
+            simd code = SIMD_AND(SIMD_GT(c[0], c[3]), bits[0]);
+            code = SIMD_OR(code, SIMD_AND(SIMD_GT(c[1], c[3]), bits[1]));
+            code = SIMD_OR(code, SIMD_AND(SIMD_GT(c[2], c[3]), bits[2]));
+            code = SIMD_OR(code, SIMD_AND(SIMD_GT(nx, c[3]), bits[3]));
+            code = SIMD_OR(code, SIMD_AND(SIMD_GT(ny, c[3]), bits[4]));
+            code = SIMD_OR(code, SIMD_AND(SIMD_GT(nz, c[3]), bits[5]));
+            code = SIMD_OR(code, SIMD_AND(SIMD_GT(c[0], gw), bits[6]));
+            code = SIMD_OR(code, SIMD_AND(SIMD_GT(c[1], gw), bits[7]));
+            code = SIMD_OR(code, SIMD_AND(SIMD_GT(nx, gw), bits[8]));
+            code = SIMD_OR(code, SIMD_AND(SIMD_GT(ny, gw), bits[9]));
+            SIMD_STORE(reinterpret_cast<float*>(codes + i), code);
+        }
+
+        #undef SIMD_SET1
+        #undef SIMD_ADD
+        #undef SIMD_MUL
+        #undef SIMD_SUB
+        #undef SIMD_AND
+        #undef SIMD_OR
+        #undef SIMD_GT
+        #undef SIMD_STORE
+        #undef SIMD_ZERO
+#endif
+
+        // remaining vertices (or all of them without SIMD)
+        for (; i < count; i++) {
+            glm::vec4 p = mvp * in[i].pos;
+            out.x[i] = p.x; out.y[i] = p.y; out.z[i] = p.z; out.w[i] = p.w;
+            codes[i] = outcodes::compute(p);
+        }
+    }
+}
+
+#endif //ITU_GRAPHICS_PROGRAMMING_SRL_VERTEX_TRANSFORM_H